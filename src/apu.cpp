@@ -0,0 +1,539 @@
+#include "apu.h"
+#include "dma.h"
+#include "gba.h"
+#include <cstring>
+
+static constexpr uint32_t APU_MAX_BUFFERED_SAMPLES = 2 * (APU_DEFAULT_SAMPLE_RATE / 2);
+
+// Square wave patterns for the four duty cycles (12.5%, 25%, 50%, 75%), one bit per step.
+static constexpr uint8_t APU_DUTY_PATTERNS[4] = { 0x01, 0x81, 0x87, 0x7E };
+
+static constexpr uint16_t SOUND_RESTART_FLAG = 1 << 15;
+static constexpr uint16_t SOUND_LENGTH_ENABLE_FLAG = 1 << 14;
+static constexpr uint16_t SOUND_MASTER_ENABLE_FLAG = 1 << 7;
+static constexpr uint16_t SOUND3_ENABLE_FLAG = 1 << 7;
+static constexpr uint16_t SOUND_FIFO_A_RESET_FLAG = 1 << 11;
+static constexpr uint16_t SOUND_FIFO_B_RESET_FLAG = 1 << 15;
+
+static constexpr uint32_t SOUND_PSG_REGISTERS_START = REG_SOUND1_SWEEP;
+static constexpr uint32_t SOUND_PSG_REGISTERS_END = REG_SOUND_CONTROL_L + 2;
+
+inline void apu_init_envelope(APUEnvelope& envelope, uint16_t control) {
+  envelope.step_time = (control >> 8) & 0x7;
+  envelope.increase = control & (1 << 11);
+  envelope.volume = control >> 12;
+  envelope.timer = envelope.step_time;
+}
+
+// A channel with a silent, decreasing envelope has its DAC turned off.
+inline bool apu_envelope_dac_enabled(APUEnvelope const& envelope) {
+  return envelope.volume > 0 || envelope.increase;
+}
+
+inline void apu_clock_envelope(APUEnvelope& envelope) {
+  if (envelope.step_time == 0) return;
+  if (--envelope.timer > 0) return;
+
+  envelope.timer = envelope.step_time;
+  if (envelope.increase && envelope.volume < 15) {
+    envelope.volume++;
+  } else if (!envelope.increase && envelope.volume > 0) {
+    envelope.volume--;
+  }
+}
+
+template<typename Channel>
+inline void apu_clock_length(Channel& channel, uint16_t control) {
+  if ((control & SOUND_LENGTH_ENABLE_FLAG) == 0 || channel.length == 0) return;
+  if (--channel.length == 0) {
+    channel.enabled = false;
+  }
+}
+
+inline int32_t apu_square_period(uint16_t control) {
+  return 16 * (2048 - (control & 0x7FF));
+}
+
+inline int32_t apu_wave_period(uint16_t control) {
+  return 8 * (2048 - (control & 0x7FF));
+}
+
+inline int32_t apu_noise_period(uint16_t control) {
+  uint32_t ratio = control & 0x7;
+  uint32_t shift = (control >> 4) & 0xF;
+  return (ratio == 0 ? 16 : 32 * ratio) << (shift + 1);
+}
+
+// Count down `timer` by `cycles`, returns how many times the period elapsed.
+inline uint32_t apu_run_timer(int32_t& timer, int32_t period, uint32_t cycles) {
+  timer -= cycles;
+  if (timer > 0) return 0;
+
+  uint32_t steps = (uint32_t)(-timer) / period + 1;
+  timer += steps * period;
+  return steps;
+}
+
+uint16_t apu_sweep_next_frequency(APUSquareChannel& channel, uint16_t sweep) {
+  uint32_t shift = sweep & 0x7;
+  uint32_t delta = channel.sweep_frequency >> shift;
+  return (sweep & (1 << 3)) ? channel.sweep_frequency - delta : channel.sweep_frequency + delta;
+}
+
+void apu_trigger_square(RAM& ram, APUSquareChannel& channel, uint32_t duty_address, uint32_t frequency_address, bool has_sweep) {
+  uint16_t duty = ram_read_half_word_direct(ram, duty_address);
+  uint16_t frequency = ram_read_half_word_direct(ram, frequency_address);
+
+  apu_init_envelope(channel.envelope, duty);
+  channel.enabled = apu_envelope_dac_enabled(channel.envelope);
+  channel.length = 64 - (duty & 0x3F);
+  channel.timer = apu_square_period(frequency);
+
+  if (!has_sweep) return;
+
+  uint16_t sweep = ram_read_half_word_from_io_registers_fast<REG_SOUND1_SWEEP>(ram);
+  uint8_t sweep_time = (sweep >> 4) & 0x7;
+  channel.sweep_frequency = frequency & 0x7FF;
+  channel.sweep_timer = sweep_time ? sweep_time : 8;
+  channel.sweep_enabled = sweep_time != 0 || (sweep & 0x7) != 0;
+
+  if ((sweep & 0x7) != 0 && apu_sweep_next_frequency(channel, sweep) > 0x7FF) {
+    channel.enabled = false;
+  }
+}
+
+void apu_clock_sweep(RAM& ram, APUSquareChannel& channel) {
+  if (!channel.sweep_enabled || --channel.sweep_timer > 0) return;
+
+  uint16_t sweep = ram_read_half_word_from_io_registers_fast<REG_SOUND1_SWEEP>(ram);
+  uint8_t sweep_time = (sweep >> 4) & 0x7;
+  channel.sweep_timer = sweep_time ? sweep_time : 8;
+  if (sweep_time == 0) return;
+
+  uint16_t next_frequency = apu_sweep_next_frequency(channel, sweep);
+  if (next_frequency > 0x7FF) {
+    channel.enabled = false;
+    return;
+  }
+
+  if ((sweep & 0x7) != 0) {
+    channel.sweep_frequency = next_frequency;
+    uint16_t control = ram_read_half_word_from_io_registers_fast<REG_SOUND1_FREQUENCY>(ram);
+    ram_write_half_word_to_io_registers_fast<REG_SOUND1_FREQUENCY>(ram, (control & ~0x7FF) | next_frequency);
+  }
+}
+
+void apu_trigger_wave(RAM& ram, APUWaveChannel& channel) {
+  uint16_t select = ram_read_half_word_from_io_registers_fast<REG_SOUND3_SELECT>(ram);
+  uint16_t length_volume = ram_read_half_word_from_io_registers_fast<REG_SOUND3_LENGTH_VOLUME>(ram);
+  uint16_t frequency = ram_read_half_word_from_io_registers_fast<REG_SOUND3_FREQUENCY>(ram);
+
+  channel.enabled = select & SOUND3_ENABLE_FLAG;
+  channel.length = 256 - (length_volume & 0xFF);
+  channel.position = 0;
+  channel.timer = apu_wave_period(frequency);
+}
+
+// Swap the wave banks when the game selects another one for playback.
+void apu_select_wave_bank(RAM& ram, APUWaveChannel& channel, uint16_t select) {
+  if ((select & SOUND3_ENABLE_FLAG) == 0) {
+    channel.enabled = false;
+  }
+
+  uint8_t bank = (select >> 6) & 1;
+  if (bank == channel.playing_bank) return;
+
+  uint8_t* accessible_bank = ram_read_memory_from_io_registers_fast<REG_WAVE_RAM>(ram);
+  uint8_t previous[APU_WAVE_BANK_SIZE];
+  memcpy(previous, accessible_bank, APU_WAVE_BANK_SIZE);
+  memcpy(accessible_bank, channel.wave_ram[channel.playing_bank], APU_WAVE_BANK_SIZE);
+  memcpy(channel.wave_ram[bank], previous, APU_WAVE_BANK_SIZE);
+  channel.playing_bank = bank;
+}
+
+void apu_trigger_noise(RAM& ram, APUNoiseChannel& channel) {
+  uint16_t length_envelope = ram_read_half_word_from_io_registers_fast<REG_SOUND4_LENGTH_ENVELOPE>(ram);
+  uint16_t frequency = ram_read_half_word_from_io_registers_fast<REG_SOUND4_FREQUENCY>(ram);
+
+  apu_init_envelope(channel.envelope, length_envelope);
+  channel.enabled = apu_envelope_dac_enabled(channel.envelope);
+  channel.length = 64 - (length_envelope & 0x3F);
+  channel.lfsr = 0x7FFF;
+  channel.timer = apu_noise_period(frequency);
+}
+
+void apu_reset_fifo(APUFifo& fifo) {
+  fifo.read_index = 0;
+  fifo.count = 0;
+  fifo.sample = 0;
+}
+
+void apu_push_fifo(APUFifo& fifo, uint32_t value) {
+  for (int i = 0; i < 4 && fifo.count < APU_FIFO_SIZE; i++) {
+    fifo.data[(fifo.read_index + fifo.count) % APU_FIFO_SIZE] = (int8_t)(value >> (i * 8));
+    fifo.count++;
+  }
+}
+
+void apu_pop_fifo(CPU& cpu, APU& apu, uint8_t fifo_index, uint32_t fifo_address) {
+  APUFifo& fifo = apu.fifos[fifo_index];
+  if (fifo.count > 0) {
+    apu.fifo_events.push_back({ cpu.cycle_count, fifo_index, fifo.data[fifo.read_index] });
+    fifo.read_index = (fifo.read_index + 1) % APU_FIFO_SIZE;
+    fifo.count--;
+  }
+
+  if (fifo.count <= APU_FIFO_REFILL_THRESHOLD) {
+    dma_request_fifo(cpu, fifo_address);
+  }
+}
+
+void apu_clock_frame_sequencer(RAM& ram, APU& apu) {
+  uint8_t step = apu.frame_sequencer_step;
+  apu.frame_sequencer_step = (step + 1) & 7;
+
+  // Length counters run at 256Hz.
+  if ((step & 1) == 0) {
+    apu_clock_length(apu.square[0], ram_read_half_word_from_io_registers_fast<REG_SOUND1_FREQUENCY>(ram));
+    apu_clock_length(apu.square[1], ram_read_half_word_from_io_registers_fast<REG_SOUND2_FREQUENCY>(ram));
+    apu_clock_length(apu.wave, ram_read_half_word_from_io_registers_fast<REG_SOUND3_FREQUENCY>(ram));
+    apu_clock_length(apu.noise, ram_read_half_word_from_io_registers_fast<REG_SOUND4_FREQUENCY>(ram));
+  }
+
+  // Sweep runs at 128Hz.
+  if (step == 2 || step == 6) {
+    apu_clock_sweep(ram, apu.square[0]);
+  }
+
+  // Envelopes run at 64Hz.
+  if (step == 7) {
+    apu_clock_envelope(apu.square[0].envelope);
+    apu_clock_envelope(apu.square[1].envelope);
+    apu_clock_envelope(apu.noise.envelope);
+  }
+}
+
+// Catch the PSG channels up with the cycles run since the previous sample.
+void apu_advance(RAM& ram, APU& apu, uint32_t cycles) {
+  apu.frame_sequencer_cycles += cycles;
+  while (apu.frame_sequencer_cycles >= APU_FRAME_SEQUENCER_PERIOD) {
+    apu.frame_sequencer_cycles -= APU_FRAME_SEQUENCER_PERIOD;
+    apu_clock_frame_sequencer(ram, apu);
+  }
+
+  static constexpr uint32_t square_frequency_registers[2] = { REG_SOUND1_FREQUENCY, REG_SOUND2_FREQUENCY };
+  for (int i = 0; i < 2; i++) {
+    APUSquareChannel& channel = apu.square[i];
+    if (!channel.enabled) continue;
+
+    int32_t period = apu_square_period(ram_read_half_word_direct(ram, square_frequency_registers[i]));
+    uint32_t steps = apu_run_timer(channel.timer, period, cycles);
+    channel.duty_step = (channel.duty_step + steps) & 7;
+  }
+
+  if (apu.wave.enabled) {
+    uint16_t select = ram_read_half_word_from_io_registers_fast<REG_SOUND3_SELECT>(ram);
+    uint32_t wave_length = (select & (1 << 5)) ? 64 : 32;
+    int32_t period = apu_wave_period(ram_read_half_word_from_io_registers_fast<REG_SOUND3_FREQUENCY>(ram));
+    uint32_t steps = apu_run_timer(apu.wave.timer, period, cycles);
+    apu.wave.position = (apu.wave.position + steps) % wave_length;
+  }
+
+  if (apu.noise.enabled) {
+    uint16_t frequency = ram_read_half_word_from_io_registers_fast<REG_SOUND4_FREQUENCY>(ram);
+    bool short_mode = frequency & (1 << 3);
+    uint32_t steps = apu_run_timer(apu.noise.timer, apu_noise_period(frequency), cycles);
+    for (uint32_t i = 0; i < steps; i++) {
+      uint16_t lfsr = apu.noise.lfsr;
+      uint16_t bit = (lfsr ^ (lfsr >> 1)) & 1;
+      lfsr = (lfsr >> 1) | (bit << 14);
+      if (short_mode) {
+        lfsr = (lfsr & ~(1 << 6)) | (bit << 6);
+      }
+      apu.noise.lfsr = lfsr;
+    }
+  }
+}
+
+// Channel outputs are centered around zero, -15 to 15.
+int32_t apu_square_output(RAM& ram, APUSquareChannel const& channel, uint32_t duty_address) {
+  if (!channel.enabled) return 0;
+
+  uint8_t duty = (ram_read_half_word_direct(ram, duty_address) >> 6) & 0x3;
+  bool high = (APU_DUTY_PATTERNS[duty] >> channel.duty_step) & 1;
+  return high ? channel.envelope.volume : -channel.envelope.volume;
+}
+
+int32_t apu_wave_output(RAM& ram, APUWaveChannel const& channel) {
+  if (!channel.enabled) return 0;
+
+  uint8_t bank = (channel.playing_bank + channel.position / 32) & 1;
+  uint8_t const* wave_ram = bank == channel.playing_bank
+    ? channel.wave_ram[bank]
+    : ram_read_memory_from_io_registers_fast<REG_WAVE_RAM>(ram);
+
+  // Two samples per byte, high nibble first.
+  uint8_t index = channel.position % 32;
+  uint8_t packed = wave_ram[index / 2];
+  int32_t sample = (index & 1) ? packed & 0xF : packed >> 4;
+  int32_t value = sample * 2 - 15;
+
+  uint16_t length_volume = ram_read_half_word_from_io_registers_fast<REG_SOUND3_LENGTH_VOLUME>(ram);
+  if (length_volume & (1 << 15)) {
+    return value * 3 / 4;
+  }
+  switch ((length_volume >> 13) & 0x3) {
+    case 0: return 0;
+    case 1: return value;
+    case 2: return value / 2;
+    default: return value / 4;
+  }
+}
+
+int32_t apu_noise_output(APUNoiseChannel const& channel) {
+  if (!channel.enabled) return 0;
+  // The output is the inverted low bit of the shift register.
+  return (channel.lfsr & 1) == 0 ? channel.envelope.volume : -channel.envelope.volume;
+}
+
+void apu_mix_sample(RAM& ram, APU& apu) {
+  uint16_t control_x = ram_read_half_word_from_io_registers_fast<REG_SOUND_CONTROL_X>(ram);
+  if ((control_x & SOUND_MASTER_ENABLE_FLAG) == 0) {
+    resampler_push(apu.resampler, 0.0f, 0.0f);
+    return;
+  }
+
+  uint16_t control_l = ram_read_half_word_from_io_registers_fast<REG_SOUND_CONTROL_L>(ram);
+  uint16_t control_h = ram_read_half_word_from_io_registers_fast<REG_SOUND_CONTROL_H>(ram);
+
+  int32_t channels[4] = {
+    apu_square_output(ram, apu.square[0], REG_SOUND1_DUTY_LENGTH),
+    apu_square_output(ram, apu.square[1], REG_SOUND2_DUTY_LENGTH),
+    apu_wave_output(ram, apu.wave),
+    apu_noise_output(apu.noise)
+  };
+
+  // PSG volume is 25%, 50% or 100% (3 is prohibited and treated as 100%).
+  uint32_t psg_shift = 2 - ((control_h & 0x3) > 2 ? 2 : control_h & 0x3);
+
+  int32_t mixed[2];
+  for (int side = 0; side < 2; side++) {
+    // Side 0 is left (upper bits), side 1 is right.
+    uint32_t enable_shift = side == 0 ? 12 : 8;
+    uint32_t master_volume = ((control_l >> (side == 0 ? 4 : 0)) & 0x7) + 1;
+
+    int32_t psg = 0;
+    for (int i = 0; i < 4; i++) {
+      if (control_l & (1 << (enable_shift + i))) {
+        psg += channels[i];
+      }
+    }
+    psg = (psg * (int32_t)master_volume) >> psg_shift;
+
+    // DirectSound samples are 8 bit, at 50% or 100% volume.
+    int32_t direct_sound = 0;
+    for (int fifo = 0; fifo < 2; fifo++) {
+      uint32_t fifo_bits = control_h >> (8 + fifo * 4);
+      bool enabled_on_side = fifo_bits & (side == 0 ? 2 : 1);
+      if (!enabled_on_side) continue;
+
+      bool full_volume = control_h & (1 << (2 + fifo));
+      direct_sound += apu.fifos[fifo].sample * (full_volume ? 4 : 2);
+    }
+
+    mixed[side] = (psg + direct_sound) * 32;
+  }
+
+  resampler_push(apu.resampler, (float)mixed[0], (float)mixed[1]);
+}
+
+void apu_disable_psg(RAM& ram, APU& apu) {
+  apu.square[0].enabled = false;
+  apu.square[1].enabled = false;
+  apu.wave.enabled = false;
+  apu.noise.enabled = false;
+
+  // Turning the sound off clears the PSG registers.
+  memset(&ram.io_registers[SOUND_PSG_REGISTERS_START & MEMORY_NOT_MASK], 0, SOUND_PSG_REGISTERS_END - SOUND_PSG_REGISTERS_START);
+}
+
+inline void apu_sync(RAM& ram, APU& apu) {
+  apu_render(ram, apu, ram.gba->cpu.cycle_count);
+}
+
+void apu_init(GBA& gba) {
+  apu_reset(gba.apu);
+
+  // Hooked registers render the audio up to the write first, so the change lands at the right time.
+  // Stores keep the size of the write, a word write also sets the next register.
+  // Registers without hooks are picked up at block granularity.
+
+  // Writing the restart bit (re)starts a PSG channel. The bit itself always reads as zero.
+  ram_register_write_hook(gba.cpu.ram, REG_SOUND1_FREQUENCY, [](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+    APU& apu = ram.gba->apu;
+    apu_sync(ram, apu);
+    ram_write_direct(ram, address, value & ~SOUND_RESTART_FLAG, size);
+    if (value & SOUND_RESTART_FLAG) {
+      apu_trigger_square(ram, apu.square[0], REG_SOUND1_DUTY_LENGTH, REG_SOUND1_FREQUENCY, true);
+    }
+  });
+  ram_register_write_hook(gba.cpu.ram, REG_SOUND2_FREQUENCY, [](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+    APU& apu = ram.gba->apu;
+    apu_sync(ram, apu);
+    ram_write_direct(ram, address, value & ~SOUND_RESTART_FLAG, size);
+    if (value & SOUND_RESTART_FLAG) {
+      apu_trigger_square(ram, apu.square[1], REG_SOUND2_DUTY_LENGTH, REG_SOUND2_FREQUENCY, false);
+    }
+  });
+  ram_register_write_hook(gba.cpu.ram, REG_SOUND3_FREQUENCY, [](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+    APU& apu = ram.gba->apu;
+    apu_sync(ram, apu);
+    ram_write_direct(ram, address, value & ~SOUND_RESTART_FLAG, size);
+    if (value & SOUND_RESTART_FLAG) {
+      apu_trigger_wave(ram, apu.wave);
+    }
+  });
+  ram_register_write_hook(gba.cpu.ram, REG_SOUND4_FREQUENCY, [](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+    APU& apu = ram.gba->apu;
+    apu_sync(ram, apu);
+    ram_write_direct(ram, address, value & ~SOUND_RESTART_FLAG, size);
+    if (value & SOUND_RESTART_FLAG) {
+      apu_trigger_noise(ram, apu.noise);
+    }
+  });
+
+  ram_register_write_hook(gba.cpu.ram, REG_SOUND3_SELECT, [](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+    APU& apu = ram.gba->apu;
+    apu_sync(ram, apu);
+    apu_select_wave_bank(ram, apu.wave, (uint16_t)value);
+    ram_write_direct(ram, address, value, size);
+  });
+
+  // The FIFO reset bits are write-only.
+  ram_register_write_hook(gba.cpu.ram, REG_SOUND_CONTROL_H, [](RAM& ram, uint32_t address, uint32_t value, uint32_t) {
+    APU& apu = ram.gba->apu;
+    apu_sync(ram, apu);
+    if (value & SOUND_FIFO_A_RESET_FLAG) apu_reset_fifo(apu.fifos[0]);
+    if (value & SOUND_FIFO_B_RESET_FLAG) apu_reset_fifo(apu.fifos[1]);
+    ram_write_half_word_direct(ram, address, value & ~(SOUND_FIFO_A_RESET_FLAG | SOUND_FIFO_B_RESET_FLAG));
+  });
+
+  // Only the master enable is writable, the low bits report which PSG channels are playing.
+  ram_register_write_hook(gba.cpu.ram, REG_SOUND_CONTROL_X, [](RAM& ram, uint32_t address, uint32_t value, uint32_t) {
+    APU& apu = ram.gba->apu;
+    apu_sync(ram, apu);
+    if ((value & SOUND_MASTER_ENABLE_FLAG) == 0) {
+      apu_disable_psg(ram, apu);
+    }
+    ram_write_half_word_direct(ram, address, value & SOUND_MASTER_ENABLE_FLAG);
+  });
+  ram_register_read_hook(gba.cpu.ram, REG_SOUND_CONTROL_X, [](RAM& ram, uint32_t address) {
+    APU& apu = ram.gba->apu;
+    uint32_t value = ram_read_half_word_direct(ram, address) & SOUND_MASTER_ENABLE_FLAG;
+    value |= apu.square[0].enabled ? 1 : 0;
+    value |= apu.square[1].enabled ? 2 : 0;
+    value |= apu.wave.enabled ? 4 : 0;
+    value |= apu.noise.enabled ? 8 : 0;
+    return value;
+  });
+
+  // FIFO writes are taken as words, which is how both DMA and the sound drivers fill them.
+  ram_register_write_hook(gba.cpu.ram, REG_FIFO_A, [](RAM& ram, uint32_t, uint32_t value, uint32_t) {
+    apu_push_fifo(ram.gba->apu.fifos[0], value);
+  });
+  ram_register_write_hook(gba.cpu.ram, REG_FIFO_B, [](RAM& ram, uint32_t, uint32_t value, uint32_t) {
+    apu_push_fifo(ram.gba->apu.fifos[1], value);
+  });
+}
+
+void apu_reset(APU& apu) {
+  bool enabled = apu.enabled;
+  uint32_t sample_rate = apu.sample_rate;
+
+  // Keep the resampler, so its filter is not rebuilt when the rate stays the same.
+  Resampler resampler = std::move(apu.resampler);
+
+  apu = APU();
+  apu.enabled = enabled;
+  apu.resampler = std::move(resampler);
+  apu_set_sample_rate(apu, sample_rate);
+}
+
+void apu_set_sample_rate(APU& apu, uint32_t sample_rate) {
+  apu.sample_rate = sample_rate > 0 ? sample_rate : APU_DEFAULT_SAMPLE_RATE;
+  resampler_init(apu.resampler, APU_NATIVE_SAMPLE_RATE, apu.sample_rate);
+}
+
+void apu_set_enabled(APU& apu, bool enabled) {
+  apu.enabled = enabled;
+}
+
+void apu_cycle(CPU& cpu, APU& apu, Timer& timer) {
+  if (timer.overflow_flags[0] || timer.overflow_flags[1]) {
+    uint16_t control_x = ram_read_half_word_from_io_registers_fast<REG_SOUND_CONTROL_X>(cpu.ram);
+    uint16_t control_h = ram_read_half_word_from_io_registers_fast<REG_SOUND_CONTROL_H>(cpu.ram);
+    if (control_x & SOUND_MASTER_ENABLE_FLAG) {
+      // Each FIFO plays its next sample when its selected timer (0 or 1) overflows.
+      if (timer.overflow_flags[(control_h >> 10) & 1]) apu_pop_fifo(cpu, apu, 0, REG_FIFO_A);
+      if (timer.overflow_flags[(control_h >> 14) & 1]) apu_pop_fifo(cpu, apu, 1, REG_FIFO_B);
+    }
+  }
+
+  if (cpu.cycle_count - apu.rendered_cycle >= APU_BLOCK_CYCLES) {
+    apu_render(cpu.ram, apu, cpu.cycle_count);
+  }
+}
+
+void apu_render(RAM& ram, APU& apu, uint64_t cycle) {
+  // The cycle counter went back (reset), start over from there.
+  if (cycle < apu.rendered_cycle) {
+    apu.rendered_cycle = cycle;
+  }
+
+  size_t next_event = 0;
+  auto apply_events_until = [&apu, &next_event](uint64_t until) {
+    while (next_event < apu.fifo_events.size() && apu.fifo_events[next_event].cycle <= until) {
+      APUFifoEvent const& event = apu.fifo_events[next_event++];
+      apu.fifos[event.fifo].sample = event.sample;
+    }
+  };
+
+  if (!apu.enabled) {
+    apply_events_until(cycle);
+    apu.fifo_events.clear();
+    apu.rendered_cycle = cycle;
+    return;
+  }
+
+  // Native samples are taken on multiples of APU_NATIVE_SAMPLE_PERIOD cycles.
+  uint64_t position = apu.rendered_cycle;
+  while (true) {
+    uint64_t sample_cycle = (position / APU_NATIVE_SAMPLE_PERIOD + 1) * APU_NATIVE_SAMPLE_PERIOD;
+    if (sample_cycle > cycle) break;
+
+    apu_advance(ram, apu, sample_cycle - position);
+    apply_events_until(sample_cycle);
+    apu_mix_sample(ram, apu);
+    position = sample_cycle;
+  }
+
+  apu_advance(ram, apu, cycle - position);
+  apply_events_until(cycle);
+  apu.fifo_events.clear();
+  apu.rendered_cycle = cycle;
+
+  if (apu.samples.size() >= APU_MAX_BUFFERED_SAMPLES) {
+    // Nobody is reading, drop the oldest half instead of growing forever.
+    apu.samples.erase(apu.samples.begin(), apu.samples.begin() + APU_MAX_BUFFERED_SAMPLES / 2);
+  }
+  resampler_process(apu.resampler, apu.samples);
+}
+
+uint32_t apu_read_samples(APU& apu, int16_t* out, uint32_t max_frames) {
+  uint32_t frames = apu.samples.size() / 2;
+  if (frames > max_frames) frames = max_frames;
+
+  memcpy(out, apu.samples.data(), frames * 2 * sizeof(int16_t));
+  apu.samples.erase(apu.samples.begin(), apu.samples.begin() + frames * 2);
+  return frames;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "cpu.h"
+#include "timer.h"
+#include "resampler.h"
+
+static constexpr uint32_t APU_CPU_FREQUENCY = 16777216;
+
+// The mixer runs at the hardware rate, its output is resampled to the sample rate of the APU.
+static constexpr uint32_t APU_NATIVE_SAMPLE_RATE = 32768;
+static constexpr uint32_t APU_NATIVE_SAMPLE_PERIOD = APU_CPU_FREQUENCY / APU_NATIVE_SAMPLE_RATE;
+static constexpr uint32_t APU_DEFAULT_SAMPLE_RATE = 48000;
+
+// Audio is rendered in blocks of at least one scanline.
+static constexpr uint32_t APU_BLOCK_CYCLES = 1232;
+
+// The frame sequencer clocks length counters, sweep and envelopes at 512Hz.
+static constexpr uint32_t APU_FRAME_SEQUENCER_PERIOD = APU_CPU_FREQUENCY / 512;
+
+static constexpr uint32_t APU_FIFO_SIZE = 32;
+// A FIFO asks for another 16 bytes once it is down to this many.
+static constexpr uint32_t APU_FIFO_REFILL_THRESHOLD = 16;
+
+static constexpr uint32_t APU_WAVE_BANK_SIZE = 16;
+
+struct APUEnvelope {
+  uint8_t volume = 0;
+  uint8_t step_time = 0;
+  uint8_t timer = 0;
+  bool increase = false;
+};
+
+// Channels 1 and 2. Only channel 1 has a frequency sweep.
+struct APUSquareChannel {
+  bool enabled = false;
+  uint32_t length = 0;
+  int32_t timer = 0;
+  uint8_t duty_step = 0;
+  APUEnvelope envelope;
+
+  bool sweep_enabled = false;
+  uint8_t sweep_timer = 0;
+  uint16_t sweep_frequency = 0;
+};
+
+struct APUWaveChannel {
+  bool enabled = false;
+  uint32_t length = 0;
+  int32_t timer = 0;
+  uint8_t position = 0;
+
+  // The bank being played lives here, the I/O registers hold the bank the CPU can access.
+  uint8_t wave_ram[2][APU_WAVE_BANK_SIZE] = {};
+  uint8_t playing_bank = 0;
+};
+
+struct APUNoiseChannel {
+  bool enabled = false;
+  uint32_t length = 0;
+  int32_t timer = 0;
+  uint16_t lfsr = 0x7FFF;
+  APUEnvelope envelope;
+};
+
+// DirectSound A/B. Filled with signed 8 bit samples by the CPU or by DMA1/DMA2.
+struct APUFifo {
+  int8_t data[APU_FIFO_SIZE] = {};
+  uint8_t read_index = 0;
+  uint8_t count = 0;
+
+  // Sample currently heard, updated from the FIFO events while rendering.
+  int8_t sample = 0;
+};
+
+// A sample taken from a FIFO on a timer overflow, mixed in once rendering reaches `cycle`.
+struct APUFifoEvent {
+  uint64_t cycle;
+  uint8_t fifo;
+  int8_t sample;
+};
+
+struct APU {
+  APUSquareChannel square[2];
+  APUWaveChannel wave;
+  APUNoiseChannel noise;
+  APUFifo fifos[2];
+
+  // When disabled the FIFOs and their DMA keep running, but nothing is mixed.
+  bool enabled = true;
+  uint32_t sample_rate = APU_DEFAULT_SAMPLE_RATE;
+
+  uint64_t rendered_cycle = 0;
+  std::vector<APUFifoEvent> fifo_events;
+
+  Resampler resampler;
+
+  uint32_t frame_sequencer_cycles = 0;
+  uint8_t frame_sequencer_step = 0;
+
+  // Interleaved stereo samples (left, right) waiting to be read.
+  std::vector<int16_t> samples;
+};
+
+struct GBA;
+
+// Registers the sound register hooks on the instance's RAM, which render the audio up to the current cycle before a write.
+void apu_init(GBA& gba);
+void apu_reset(APU& apu);
+void apu_set_sample_rate(APU& apu, uint32_t sample_rate);
+
+// Turn audio generation off, e.g. for headless runs. The FIFOs still drain, so sound DMA timing is unchanged.
+void apu_set_enabled(APU& apu, bool enabled);
+
+// Advance one cycle. Timer overflows from this cycle drive the DirectSound FIFOs.
+// Audio itself is only rendered once a block worth of cycles has passed.
+void apu_cycle(CPU& cpu, APU& apu, Timer& timer);
+
+// Render everything up to `cycle`.
+void apu_render(RAM& ram, APU& apu, uint64_t cycle);
+
+// Move up to `max_frames` stereo frames into `out`, returns how many were written.
+uint32_t apu_read_samples(APU& apu, int16_t* out, uint32_t max_frames);
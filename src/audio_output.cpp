@@ -0,0 +1,124 @@
+#include "audio_output.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+inline uint32_t audio_ring_copy_in(AudioRingBuffer& ring, uint64_t frame, int16_t const* samples, uint32_t frames) {
+  uint32_t start = frame & (ring.capacity_frames - 1);
+  uint32_t first = std::min(frames, ring.capacity_frames - start);
+  memcpy(ring.samples + start * 2, samples, first * 2 * sizeof(int16_t));
+  memcpy(ring.samples, samples + first * 2, (frames - first) * 2 * sizeof(int16_t));
+  return frames;
+}
+
+inline uint32_t audio_ring_copy_out(AudioRingBuffer const& ring, uint64_t frame, int16_t* samples, uint32_t frames) {
+  uint32_t start = frame & (ring.capacity_frames - 1);
+  uint32_t first = std::min(frames, ring.capacity_frames - start);
+  memcpy(samples, ring.samples + start * 2, first * 2 * sizeof(int16_t));
+  memcpy(samples + first * 2, ring.samples, (frames - first) * 2 * sizeof(int16_t));
+  return frames;
+}
+
+uint32_t audio_ring_fill(AudioRingBuffer const& ring) {
+  uint64_t write_frame = ring.write_frame.load(std::memory_order_acquire);
+  uint64_t read_frame = ring.read_frame.load(std::memory_order_acquire);
+  return (uint32_t)(write_frame - read_frame);
+}
+
+uint32_t audio_ring_write(AudioRingBuffer& ring, int16_t const* samples, uint32_t frames) {
+  uint64_t write_frame = ring.write_frame.load(std::memory_order_relaxed);
+  uint64_t read_frame = ring.read_frame.load(std::memory_order_acquire);
+
+  uint32_t space = ring.capacity_frames - (uint32_t)(write_frame - read_frame);
+  frames = std::min(frames, space);
+  audio_ring_copy_in(ring, write_frame, samples, frames);
+
+  ring.write_frame.store(write_frame + frames, std::memory_order_release);
+  return frames;
+}
+
+uint32_t audio_ring_read(AudioRingBuffer& ring, int16_t* samples, uint32_t frames) {
+  uint64_t read_frame = ring.read_frame.load(std::memory_order_relaxed);
+  uint64_t write_frame = ring.write_frame.load(std::memory_order_acquire);
+
+  frames = std::min(frames, (uint32_t)(write_frame - read_frame));
+  audio_ring_copy_out(ring, read_frame, samples, frames);
+
+  ring.read_frame.store(read_frame + frames, std::memory_order_release);
+  return frames;
+}
+
+// Stands in for the audio device: hands the sink one period at a time, on the wall clock.
+void audio_output_worker(AudioOutput* output) {
+  std::vector<int16_t> period(output->period_frames * 2);
+  auto const period_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>((double)output->period_frames / output->sample_rate)
+  );
+
+  auto next_period = std::chrono::steady_clock::now();
+  while (!output->stop.load(std::memory_order_relaxed)) {
+    uint32_t frames = audio_ring_read(output->ring, period.data(), output->period_frames);
+    if (frames < output->period_frames) {
+      // Underrun, play silence for the rest of the period.
+      memset(period.data() + frames * 2, 0, (output->period_frames - frames) * 2 * sizeof(int16_t));
+      output->underrun_frames.fetch_add(output->period_frames - frames, std::memory_order_relaxed);
+    }
+    output->sink(period.data(), output->period_frames);
+
+    next_period += period_duration;
+    std::this_thread::sleep_until(next_period);
+  }
+}
+
+AudioOutput* audio_output_create(uint32_t sample_rate, uint32_t latency_ms, AudioSinkCallback const& sink) {
+  AudioOutput* output = new AudioOutput();
+  output->sample_rate = sample_rate;
+  output->sink = sink;
+
+  uint32_t latency_frames = std::max<uint32_t>(sample_rate * latency_ms / 1000, 64);
+  output->period_frames = latency_frames / 4;
+
+  // Power of two, so positions wrap with a mask.
+  uint32_t capacity = 1;
+  while (capacity < latency_frames * 2) capacity <<= 1;
+  output->ring.capacity_frames = capacity;
+  output->ring.samples = new int16_t[capacity * 2]();
+
+  output->worker = std::thread(audio_output_worker, output);
+  return output;
+}
+
+void audio_output_destroy(AudioOutput* output) {
+  output->stop.store(true, std::memory_order_relaxed);
+  output->worker.join();
+  delete [] output->ring.samples;
+  delete output;
+}
+
+void audio_output_push(AudioOutput& output, APU& apu, bool wait_for_space) {
+  int16_t const* samples = apu.samples.data();
+  uint32_t frames = apu.samples.size() / 2;
+
+  // Pacing keeps the ring at the target fill (half), the rest is headroom for the rate control.
+  if (wait_for_space) {
+    while (audio_ring_fill(output.ring) > output.ring.capacity_frames / 2 && !output.stop.load(std::memory_order_relaxed)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  while (frames > 0) {
+    uint32_t written = audio_ring_write(output.ring, samples, frames);
+    samples += written * 2;
+    frames -= written;
+
+    if (frames == 0 || !wait_for_space) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // Without waiting, whatever did not fit is dropped.
+  apu.samples.clear();
+
+  // Dynamic rate control: produce slightly fewer samples while the ring is more than half full, and more while it is below.
+  double fill = (double)audio_ring_fill(output.ring) / output.ring.capacity_frames;
+  resampler_set_rate_adjust(apu.resampler, AUDIO_OUTPUT_MAX_RATE_DELTA * (2.0 * fill - 1.0));
+}
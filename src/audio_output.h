@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include "apu.h"
+
+// Largest correction applied to the resampling ratio by the rate control (0.5%).
+static constexpr double AUDIO_OUTPUT_MAX_RATE_DELTA = 0.005;
+
+// Single producer, single consumer ring of interleaved stereo frames.
+// The emulation thread writes, the output thread reads, neither takes a lock.
+struct AudioRingBuffer {
+  int16_t* samples = nullptr;
+  uint32_t capacity_frames = 0;
+
+  // Total frames written and read so far. Each side only stores its own counter.
+  alignas(64) std::atomic<uint64_t> write_frame = 0;
+  alignas(64) std::atomic<uint64_t> read_frame = 0;
+};
+
+// Called on the output thread with a period of audio, like an audio device callback.
+typedef std::function<void(int16_t const* samples, uint32_t frames)> AudioSinkCallback;
+
+// Plays the APU output through a sink at the sample rate of the APU.
+// The output thread pulls one period at a time in real time, the emulation thread keeps the ring half full.
+struct AudioOutput {
+  AudioRingBuffer ring;
+  uint32_t sample_rate = 0;
+  uint32_t period_frames = 0;
+
+  AudioSinkCallback sink;
+  std::thread worker;
+  std::atomic<bool> stop = false;
+
+  // Frames of silence played because the ring ran dry.
+  std::atomic<uint64_t> underrun_frames = 0;
+};
+
+uint32_t audio_ring_fill(AudioRingBuffer const& ring);
+uint32_t audio_ring_write(AudioRingBuffer& ring, int16_t const* samples, uint32_t frames);
+uint32_t audio_ring_read(AudioRingBuffer& ring, int16_t* samples, uint32_t frames);
+
+// `latency_ms` is the target amount of buffered audio, the ring holds twice that.
+AudioOutput* audio_output_create(uint32_t sample_rate, uint32_t latency_ms, AudioSinkCallback const& sink);
+void audio_output_destroy(AudioOutput* output);
+
+// Move the rendered APU samples into the ring and steer the resampling ratio towards a half full ring.
+// With `wait_for_space` the call blocks while the ring is above half full, which paces emulation to the audio clock.
+void audio_output_push(AudioOutput& output, APU& apu, bool wait_for_space);
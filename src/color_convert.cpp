@@ -0,0 +1,205 @@
+#include "color_convert.h"
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Expand a 5 bit channel to 8 bits, so 31 maps to 255.
+inline uint32_t color_expand_5_to_8(uint32_t channel) {
+  return (channel << 3) | (channel >> 2);
+}
+
+template<ColorFormat Format>
+inline uint32_t color_from_rgb888(uint32_t r, uint32_t g, uint32_t b) {
+  switch (Format) {
+    case COLOR_FORMAT_RGBA8888:
+      return r | (g << 8) | (b << 16) | 0xFF000000;
+    case COLOR_FORMAT_BGRA8888:
+      return b | (g << 8) | (r << 16) | 0xFF000000;
+    case COLOR_FORMAT_RGB565:
+      return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+  }
+  return 0;
+}
+
+template<ColorFormat Format>
+inline uint32_t color_from_rgb555(uint16_t color) {
+  uint32_t r = color & 0x1F;
+  uint32_t g = (color >> 5) & 0x1F;
+  uint32_t b = (color >> 10) & 0x1F;
+  return color_from_rgb888<Format>(color_expand_5_to_8(r), color_expand_5_to_8(g), color_expand_5_to_8(b));
+}
+
+template<ColorFormat Format>
+void color_convert_pixels_direct(uint16_t const* src, uint32_t pixel_count, void* dst) {
+  uint32_t i = 0;
+
+  if constexpr (Format == COLOR_FORMAT_RGB565) {
+    uint16_t* out = (uint16_t*)dst;
+#if defined(__SSE2__)
+    __m128i const channel_mask = _mm_set1_epi16(0x1F);
+    for (; i + 8 <= pixel_count; i += 8) {
+      __m128i colors = _mm_loadu_si128((__m128i const*)(src + i));
+      __m128i r = _mm_and_si128(colors, channel_mask);
+      __m128i g = _mm_and_si128(_mm_srli_epi16(colors, 5), channel_mask);
+      __m128i b = _mm_and_si128(_mm_srli_epi16(colors, 10), channel_mask);
+
+      // Green gets a sixth bit, repeat its top bit like the 8 bit expansion does.
+      __m128i g6 = _mm_or_si128(_mm_slli_epi16(g, 1), _mm_srli_epi16(g, 4));
+      __m128i result = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g6, 5)), b);
+      _mm_storeu_si128((__m128i*)(out + i), result);
+    }
+#endif
+    for (; i < pixel_count; i++) {
+      out[i] = color_from_rgb555<Format>(src[i]);
+    }
+  } else {
+    uint32_t* out = (uint32_t*)dst;
+#if defined(__SSE2__)
+    __m128i const channel_mask = _mm_set1_epi16(0x1F);
+    __m128i const opaque_alpha = _mm_set1_epi16((short)0xFF00);
+    for (; i + 8 <= pixel_count; i += 8) {
+      __m128i colors = _mm_loadu_si128((__m128i const*)(src + i));
+      __m128i r = _mm_and_si128(colors, channel_mask);
+      __m128i g = _mm_and_si128(_mm_srli_epi16(colors, 5), channel_mask);
+      __m128i b = _mm_and_si128(_mm_srli_epi16(colors, 10), channel_mask);
+      r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+      g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+      b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+      // Build the low and high half of every output pixel, then interleave them.
+      __m128i first = Format == COLOR_FORMAT_RGBA8888 ? r : b;
+      __m128i third = Format == COLOR_FORMAT_RGBA8888 ? b : r;
+      __m128i low = _mm_or_si128(first, _mm_slli_epi16(g, 8));
+      __m128i high = _mm_or_si128(third, opaque_alpha);
+      _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(low, high));
+      _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(low, high));
+    }
+#endif
+    for (; i < pixel_count; i++) {
+      out[i] = color_from_rgb555<Format>(src[i]);
+    }
+  }
+}
+
+// Luma scaled by 256, so 255 * 256 at full white.
+inline uint32_t color_luma_256(uint16_t color) {
+  uint32_t r = color_expand_5_to_8(color & 0x1F);
+  uint32_t g = color_expand_5_to_8((color >> 5) & 0x1F);
+  uint32_t b = color_expand_5_to_8((color >> 10) & 0x1F);
+  return 77 * r + 150 * g + 29 * b;
+}
+
+// Table entries are already in the output format, only their size differs.
+template<typename Pixel>
+void color_convert_pixels_with_table(uint16_t const* src, uint32_t pixel_count, void* dst, ColorTable const& table) {
+  Pixel* out = (Pixel*)dst;
+  for (uint32_t i = 0; i < pixel_count; i++) {
+    out[i] = table.colors[src[i] & 0x7FFF];
+  }
+}
+
+template<ColorFormat Format>
+void color_fill_table(ColorTable& table, bool lcd_correction) {
+  if (!lcd_correction) {
+    for (uint32_t color = 0; color < COLOR_TABLE_SIZE; color++) {
+      table.colors[color] = color_from_rgb555<Format>(color);
+    }
+    return;
+  }
+
+  // The screen has a steep gamma and its channels bleed into each other.
+  // Linearize with the LCD gamma, mix the channels, and encode again for a regular display.
+  constexpr double lcd_gamma = 4.0;
+  constexpr double display_gamma = 2.2;
+  constexpr double scale = 255.0 * 255.0 / 280.0;
+
+  double linear[32];
+  for (int i = 0; i < 32; i++) {
+    linear[i] = std::pow(i / 31.0, lcd_gamma);
+  }
+
+  for (uint32_t color = 0; color < COLOR_TABLE_SIZE; color++) {
+    double lr = linear[color & 0x1F];
+    double lg = linear[(color >> 5) & 0x1F];
+    double lb = linear[(color >> 10) & 0x1F];
+
+    double mixed[3] = {
+      (255 * lr + 50 * lg + 0 * lb) / 255,
+      (10 * lr + 230 * lg + 30 * lb) / 255,
+      (50 * lr + 10 * lg + 220 * lb) / 255
+    };
+
+    uint32_t channels[3];
+    for (int i = 0; i < 3; i++) {
+      double value = std::pow(mixed[i], 1.0 / display_gamma) * scale;
+      channels[i] = value >= 255.0 ? 255 : (uint32_t)(value + 0.5);
+    }
+    table.colors[color] = color_from_rgb888<Format>(channels[0], channels[1], channels[2]);
+  }
+}
+
+void color_build_table(ColorTable& table, ColorFormat format, bool lcd_correction) {
+  table.format = format;
+  switch (format) {
+    case COLOR_FORMAT_RGBA8888:
+      color_fill_table<COLOR_FORMAT_RGBA8888>(table, lcd_correction);
+      break;
+    case COLOR_FORMAT_BGRA8888:
+      color_fill_table<COLOR_FORMAT_BGRA8888>(table, lcd_correction);
+      break;
+    case COLOR_FORMAT_RGB565:
+      color_fill_table<COLOR_FORMAT_RGB565>(table, lcd_correction);
+      break;
+  }
+}
+
+void color_convert_pixels(uint16_t const* src, uint32_t pixel_count, ColorFormat format, void* dst, ColorTable const* table) {
+  if (table != nullptr) {
+    if (color_bytes_per_pixel(format) == 2) {
+      color_convert_pixels_with_table<uint16_t>(src, pixel_count, dst, *table);
+    } else {
+      color_convert_pixels_with_table<uint32_t>(src, pixel_count, dst, *table);
+    }
+    return;
+  }
+
+  switch (format) {
+    case COLOR_FORMAT_RGBA8888:
+      color_convert_pixels_direct<COLOR_FORMAT_RGBA8888>(src, pixel_count, dst);
+      break;
+    case COLOR_FORMAT_BGRA8888:
+      color_convert_pixels_direct<COLOR_FORMAT_BGRA8888>(src, pixel_count, dst);
+      break;
+    case COLOR_FORMAT_RGB565:
+      color_convert_pixels_direct<COLOR_FORMAT_RGB565>(src, pixel_count, dst);
+      break;
+  }
+}
+
+void color_convert_frame_buffer(GPU const& gpu, ColorFormat format, void* dst, uint32_t dst_pitch, ColorTable const* table) {
+  uint32_t row_bytes = FRAME_WIDTH * color_bytes_per_pixel(format);
+  if (dst_pitch == row_bytes) {
+    color_convert_pixels(gpu.frame_buffer, FRAME_BUFFER_SIZE, format, dst, table);
+    return;
+  }
+
+  for (uint32_t line = 0; line < FRAME_HEIGHT; line++) {
+    uint8_t* dst_line = (uint8_t*)dst + line * dst_pitch;
+    color_convert_pixels(&gpu.frame_buffer[line * FRAME_BUFFER_PITCH], FRAME_WIDTH, format, dst_line, table);
+  }
+}
+
+void color_convert_gray8(uint16_t const* src, uint32_t pixel_count, uint8_t* dst) {
+  for (uint32_t i = 0; i < pixel_count; i++) {
+    dst[i] = color_luma_256(src[i]) >> 8;
+  }
+}
+
+void color_convert_gray8_half(uint16_t const* line0, uint16_t const* line1, uint32_t pixel_count, uint8_t* dst) {
+  for (uint32_t i = 0; i + 1 < pixel_count; i += 2) {
+    uint32_t sum = color_luma_256(line0[i]) + color_luma_256(line0[i + 1]) + color_luma_256(line1[i]) + color_luma_256(line1[i + 1]);
+    dst[i >> 1] = sum >> 10;
+  }
+}
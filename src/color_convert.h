@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "gpu.h"
+
+static constexpr uint32_t COLOR_TABLE_SIZE = 1 << 15;
+
+enum ColorFormat {
+  // Byte order R, G, B, A in memory.
+  COLOR_FORMAT_RGBA8888 = 0,
+  // Byte order B, G, R, A in memory.
+  COLOR_FORMAT_BGRA8888 = 1,
+  // Red in the top 5 bits, blue in the bottom 5 bits.
+  COLOR_FORMAT_RGB565 = 2
+};
+
+// Every RGB555 color resolved to its output value, built once for a target format.
+// 32 bit formats use the whole entry, RGB565 only the low 16 bits.
+struct ColorTable {
+  ColorFormat format;
+  uint32_t colors[COLOR_TABLE_SIZE];
+};
+
+inline uint32_t color_bytes_per_pixel(ColorFormat format) {
+  return format == COLOR_FORMAT_RGB565 ? 2 : 4;
+}
+
+// Fill the table for `format`. With `lcd_correction` the colors are remapped to approximate
+// the washed out look of the GBA screen, otherwise the table is a plain channel expansion.
+void color_build_table(ColorTable& table, ColorFormat format, bool lcd_correction);
+
+// Convert RGB555 pixels (the ENABLE_PIXEL bit is ignored) into `dst`.
+// Uses the table when one is given, which must have been built for the same format.
+void color_convert_pixels(
+  uint16_t const* src,
+  uint32_t pixel_count,
+  ColorFormat format,
+  void* dst,
+  ColorTable const* table = nullptr
+);
+
+// Convert the whole frame buffer into a FRAME_WIDTH x FRAME_HEIGHT image with rows `dst_pitch` bytes apart.
+void color_convert_frame_buffer(
+  GPU const& gpu,
+  ColorFormat format,
+  void* dst,
+  uint32_t dst_pitch,
+  ColorTable const* table = nullptr
+);
+
+// Luma of RGB555 pixels (BT.601 weights), one byte per pixel.
+void color_convert_gray8(uint16_t const* src, uint32_t pixel_count, uint8_t* dst);
+
+// Luma averaged over 2x2 blocks of two adjacent lines, `pixel_count / 2` bytes.
+void color_convert_gray8_half(uint16_t const* line0, uint16_t const* line1, uint32_t pixel_count, uint8_t* dst);
@@ -2440,6 +2440,8 @@ void execute_arm_instruction(CPU& cpu, uint32_t instruction) {
 uint32_t cpu_read_next_arm_instruction(CPU& cpu) {
   // Make sure the PC is 4-byte aligned
   uint32_t pc = cpu.get_register_value(PC) & ~0x3;
+  cpu.ram.prefetch_address = pc + 8;
+  cpu.ram.prefetch_thumb = false;
 
   // Fetch the instruction from the memory
   return ram_read_word_direct(cpu.ram, pc);
@@ -2448,12 +2450,16 @@ uint32_t cpu_read_next_arm_instruction(CPU& cpu) {
 uint16_t cpu_read_next_thumb_instruction(CPU& cpu) {
   // Make sure the PC is 2-byte aligned
   uint32_t pc = cpu.get_register_value(PC) & ~0x1;
+  cpu.ram.prefetch_address = pc + 4;
+  cpu.ram.prefetch_thumb = true;
 
   // Fetch the instruction from the memory
   return ram_read_half_word_direct(cpu.ram, pc);
 }
 
 void cpu_cycle(CPU& cpu) {
+  if (cpu.halted) return;
+
   bool is_thumb = (cpu.cpsr & 0x20) != 0;
 
   // Fetch the instruction from the memory
@@ -2474,6 +2480,13 @@ void cpu_interrupt_cycle(CPU& cpu) {
   // IRQ has been triggered externally.
   uint16_t interrupt_flag = ram_read_half_word_from_io_registers_fast<REG_INTERRUPT_REQUEST_FLAGS>(cpu.ram);
   if (interrupt_flag > 0) {
+    // Check if requested interrupt is enabled
+    uint16_t interrupt_enable = ram_read_half_word_from_io_registers_fast<REG_INTERRUPT_ENABLE>(cpu.ram);
+    if ((interrupt_flag & interrupt_enable) == 0) return;
+
+    // Halt ends on any enabled request, even while IRQs are masked.
+    cpu.halted = false;
+
     // Check CPSR to see if IRQs are disabled
     if ((cpu.cpsr & CPSR_IRQ_DISABLE) > 0) return;
 
@@ -2481,10 +2494,6 @@ void cpu_interrupt_cycle(CPU& cpu) {
     bool interrupt_master_enable = ram_read_word_from_io_registers_fast<REG_INTERRUPT_MASTER_ENABLE>(cpu.ram) & 0x1;
     if (!interrupt_master_enable) return;
 
-    // Check if requested interrupt is enabled
-    uint16_t interrupt_enable = ram_read_half_word_from_io_registers_fast<REG_INTERRUPT_ENABLE>(cpu.ram);
-    if ((interrupt_flag & interrupt_enable) == 0) return;
-
     // Trigger the IRQ interrupt
     cpu_trigger_irq_interrupt(cpu);
   }
@@ -6,6 +6,7 @@
 #include <functional>
 #include "ram.h"
 #include "flash.h"
+#include "eeprom.h"
 
 static constexpr uint8_t ARM_INSTRUCTION_SIZE = 4;
 static constexpr uint8_t THUMB_INSTRUCTION_SIZE = 2;
@@ -139,12 +140,18 @@ struct CPU {
   uint64_t cycle_count = 0;
   bool kill_signal = false;
 
+  // Set by writing HALTCNT, no instructions run until an enabled interrupt is requested.
+  bool halted = false;
+
   // Memory Mapper
   RAM ram;
 
   // Flash Controller
   Flash flash;
 
+  // EEPROM Controller
+  EEPROM eeprom;
+
   // ARM State - access to the 16 general-purpose registers (r0 - r15)
   //   Where r15 is the Program Counter (PC), r13 is the Stack Pointer (SP) and r14 is the Link Register (LR)
   //   Bits 0-1 of the PC are always 0, the rest are the address of the current instruction (4-byte aligned)
@@ -152,6 +152,12 @@ void cpu_debugger_window(CPU& cpu, DebuggerState& debugger_state) {
       debugger_state.command_queue.push(NEXT_FRAME);
     }
 
+    // Rewind button.
+    ImGui::SameLine();
+    if (ImGui::Button("Rewind")) {
+      debugger_state.command_queue.push(REWIND);
+    }
+
     // Reset button.
     ImGui::SameLine();
     if (ImGui::Button("Reset")) {
@@ -15,6 +15,7 @@ enum DebuggerCommand {
   STEP,
   BREAK,
   NEXT_FRAME,
+  REWIND,
   RESET,
 };
 
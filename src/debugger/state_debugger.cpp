@@ -13,7 +13,7 @@ static std::set<std::string> state_names;
 static char* state_name = new char[256];
 static char* selected_state = new char[256];
 
-void state_debugger_window(CPU& cpu) {
+void state_debugger_window(GBA& gba) {
   // Load the existing states from the file system.
   if (!existing_states_loaded) {
     for (const auto& entry : std::filesystem::directory_iterator("states")) {
@@ -35,7 +35,7 @@ void state_debugger_window(CPU& cpu) {
       // Save the state to the file system.
       std::stringstream ss;
       ss << "states/" << state_name_str << ".state";
-      save_state(cpu, ss.str());
+      save_state(gba, ss.str());
 
       // Cache the state name for the load state dropdown.
       ss = std::stringstream();
@@ -62,7 +62,7 @@ void state_debugger_window(CPU& cpu) {
       // Load the state from the file system.
       std::stringstream ss;
       ss << "states/" << state_name_str;
-      load_state(cpu, ss.str());
+      load_state(gba, ss.str());
     }
   }
   ImGui::End();
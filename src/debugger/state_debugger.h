@@ -2,4 +2,4 @@
 
 #include "../state_io.h"
 
-void state_debugger_window(CPU& cpu);
\ No newline at end of file
+void state_debugger_window(GBA& gba);
\ No newline at end of file
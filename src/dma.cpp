@@ -1,5 +1,6 @@
 #include "dma.h"
 #include "eeprom.h"
+#include <cstring>
 
 #define DMAxSAD(x) 0x40000B0 + (x * 12)
 #define DMAxDAD(x) 0x40000B4 + (x * 12)
@@ -141,13 +142,20 @@ struct DMAControl {
   bool enable : 1;
 };
 
+// DMAControl is wider than the register, so the bits are copied rather than read through a cast.
+inline DMAControl dma_decode_control(uint16_t control) {
+  DMAControl dma_control = {};
+  memcpy(&dma_control, &control, sizeof(control));
+  return dma_control;
+}
+
 bool dma_process_channel(CPU& cpu, uint8_t channel) {
   uint32_t source_addr = *(uint32_t*)&cpu.ram.io_registers[DMA_OFFSET_SAD[channel]];
   uint32_t dest_addr = *(uint32_t*)&cpu.ram.io_registers[DMA_OFFSET_DAD[channel]];
   uint16_t word_count = *(uint16_t*)&cpu.ram.io_registers[DMA_OFFSET_CNT_L[channel]];
   uint16_t control = *(uint16_t*)&cpu.ram.io_registers[DMA_OFFSET_CNT_H[channel]];
 
-  DMAControl dma_control = *(DMAControl*)&control;
+  DMAControl dma_control = dma_decode_control(control);
   auto const dest_control = dma_control.destination_address_control;
   auto const source_control = dma_control.source_address_control;
   bool const is_repeat = dma_control.is_repeat;
@@ -175,7 +183,8 @@ bool dma_process_channel(CPU& cpu, uint8_t channel) {
       return false;
     }
   } else if (start_mode == StartModeSpecial) {
-    // TODO: Implement special start mode when handling audio.
+    // Sound FIFO transfers are started by the APU through dma_request_fifo.
+    // TODO: Video capture (special mode on channel 3) is not supported.
     return false;
   }
 
@@ -258,6 +267,50 @@ bool dma_process_channel(CPU& cpu, uint8_t channel) {
   return true;
 }
 
+void dma_request_fifo(CPU& cpu, uint32_t fifo_address) {
+  for (uint8_t channel = DMA1; channel <= DMA2; channel++) {
+    uint32_t source_addr = *(uint32_t*)&cpu.ram.io_registers[DMA_OFFSET_SAD[channel]];
+    uint32_t dest_addr = *(uint32_t*)&cpu.ram.io_registers[DMA_OFFSET_DAD[channel]];
+    uint16_t control = *(uint16_t*)&cpu.ram.io_registers[DMA_OFFSET_CNT_H[channel]];
+
+    DMAControl dma_control = dma_decode_control(control);
+    if (!dma_control.enable || dma_control.start_mode != StartModeSpecial || dest_addr != fifo_address) {
+      continue;
+    }
+
+    // Sound DMA always moves 4 words to the FIFO, the word count, transfer type and destination control are ignored.
+    for (int i = 0; i < 4; i++) {
+      dma_transfer(cpu, source_addr, dest_addr, TransferTypeWord);
+
+      switch (dma_control.source_address_control) {
+        case SADIncrement:
+          source_addr += 4;
+          break;
+        case SADDecrement:
+          source_addr -= 4;
+          break;
+        case SADFixed:
+          break;
+        case SADProhibited:
+          throw std::runtime_error("Prohibited source control mode.");
+      }
+    }
+
+    // Keep the source address for the next request, the register is write-only for the game.
+    ram_write_word_direct(cpu.ram, DMA_SAD[channel], source_addr);
+
+    if (!dma_control.is_repeat) {
+      ram_write_half_word(cpu.ram, DMA_CNT_H[channel], control & ~DMA_CNT_L_ENABLE_FLAG);
+    }
+
+    if (dma_control.irq_enable) {
+      uint16_t interrupt_flags = ram_read_half_word_from_io_registers_fast<REG_INTERRUPT_REQUEST_FLAGS>(cpu.ram);
+      interrupt_flags |= (1 << (8 + channel));
+      ram_write_half_word_direct(cpu.ram, REG_INTERRUPT_REQUEST_FLAGS, interrupt_flags);
+    }
+  }
+}
+
 void dma_cycle(CPU& cpu) {
   for (uint8_t channel = 0; channel < 4; channel++) {
     // Process one channel per cycle.
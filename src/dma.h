@@ -3,3 +3,6 @@
 #include "cpu.h"
 
 void dma_cycle(CPU& cpu);
+
+// Called by the APU when a DirectSound FIFO runs low. Runs the sound DMA (channel 1 or 2) aimed at that FIFO, if any.
+void dma_request_fifo(CPU& cpu, uint32_t fifo_address);
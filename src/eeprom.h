@@ -5,6 +5,17 @@
 
 struct CPU;
 
+// EEPROM Controller
+// Collects the bits of a request as they arrive over DMA, one bit per half word.
+struct EEPROM {
+  // Address of the pending read, -1 when no read was requested.
+  int32_t read_address = -1;
+
+  // Store max 128 bits (16 bytes) of data.
+  // Realistically we should only see max 68 bits of data.
+  uint16_t half_word_buffer[128] = {};
+};
+
 void eeprom_dma_transfer(
   CPU& cpu,
   uint32_t source_addr,
@@ -6,12 +6,12 @@
 #include <thread>
 
 #include "debug.h"
-#include "cpu.h"
-#include "dma.h"
-#include "gpu.h"
-#include "timer.h"
+#include "gba.h"
+#include "audio_output.h"
+#include "wav_sink.h"
 #include "input.h"
-#include "flash.h"
+#include "rewind.h"
+#include "movie.h"
 #include "debugger/palette_debugger.h"
 #include "debugger/sprite_debugger.h"
 #include "debugger/ram_debugger.h"
@@ -32,7 +32,9 @@
 #include "3rdparty/zengine/ZEngine-Core/ImmediateUI/GUILibrary.h"
 #include "3rdparty/zengine/ZEngine-Core/ImmediateUI/imgui-includes.h"
 
-void cycle(CPU& cpu, GPU& gpu, Timer& timer, DebuggerState& debugger_state) {
+void cycle(GBA& gba, DebuggerState& debugger_state) {
+  CPU& cpu = gba.cpu;
+
   // PC alignment check.
   // TODO: Disable when we want performance.
   if (cpu.cpsr & CPSR_THUMB_STATE) {
@@ -48,53 +50,45 @@ void cycle(CPU& cpu, GPU& gpu, Timer& timer, DebuggerState& debugger_state) {
   // Record the current state of the CPU for debugging purposes.
   cpu_record_state(cpu, debugger_state);
 
-  cpu_cycle(cpu);
-  cpu_interrupt_cycle(cpu);
-
-  // Cycle the GPU.
-  gpu_cycle(cpu, gpu);
-
-  // Cycle the DMA controller.
-  dma_cycle(cpu);
-
-  // Cycle the Timer controller.
-  timer_tick(cpu, timer);
-
-  cpu.cycle_count++;
+  gba_cycle(gba);
 }
 
-void reset_cpu(CPU& cpu, GPU& gpu, Timer& timer) {
-  // TODO: Move this into the cpu module.
-  for (int i = 0; i < 16; i++) {
-    cpu.set_register_value(i, 0);
+// Keys only change as a frame starts, and on this thread, so a run can be recorded and replayed exactly.
+// Setting them every frame also re-evaluates the keypad interrupt condition.
+void start_frame(GBA& gba, Movie* movie, InputState& input) {
+  uint16_t keys = input_next_frame_keys(input);
+  if (movie != nullptr) {
+    keys = movie_frame_keys(*movie, keys);
   }
-  cpu.cpsr = (uint32_t)System | CPSR_FIQ_DISABLE;
-  cpu.cycle_count = 0;
+  gba_set_keys(gba, keys);
+}
 
-  ram_soft_reset(cpu.ram);
+// As VCOUNT reaches 160.
+void end_frame(GBA& gba, RewindBuffer& rewind, Movie* movie, InputState& input) {
+  rewind_record(rewind, gba);
+  start_frame(gba, movie, input);
 }
 
 void emulator_loop(
-  CPU& cpu,
-  GPU& gpu,
-  Timer& timer,
+  GBA& gba,
+  AudioOutput* audio_output,
+  RewindBuffer& rewind,
+  Movie* movie,
+  InputState& input,
   DebuggerState& debugger_state
 ) {
-  cpu_init(cpu);
-  gpu_init(cpu, gpu);
-  timer_init(cpu, timer);
-  
-  flash_init(cpu);
-  ram_soft_reset(cpu.ram);
+  CPU& cpu = gba.cpu;
+
+  // Starts from the beginning of the BIOS with all keys released.
+  gba_init(gba);
   ram_load_bios(cpu.ram, "gba_bios.bin");
   
   ram_load_rom(cpu.ram, "pokemon_emerald.gba");
 
-  // Start from the beginning of the ROM.
-  cpu.set_register_value(PC, 0x0);
-
-  // Set the key status to all keys being released (0 = pressed, 1 = released).
-  ram_write_half_word_to_io_registers_fast<REG_KEY_STATUS>(cpu.ram, 0x3FF);
+  if (movie != nullptr) {
+    movie_start(*movie, gba);
+  }
+  start_frame(gba, movie, input);
 
   while(!cpu.kill_signal) {
     if (debugger_state.command_queue.size() > 0) {
@@ -105,12 +99,12 @@ void emulator_loop(
       // Process the command.
       switch (command) {
         case CONTINUE:
-          cycle(cpu, gpu, timer, debugger_state);
+          cycle(gba, debugger_state);
           debugger_state.mode = NORMAL;
           break;
         case STEP:
           for (int i = 0; i < debugger_state.step_size; i++) {
-            cycle(cpu, gpu, timer, debugger_state);
+            cycle(gba, debugger_state);
           }
           debugger_state.mode = DEBUG;
           break;
@@ -118,19 +112,34 @@ void emulator_loop(
           debugger_state.mode = DEBUG;
           break;
         case RESET:
-          reset_cpu(cpu, gpu, timer);
+          gba_reset(gba);
+          rewind_clear(rewind);
+          if (movie != nullptr) {
+            movie_start(*movie, gba);
+          }
+          start_frame(gba, movie, input);
+          break;
+        case REWIND:
+          // A movie's frames follow on from each other, going back would desync playback or record keys twice.
+          if (movie != nullptr && !movie_finished(*movie)) {
+            std::cout << "Rewind is off while a movie is playing or recording." << std::endl;
+          } else {
+            rewind_step_back(rewind, gba);
+          }
+          debugger_state.mode = DEBUG;
           break;
         case NEXT_FRAME:
+          // Stop where the frame ends, the same point the normal loop handles frame boundaries at.
           uint8_t scanline = ram_read_byte_from_io_registers_fast<REG_VERTICAL_COUNT>(cpu.ram);
-          bool hit_vcount = false;
-          while (scanline != 160) {
-            cycle(cpu, gpu, timer, debugger_state);
+          while (scanline == 160) {
+            cycle(gba, debugger_state);
             scanline = ram_read_byte_from_io_registers_fast<REG_VERTICAL_COUNT>(cpu.ram);
           }
-          while (scanline == 160) {
-            cycle(cpu, gpu, timer, debugger_state);
+          while (scanline != 160) {
+            cycle(gba, debugger_state);
             scanline = ram_read_byte_from_io_registers_fast<REG_VERTICAL_COUNT>(cpu.ram);
           }
+          end_frame(gba, rewind, movie, input);
           break;
       }
     }
@@ -144,13 +153,26 @@ void emulator_loop(
       continue;
     }
 
-    cycle(cpu, gpu, timer, debugger_state);
+    uint8_t previous_scanline = ram_read_byte_from_io_registers_fast<REG_VERTICAL_COUNT>(cpu.ram);
+    cycle(gba, debugger_state);
+
+    if (previous_scanline != 160 && ram_read_byte_from_io_registers_fast<REG_VERTICAL_COUNT>(cpu.ram) == 160) {
+      end_frame(gba, rewind, movie, input);
+    }
+
+    // With audio output, emulation runs at the pace the samples are played.
+    if (audio_output != nullptr && cpu.cycle_count % APU_BLOCK_CYCLES == 0) {
+      audio_output_push(*audio_output, gba.apu, true);
+    }
   }
 }
 
 static constexpr int VIEW_ID = 0;
 
-void graphics_loop(CPU& cpu, GPU& gpu, DebuggerState& debugger_state) {
+void graphics_loop(GBA& gba, InputState& input, DebuggerState& debugger_state) {
+  CPU& cpu = gba.cpu;
+  GPU& gpu = gba.gpu;
+
   ZEngine::Factory::Init();
 
   ZEngine::Display display("GBA Emulator", 1920, 1080);
@@ -211,16 +233,31 @@ void graphics_loop(CPU& cpu, GPU& gpu, DebuggerState& debugger_state) {
     );
     ImGui::PopStyleVar();
 
-    // Update the frame texture.
-    frameTexture->Update(
-      0,
-      0,
-      FRAME_WIDTH,
-      FRAME_HEIGHT,
-      gpu.frame_buffer,
-      FRAME_BUFFER_SIZE_BYTES,
-      FRAME_BUFFER_PITCH
-    );
+    // Update the frame texture, uploading only runs of lines that changed.
+    uint64_t dirty_lines[FRAME_DIRTY_LINE_WORDS];
+    gpu_take_dirty_lines(gpu, dirty_lines);
+    for (uint32_t line = 0; line < FRAME_HEIGHT;) {
+      if (!gpu_is_line_dirty(dirty_lines, line)) {
+        line++;
+        continue;
+      }
+
+      uint32_t first_line = line;
+      while (line < FRAME_HEIGHT && gpu_is_line_dirty(dirty_lines, line)) {
+        line++;
+      }
+
+      uint32_t line_count = line - first_line;
+      frameTexture->Update(
+        0,
+        first_line,
+        FRAME_WIDTH,
+        line_count,
+        &gpu.frame_buffer[first_line * FRAME_WIDTH],
+        line_count * FRAME_WIDTH * sizeof(uint16_t),
+        FRAME_BUFFER_PITCH
+      );
+    }
 
     if (ImGui::Begin("GBA Emulator")) {
       ImGui::Image(frameTexture->GetHandle(), ImVec2(240 * 2, 160 * 2));
@@ -235,11 +272,11 @@ void graphics_loop(CPU& cpu, GPU& gpu, DebuggerState& debugger_state) {
     special_effects_debugger_window(cpu);
     window_debugger_window(cpu);
     bg_debugger_window(cpu);
-    state_debugger_window(cpu);
+    state_debugger_window(gba);
     rom_loader_window(cpu);
 
     // Input handling.
-    input_handle_key_detection(cpu, inputManager);
+    input_handle_key_detection(input, inputManager);
 
     ImGui::End();
 
@@ -265,39 +302,94 @@ void graphics_loop(CPU& cpu, GPU& gpu, DebuggerState& debugger_state) {
   time->Shutdown();
 }
 
-void start_cpu_loop(CPU& cpu, GPU& gpu, Timer& timer, DebuggerState& debugger_state) {
-  while (!cpu.kill_signal) {
+void start_cpu_loop(GBA* gba, AudioOutput* audio_output, RewindBuffer* rewind, Movie* movie, InputState& input, DebuggerState& debugger_state) {
+  while (!gba->cpu.kill_signal) {
     try {
-      emulator_loop(cpu, gpu, timer, debugger_state);
+      emulator_loop(*gba, audio_output, *rewind, movie, input, debugger_state);
     } catch (std::exception& e) {
-      debug_print_cpu_state(cpu);
+      debug_print_cpu_state(gba->cpu);
       std::cout << e.what() << std::endl;
     }
   }
 }
 
 int main(int argc, char* argv[]) {
-  CPU cpu;
-  GPU gpu;
-  Timer timer;
+  GBA* gba = gba_create();
+  if (gba == nullptr) {
+    std::cout << gba_get_error() << std::endl;
+    return 1;
+  }
+  InputState input;
   DebuggerState debugger_state;
 
   // Start with the debugger set to break straight away.
   debugger_state.mode = DEBUG;
 
+  // `--record-audio <file.wav>` plays the audio into a WAV file, in real time.
+  // `--record-movie <file>` records the keys of every frame, saved on exit, and `--play-movie <file>` replays them.
+  std::string record_audio_path;
+  std::string record_movie_path;
+  std::string play_movie_path;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option = argv[i];
+    if (option == "--record-audio") {
+      record_audio_path = argv[i + 1];
+    } else if (option == "--record-movie") {
+      record_movie_path = argv[i + 1];
+    } else if (option == "--play-movie") {
+      play_movie_path = argv[i + 1];
+    }
+  }
+
+  WavSink wav_sink;
+  AudioOutput* audio_output = nullptr;
+  if (!record_audio_path.empty()) {
+    wav_sink_open(wav_sink, record_audio_path, gba->apu.sample_rate);
+    audio_output = audio_output_create(gba->apu.sample_rate, 60, [&wav_sink](int16_t const* samples, uint32_t frames) {
+      wav_sink_write(wav_sink, samples, frames);
+    });
+  }
+
+  // Keep up to the last 16 seconds, a keyframe each second with a delta for every frame in between.
+  RewindBuffer* rewind = rewind_create(16, 32 * 1024 * 1024, 1, 60);
+
+  Movie* movie = nullptr;
+  if (!play_movie_path.empty()) {
+    movie = movie_load(play_movie_path);
+  } else if (!record_movie_path.empty()) {
+    movie = movie_create(MOVIE_RECORDING);
+  }
+
   // Run CPU in a separate thread.
   std::thread cpu_thread(
     start_cpu_loop,
-    std::ref(cpu),
-    std::ref(gpu),
-    std::ref(timer),
+    gba,
+    audio_output,
+    rewind,
+    movie,
+    std::ref(input),
     std::ref(debugger_state)
   );
 
   // Run graphics in the main thread.
-  graphics_loop(cpu, gpu, debugger_state);
+  graphics_loop(*gba, input, debugger_state);
 
   cpu_thread.join();
 
+  if (audio_output != nullptr) {
+    audio_output_destroy(audio_output);
+    wav_sink_close(wav_sink);
+  }
+
+  if (movie != nullptr) {
+    if (movie->mode == MOVIE_RECORDING) {
+      movie_save(*movie, record_movie_path);
+    }
+    movie_destroy(movie);
+  }
+
+  rewind_destroy(rewind);
+  gba_destroy(gba);
+
   return 0;
 }
@@ -0,0 +1,139 @@
+#include "emulator_pool.h"
+
+#include <stdexcept>
+
+bool emulator_pool_take(EmulatorPool& pool, uint32_t worker, uint32_t& instance) {
+  // Newest first from the own queue, oldest first from the others.
+  {
+    EmulatorPoolQueue& queue = pool.queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.instances.empty()) {
+      instance = queue.instances.back();
+      queue.instances.pop_back();
+      return true;
+    }
+  }
+
+  uint32_t worker_count = (uint32_t)pool.workers.size();
+  for (uint32_t i = 1; i < worker_count; i++) {
+    EmulatorPoolQueue& queue = pool.queues[(worker + i) % worker_count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.instances.empty()) {
+      instance = queue.instances.front();
+      queue.instances.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void emulator_pool_run_instance(EmulatorPool& pool, uint32_t instance, uint32_t frames) {
+  GBA& gba = *pool.instances[instance];
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    gba_set_keys(gba, pool.input_callback ? pool.input_callback(instance, gba) : pool.keys[instance]);
+    gba_run_frame(gba);
+    if (pool.frame_callback) {
+      pool.frame_callback(instance, gba);
+    }
+  }
+}
+
+void emulator_pool_worker(EmulatorPool* pool, uint32_t worker) {
+  uint64_t last_run = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(pool->mutex);
+      pool->work_ready.wait(lock, [&] { return pool->stop || pool->run != last_run; });
+      if (pool->stop) return;
+      last_run = pool->run;
+    }
+
+    // Tasks of the next run can be taken before it is announced, they are set up before being queued.
+    uint32_t instance;
+    while (emulator_pool_take(*pool, worker, instance)) {
+      try {
+        emulator_pool_run_instance(*pool, instance, pool->frames_per_run);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (!pool->error) pool->error = std::current_exception();
+      }
+
+      if (pool->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->work_done.notify_all();
+      }
+    }
+  }
+}
+
+EmulatorPool* emulator_pool_create(uint32_t instance_count, uint32_t thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  EmulatorPool* pool = new EmulatorPool();
+  for (uint32_t i = 0; i < instance_count; i++) {
+    GBA* gba = gba_create();
+    if (gba == nullptr) {
+      for (GBA* created : pool->instances) {
+        gba_destroy(created);
+      }
+      delete pool;
+      throw std::runtime_error(gba_get_error());
+    }
+    apu_set_enabled(gba->apu, false);
+    pool->instances.push_back(gba);
+  }
+  pool->keys.assign(instance_count, 0);
+
+  pool->queues = new EmulatorPoolQueue[thread_count];
+  for (uint32_t i = 0; i < thread_count; i++) {
+    pool->workers.emplace_back(emulator_pool_worker, pool, i);
+  }
+  return pool;
+}
+
+void emulator_pool_destroy(EmulatorPool* pool) {
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stop = true;
+  }
+  pool->work_ready.notify_all();
+  for (auto& worker : pool->workers) {
+    worker.join();
+  }
+
+  for (GBA* gba : pool->instances) {
+    gba_destroy(gba);
+  }
+  delete [] pool->queues;
+  delete pool;
+}
+
+void emulator_pool_set_keys(EmulatorPool& pool, uint32_t instance, uint16_t keys) {
+  pool.keys[instance] = keys;
+}
+
+void emulator_pool_run_frames(EmulatorPool& pool, uint32_t frames) {
+  if (pool.instances.empty()) return;
+
+  pool.remaining.store((uint32_t)pool.instances.size(), std::memory_order_relaxed);
+  pool.frames_per_run = frames;
+  pool.error = nullptr;
+
+  uint32_t worker_count = (uint32_t)pool.workers.size();
+  for (uint32_t i = 0; i < pool.instances.size(); i++) {
+    EmulatorPoolQueue& queue = pool.queues[i % worker_count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.instances.push_back(i);
+  }
+
+  std::unique_lock<std::mutex> lock(pool.mutex);
+  pool.run++;
+  pool.work_ready.notify_all();
+  pool.work_done.wait(lock, [&] { return pool.remaining.load(std::memory_order_acquire) == 0; });
+
+  if (pool.error) {
+    std::rethrow_exception(pool.error);
+  }
+}
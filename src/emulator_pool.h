@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <condition_variable>
+#include "gba.h"
+
+// Instances waiting to run, owned by one worker but open to stealing by the others.
+struct EmulatorPoolQueue {
+  std::mutex mutex;
+  std::deque<uint32_t> instances;
+};
+
+// Runs many independent instances a frame at a time on a pool of worker threads.
+// Every instance is one task per run, handed out round robin. Workers run their own tasks first and then steal
+// from the other queues, so instances that take longer to emulate don't leave threads idle.
+struct EmulatorPool {
+  std::vector<GBA*> instances;
+
+  // Keys held by each instance, applied before every frame. Ignored while `input_callback` is set.
+  std::vector<uint16_t> keys;
+
+  // Both run on the worker thread emulating the instance, so they can be called for different instances at once.
+  // `input_callback` returns the keys held during the next frame, `frame_callback` sees the instance after each frame.
+  std::function<uint16_t(uint32_t instance, GBA& gba)> input_callback;
+  std::function<void(uint32_t instance, GBA& gba)> frame_callback;
+
+  std::vector<std::thread> workers;
+  EmulatorPoolQueue* queues = nullptr;
+
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  uint64_t run = 0;
+  uint32_t frames_per_run = 1;
+  std::atomic<uint32_t> remaining = 0;
+  std::exception_ptr error;
+  bool stop = false;
+};
+
+// Instances start initialized with audio turned off and nothing loaded, see gba_init.
+// A thread count of 0 uses one worker per hardware thread. Throws if an instance can't be created.
+EmulatorPool* emulator_pool_create(uint32_t instance_count, uint32_t thread_count = 0);
+void emulator_pool_destroy(EmulatorPool* pool);
+
+void emulator_pool_set_keys(EmulatorPool& pool, uint32_t instance, uint16_t keys);
+
+// Advance every instance by `frames` frames and wait for all of them.
+// Rethrows the first error raised by an instance, the others still run their frames.
+void emulator_pool_run_frames(EmulatorPool& pool, uint32_t frames = 1);
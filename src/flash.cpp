@@ -6,6 +6,7 @@
 
 void flash_init(CPU& cpu) {
   memset(cpu.ram.game_pak_sram, 0xFF, 0x20000);
+  ram_mark_save_memory_written(cpu.ram);
   memset(cpu.flash.command_buffer, 0, 3);
   cpu.flash.command_buffer_index = 0;
   cpu.flash.mode = FlashMode::READ;
@@ -38,6 +39,7 @@ void flash_write_byte(CPU& cpu, uint32_t address, uint8_t value) {
       } else if (value == 0x10) {
         // Erase the entire chip.
         memset(cpu.ram.game_pak_sram, 0xFF, 0x20000);
+        ram_mark_save_memory_written(cpu.ram);
         cpu.flash.mode = FlashMode::READ;
         return;
       } else if (value == 0xA0) {
@@ -66,6 +68,7 @@ void flash_write_byte(CPU& cpu, uint32_t address, uint8_t value) {
     // WRITE mode
     int offset = address - GAME_PAK_SRAM_START + cpu.flash.bank * 0x10000;
     cpu.ram.game_pak_sram[offset] = value;
+    ram_mark_save_memory_written(cpu.ram);
   } else if (cpu.flash.mode == FlashMode::ERASE_MODE) {
     // ERASE mode
     if (
@@ -76,6 +79,7 @@ void flash_write_byte(CPU& cpu, uint32_t address, uint8_t value) {
         // Erase a sector.
         int offset = address - GAME_PAK_SRAM_START + cpu.flash.bank * 0x10000;
         memset(cpu.ram.game_pak_sram + offset, 0xFF, 0x1000);
+        ram_mark_save_memory_written(cpu.ram);
       }
     }
   } else if (cpu.flash.mode == FlashMode::SELECT_BANK_MODE) {
@@ -0,0 +1,34 @@
+#include "fork.h"
+#include <cstring>
+
+void fork_init(GBA& gba, GBA& fork) {
+  // The resampler filter is copied rather than rebuilt by apu_init.
+  fork.apu.sample_rate = gba.apu.sample_rate;
+  fork.apu.resampler = gba.apu.resampler;
+
+  // Hooks of the fork find its own subsystems.
+  gba_init(fork);
+
+  gpu_set_tile_cache_enabled(fork.cpu, fork.gpu, gba.gpu.tile_cache != nullptr);
+  gpu_set_frame_skip(fork.gpu, gba.gpu.frame_skip_rendered, gba.gpu.frame_skip_period);
+  apu_set_enabled(fork.apu, gba.apu.enabled);
+
+  // Snapshots hold neither ROM.
+  ram_share_rom(fork.cpu.ram, gba.cpu.ram);
+  memcpy(fork.cpu.ram.system_rom, gba.cpu.ram.system_rom, 0x4000);
+  fork.cpu.ram.load_rom_into_bios = gba.cpu.ram.load_rom_into_bios;
+  fork.cpu.ram.enable_rom_write_protection = gba.cpu.ram.enable_rom_write_protection;
+}
+
+void fork_instance(GBA& gba, GBA& fork) {
+  fork_init(gba, fork);
+  snapshot_copy_state(gba, fork);
+  ram_share_memory(fork.cpu.ram, gba.cpu.ram);
+}
+
+bool fork_instance_from_snapshot(SnapshotArena const& arena, snapshot_t snapshot, GBA& gba, GBA& fork) {
+  fork_init(gba, fork);
+
+  // The fork's writes are tracked relative to the snapshot, so deltas against it work for every fork.
+  return snapshot_restore(arena, snapshot, fork);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "gba.h"
+#include "snapshot.h"
+
+// Turn a freshly constructed instance into a copy of another one, to branch a state and run it with different inputs.
+// The ROM is shared for the life of both instances, and EWRAM, IWRAM and VRAM are shared copy-on-write
+// (see ram_share_memory), so a fork copies a few hundred kb of registers, save memory and frame buffer
+// and grows by the pages either instance writes afterwards.
+// Writes to the ROM, like the RTC GPIO pokes at 0x080000C4 - 0x080000C9, are ignored rather than copying it.
+// The fork gets the tile cache, frame skip and audio settings of the source, but renders on the emulation thread.
+void fork_instance(GBA& gba, GBA& fork);
+
+// Same, but starting from a snapshot of the source, to make many forks of one state without copying it out each time.
+// Returns false, leaving the fork in its initial state, if the snapshot was overwritten by newer ones.
+bool fork_instance_from_snapshot(SnapshotArena const& arena, snapshot_t snapshot, GBA& gba, GBA& fork);
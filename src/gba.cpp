@@ -0,0 +1,102 @@
+#include "gba.h"
+#include "dma.h"
+#include "flash.h"
+#include "render_pipeline.h"
+
+// Requests the keypad interrupt when KEYCNT enables it and the held keys meet its condition.
+inline void gba_update_key_interrupt(RAM& ram) {
+  uint16_t control = ram_read_half_word_from_io_registers_fast<REG_KEY_INTERRUPT_CONTROL>(ram);
+  if ((control & REG_KEY_INTERRUPT_CONTROL_ENABLE) == 0) return;
+
+  uint16_t selected = control & REG_KEY_INTERRUPT_CONTROL_KEYS;
+  uint16_t pressed = ~ram_read_half_word_from_io_registers_fast<REG_KEY_STATUS>(ram) & selected;
+  bool matched = (control & REG_KEY_INTERRUPT_CONTROL_ALL_KEYS) ? selected != 0 && pressed == selected : pressed != 0;
+  if (!matched) return;
+
+  // NOTE: The following write must skip write hooks, since this register is clear-on-write.
+  uint16_t interrupt_flags = ram_read_half_word_from_io_registers_fast<REG_INTERRUPT_REQUEST_FLAGS>(ram);
+  ram_write_half_word_to_io_registers_fast<REG_INTERRUPT_REQUEST_FLAGS>(ram, interrupt_flags | INTERRUPT_KEYPAD);
+}
+
+void gba_init(GBA& gba) {
+  gba.cpu.ram.gba = &gba;
+
+  cpu_init(gba.cpu);
+  gpu_init(gba.cpu, gba.gpu);
+  gpu_set_tile_cache_enabled(gba.cpu, gba.gpu, true);
+  timer_init(gba);
+  apu_init(gba);
+
+  // Both bytes, so a byte write to either half of KEYCNT keeps the other.
+  for (uint32_t offset = 0; offset < 2; offset++) {
+    ram_register_write_hook(gba.cpu.ram, REG_KEY_INTERRUPT_CONTROL + offset, [](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+      ram_write_direct(ram, address, value, size);
+      gba_update_key_interrupt(ram);
+    });
+  }
+
+  // Stop mode (bit 7) is treated as halt, both end on an enabled interrupt.
+  ram_register_write_hook(gba.cpu.ram, REG_HALT_CONTROL, [](RAM& ram, uint32_t, uint32_t, uint32_t) {
+    ram.gba->cpu.halted = true;
+  });
+  // Halfword and word writes to POSTFLG carry HALTCNT in the byte above it.
+  ram_register_write_hook(gba.cpu.ram, REG_POST_BOOT_FLAG, [](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+    ram_write_byte_direct(ram, address, (uint8_t)value);
+    if (size >= 2) ram.gba->cpu.halted = true;
+  });
+
+  flash_init(gba.cpu);
+  ram_soft_reset(gba.cpu.ram);
+
+  // Start from the beginning of the BIOS.
+  gba.cpu.set_register_value(PC, 0x0);
+  gba_set_keys(gba, 0);
+}
+
+void gba_reset(GBA& gba) {
+  for (int i = 0; i < 16; i++) {
+    gba.cpu.set_register_value(i, 0);
+  }
+  gba.cpu.cpsr = (uint32_t)System | CPSR_FIQ_DISABLE;
+  gba.cpu.cycle_count = 0;
+  gba.cpu.halted = false;
+
+  ram_soft_reset(gba.cpu.ram);
+  apu_reset(gba.apu);
+}
+
+void gba_cycle(GBA& gba) {
+  cpu_cycle(gba.cpu);
+  cpu_interrupt_cycle(gba.cpu);
+  gpu_cycle(gba.cpu, gba.gpu);
+  dma_cycle(gba.cpu);
+  timer_tick(gba.cpu, gba.timer);
+
+  // After the timers, so it sees this cycle's overflows.
+  apu_cycle(gba.cpu, gba.apu, gba.timer);
+
+  gba.cpu.cycle_count++;
+}
+
+void gba_run_frame(GBA& gba) {
+  // Leave the first line of VBlank if the last frame just ended, then run up to the next one.
+  while (ram_read_byte_from_io_registers_fast<REG_VERTICAL_COUNT>(gba.cpu.ram) == 160) {
+    gba_cycle(gba);
+  }
+  while (ram_read_byte_from_io_registers_fast<REG_VERTICAL_COUNT>(gba.cpu.ram) != 160) {
+    gba_cycle(gba);
+  }
+}
+
+void gba_settle(GBA& gba) {
+  if (gba.gpu.render_pipeline != nullptr) {
+    render_pipeline_wait_idle(*gba.gpu.render_pipeline);
+  }
+  apu_render(gba.cpu.ram, gba.apu, gba.cpu.cycle_count);
+}
+
+void gba_set_keys(GBA& gba, uint16_t keys) {
+  // The register reads 0 for pressed keys.
+  ram_write_half_word_to_io_registers_fast<REG_KEY_STATUS>(gba.cpu.ram, ~keys & 0x3FF);
+  gba_update_key_interrupt(gba.cpu.ram);
+}
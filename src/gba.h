@@ -0,0 +1,40 @@
+#pragma once
+
+#include "cpu.h"
+#include "gpu.h"
+#include "timer.h"
+#include "apu.h"
+#include "gba_api.h"
+
+// One emulated Game Boy Advance, owning all of its state: the CPU with its RAM, Flash and EEPROM controllers,
+// the GPU, the timers and the APU (DMA state lives in the I/O registers).
+// Memory hooks find the other subsystems through RAM::gba, so instances share nothing and can run on different threads.
+// A GBA must stay where it is once initialized, as the RAM points back at it.
+struct GBA {
+  CPU cpu;
+  GPU gpu;
+  Timer timer;
+  APU apu;
+};
+
+// gba_create, gba_clone and gba_destroy are part of the C interface in gba_api.h.
+
+// Powered on with all keys released, the BIOS and ROM are loaded by the caller.
+void gba_init(GBA& gba);
+
+// Back to the start of the BIOS, keeping the loaded BIOS, ROM and save memory.
+void gba_reset(GBA& gba);
+
+void gba_cycle(GBA& gba);
+
+// Run until the next VBlank starts, when the frame buffer holds a complete frame.
+void gba_run_frame(GBA& gba);
+
+// Finishes the work still in flight, the frame buffer bands and the audio up to now,
+// so the state read out afterwards is complete.
+void gba_settle(GBA& gba);
+
+// One bit per key in REG_KEY_STATUS order, set while the key is held down.
+// Requests the keypad interrupt if KEYCNT asks for these keys, so call it once per frame even when nothing changed,
+// as a game acknowledging the interrupt while the keys are still held gets it again.
+void gba_set_keys(GBA& gba, uint16_t keys);
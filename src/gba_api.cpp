@@ -0,0 +1,214 @@
+#include "gba_api.h"
+#include "gba.h"
+#include "fork.h"
+#include "render_pipeline.h"
+#include "state_io.h"
+
+#include <exception>
+#include <string>
+
+static_assert(GBA_FRAME_WIDTH == FRAME_WIDTH && GBA_FRAME_HEIGHT == FRAME_HEIGHT);
+static_assert(GBA_OBSERVATION_RGB555 == OBSERVATION_FORMAT_RGB555);
+static_assert(GBA_OBSERVATION_GRAY8 == OBSERVATION_FORMAT_GRAY8);
+static_assert(GBA_OBSERVATION_GRAY8_HALF == OBSERVATION_FORMAT_GRAY8_HALF);
+
+// Exceptions don't cross the C interface, calls that can fail catch them and keep the message here instead.
+static thread_local std::string gba_error;
+
+int gba_fail(char const* message) {
+  gba_error = message;
+  return -1;
+}
+
+GBA* gba_create() {
+  GBA* gba = nullptr;
+  try {
+    gba = new GBA();
+    gba_init(*gba);
+  } catch (std::exception& e) {
+    if (gba != nullptr) gba_destroy(gba);
+    gba_fail(e.what());
+    return nullptr;
+  }
+  return gba;
+}
+
+GBA* gba_clone(GBA* source) {
+  GBA* gba = nullptr;
+  try {
+    gba = new GBA();
+    fork_instance(*source, *gba);
+  } catch (std::exception& e) {
+    if (gba != nullptr) gba_destroy(gba);
+    gba_fail(e.what());
+    return nullptr;
+  }
+  return gba;
+}
+
+void gba_destroy(GBA* gba) {
+  gpu_set_render_pipeline(gba->cpu, gba->gpu, 0);
+  gpu_set_tile_cache_enabled(gba->cpu, gba->gpu, false);
+  ram_free(gba->cpu.ram);
+  delete gba;
+}
+
+int gba_load_bios_from_memory(GBA* gba, void const* data, size_t size) {
+  if (data == nullptr) return gba_fail("Error: No BIOS data.");
+  ram_load_bios_from_memory(gba->cpu.ram, (uint8_t const*)data, size);
+  return 0;
+}
+
+int gba_load_rom_from_memory(GBA* gba, void const* data, size_t size) {
+  if (data == nullptr || size == 0) return gba_fail("Error: No ROM data.");
+  if (size > 0x2000000) return gba_fail("Error: ROM is larger than 32MB.");
+  try {
+    ram_load_rom_from_memory(gba->cpu.ram, (uint8_t const*)data, size);
+  } catch (std::exception& e) {
+    return gba_fail(e.what());
+  }
+  return 0;
+}
+
+int gba_run_frame(GBA* gba) {
+  try {
+    gba_run_frame(*gba);
+  } catch (std::exception& e) {
+    return gba_fail(e.what());
+  }
+  return 0;
+}
+
+void gba_set_keys(GBA* gba, uint16_t keys) {
+  gba_set_keys(*gba, keys);
+}
+
+uint16_t const* gba_get_framebuffer(GBA* gba) {
+  return gba->gpu.frame_buffer;
+}
+
+uint64_t gba_get_frame_sequence(GBA* gba) {
+  return gba->gpu.frame_sequence;
+}
+
+int gba_set_render_threads(GBA* gba, uint32_t thread_count) {
+  try {
+    gpu_set_render_pipeline(gba->cpu, gba->gpu, thread_count);
+  } catch (std::exception& e) {
+    return gba_fail(e.what());
+  }
+  return 0;
+}
+
+void gba_wait_render(GBA* gba) {
+  if (gba->gpu.render_pipeline != nullptr) {
+    render_pipeline_wait_idle(*gba->gpu.render_pipeline);
+  }
+}
+
+void gba_set_frame_skip(GBA* gba, uint32_t rendered, uint32_t period) {
+  gpu_set_frame_skip(gba->gpu, rendered, period);
+}
+
+int gba_set_observation(GBA* gba, int format, void* buffer) {
+  if (format < GBA_OBSERVATION_RGB555 || format > GBA_OBSERVATION_GRAY8_HALF) {
+    return gba_fail("Error: Unknown observation format.");
+  }
+  gpu_set_observation(gba->gpu, (ObservationFormat)format, buffer);
+  return 0;
+}
+
+size_t gba_get_observation_size(int format) {
+  if (format < GBA_OBSERVATION_RGB555 || format > GBA_OBSERVATION_GRAY8_HALF) return 0;
+  return gpu_observation_size((ObservationFormat)format);
+}
+
+uint8_t const* gba_get_memory(GBA* gba, int region, size_t* size) {
+  RAM& ram = gba->cpu.ram;
+  uint8_t const* memory = nullptr;
+  size_t memory_size = 0;
+  switch (region) {
+    case GBA_MEMORY_EWRAM: memory = ram.external_working_ram; memory_size = 0x40000; break;
+    case GBA_MEMORY_IWRAM: memory = ram.internal_working_ram; memory_size = 0x8000; break;
+    case GBA_MEMORY_IO: memory = ram.io_registers; memory_size = 0x804; break;
+    case GBA_MEMORY_PALETTE: memory = ram.palette_ram; memory_size = PALETTE_RAM_SIZE; break;
+    case GBA_MEMORY_VRAM: memory = ram.video_ram; memory_size = VRAM_SIZE; break;
+    case GBA_MEMORY_OAM: memory = ram.object_attribute_memory; memory_size = OAM_SIZE; break;
+    default: gba_fail("Error: Unknown memory region."); break;
+  }
+
+  if (size != nullptr) {
+    *size = memory_size;
+  }
+  return memory;
+}
+
+// Folds the mirrors of the regions whose arrays don't cover their whole window back onto the memory behind them,
+// returns false where nothing is mapped.
+inline bool gba_resolve_read_address(uint32_t& address) {
+  uint32_t offset = address & 0xFFFFFF;
+  switch (address >> 24) {
+    case 0x4: return offset < 0x804;
+    case 0x6:
+      // 96KB of VRAM in a 128KB window, the last 32KB repeat the object tiles.
+      offset &= 0x1FFFF;
+      if (offset >= VRAM_SIZE) offset -= 0x8000;
+      address = VRAM_START + offset;
+      return true;
+    case 0x7: address = OAM_START + (offset & (OAM_SIZE - 1)); return true;
+    case 0xE: address = GAME_PAK_SRAM_START + (offset & 0xFFFF); return true;
+    default: return (address >> 24) < 0xE;
+  }
+}
+
+int gba_read_memory(GBA* gba, uint32_t address, void* out, size_t size) {
+  uint8_t* bytes = (uint8_t*)out;
+  try {
+    for (size_t i = 0; i < size; i++) {
+      uint32_t byte_address = address + (uint32_t)i;
+      if (!gba_resolve_read_address(byte_address)) return gba_fail("Error: Nothing is mapped at the address.");
+      bytes[i] = ram_read_byte_direct(gba->cpu.ram, byte_address);
+    }
+  } catch (std::exception& e) {
+    return gba_fail(e.what());
+  }
+  return 0;
+}
+
+uint32_t gba_read_audio(GBA* gba, int16_t* out, uint32_t max_frames) {
+  apu_render(gba->cpu.ram, gba->apu, gba->cpu.cycle_count);
+  return apu_read_samples(gba->apu, out, max_frames);
+}
+
+void gba_set_audio_enabled(GBA* gba, int enabled) {
+  apu_set_enabled(gba->apu, enabled != 0);
+}
+
+size_t gba_snapshot(GBA* gba, void* out, size_t capacity) {
+  std::vector<uint8_t> data;
+  try {
+    state_serialize(*gba, data, false);
+  } catch (std::exception& e) {
+    gba_fail(e.what());
+    return 0;
+  }
+
+  if (out != nullptr && data.size() <= capacity) {
+    memcpy(out, data.data(), data.size());
+  }
+  return data.size();
+}
+
+int gba_restore(GBA* gba, void const* data, size_t size) {
+  if (data == nullptr) return gba_fail("Error: No save state data.");
+  try {
+    state_deserialize(*gba, (uint8_t const*)data, size);
+  } catch (std::exception& e) {
+    return gba_fail(e.what());
+  }
+  return 0;
+}
+
+char const* gba_get_error(void) {
+  return gba_error.c_str();
+}
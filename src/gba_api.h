@@ -0,0 +1,110 @@
+#pragma once
+
+// C interface for embedding the core, exported by the `gba` shared library.
+// Every function takes the instance it works on, so any number of instances can be driven from different threads,
+// as long as each one is only used by one thread at a time.
+// Functions returning int give 0 on success and -1 on failure, with the reason in gba_get_error.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define GBA_API __declspec(dllexport)
+#else
+#define GBA_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct GBA GBA;
+
+#define GBA_FRAME_WIDTH 240
+#define GBA_FRAME_HEIGHT 160
+
+// Formats for gba_set_observation.
+#define GBA_OBSERVATION_RGB555 0
+#define GBA_OBSERVATION_GRAY8 1
+#define GBA_OBSERVATION_GRAY8_HALF 2
+
+// Regions for gba_get_memory.
+#define GBA_MEMORY_EWRAM 0
+#define GBA_MEMORY_IWRAM 1
+#define GBA_MEMORY_IO 2
+#define GBA_MEMORY_PALETTE 3
+#define GBA_MEMORY_VRAM 4
+#define GBA_MEMORY_OAM 5
+
+// A new instance, set up with gba_init. It starts at the beginning of the BIOS once a BIOS and ROM are loaded.
+// Null if it couldn't be made, with the reason in gba_get_error.
+GBA_API GBA* gba_create(void);
+
+// A new instance in the same state as `source`, see fork_instance. Null on failure, like gba_create.
+GBA_API GBA* gba_clone(GBA* source);
+
+GBA_API void gba_destroy(GBA* gba);
+
+// The images are copied, the caller's buffers can be freed straight after.
+GBA_API int gba_load_bios_from_memory(GBA* gba, void const* data, size_t size);
+GBA_API int gba_load_rom_from_memory(GBA* gba, void const* data, size_t size);
+
+// Run until the next VBlank starts, when the frame buffer holds a complete frame.
+GBA_API int gba_run_frame(GBA* gba);
+
+// One bit per key in REG_KEY_STATUS order (A, B, Select, Start, Right, Left, Up, Down, R, L), set while held.
+// Also raises the keypad interrupt a game set up in KEYCNT, best called before every frame even if the keys are unchanged.
+GBA_API void gba_set_keys(GBA* gba, uint16_t keys);
+
+// GBA_FRAME_WIDTH * GBA_FRAME_HEIGHT pixels of 15 bit color, red in the low bits.
+// Owned by the instance and rewritten as it runs, valid until it is destroyed.
+GBA_API uint16_t const* gba_get_framebuffer(GBA* gba);
+
+// Frames completed by the instance, bumped as each frame ends. Reading it before and after reading the
+// frame buffer or an observation tells whether the frame changed in between.
+GBA_API uint64_t gba_get_frame_sequence(GBA* gba);
+
+// Draw frames on `thread_count` worker threads, each taking a band of lines, while the instance goes on emulating
+// the next frame. 0 draws on the calling thread, as instances start out. With workers a frame is only complete
+// in the frame buffer and observation once gba_wait_render returns. Every worker copies all the video memory written
+// during a frame, so more threads than free cores only cost more. At most 80 threads are used.
+GBA_API int gba_set_render_threads(GBA* gba, uint32_t thread_count);
+
+// Block until the render workers have drawn every frame emulated so far, returns straight away without workers.
+GBA_API void gba_wait_render(GBA* gba);
+
+// Draw only `rendered` frames out of every `period`, spread evenly. Skipped frames still run with the same timing,
+// VCOUNT, DISPSTAT and interrupts, only the frame buffer keeps the last drawn frame. A period of 0 draws every frame,
+// and `rendered` is kept between 1 and `period`.
+GBA_API void gba_set_frame_skip(GBA* gba, uint32_t rendered, uint32_t period);
+
+// Have the GPU keep `buffer` holding the frame in one of the GBA_OBSERVATION formats, so reading the screen needs
+// no copy. Lines are written into it as they are rendered, with no extra pass over the frame.
+// The buffer must hold gba_get_observation_size(format) bytes and stay valid until replaced or cleared with NULL.
+GBA_API int gba_set_observation(GBA* gba, int format, void* buffer);
+GBA_API size_t gba_get_observation_size(int format);
+
+// One of the GBA_MEMORY regions in place, with its size in `size`. The memory stays where it is for the life
+// of the instance, so the pointer can be kept. Read only, writes would skip the emulator's change tracking.
+GBA_API uint8_t const* gba_get_memory(GBA* gba, int region, size_t* size);
+
+// Reads `size` bytes from the bus starting at `address`. I/O register hooks are bypassed, so reading has no side effects.
+// Mirrors read the memory they repeat, returns -1 if the range runs into unused I/O or past the save memory.
+GBA_API int gba_read_memory(GBA* gba, uint32_t address, void* out, size_t size);
+
+// Move up to `max_frames` interleaved stereo frames into `out`, returns how many were written.
+// Unread samples are dropped once half a second has built up.
+GBA_API uint32_t gba_read_audio(GBA* gba, int16_t* out, uint32_t max_frames);
+GBA_API void gba_set_audio_enabled(GBA* gba, int enabled);
+
+// Writes a save state to `out` when it fits in `capacity` bytes. Returns the size of the state either way, 0 on failure,
+// so a first call with no buffer gives the size to allocate.
+GBA_API size_t gba_snapshot(GBA* gba, void* out, size_t capacity);
+GBA_API int gba_restore(GBA* gba, void const* data, size_t size);
+
+// Why the last failing call on this thread failed.
+GBA_API char const* gba_get_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,17 @@
 #include "gpu.h"
+#include "gba.h"
+#include "render_pipeline.h"
+#include "color_convert.h"
 #include "debug.h"
+#include <algorithm>
 #include <cstring>
+#include <atomic>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static constexpr uint32_t OBJ_VRAM_MASK = 0x7FFF;
 
 static constexpr uint16_t REG_LCD_STATUS_HBLANK_FLAG = 1 << 1;
 static constexpr uint16_t REG_LCD_STATUS_VCOUNT_MATCH_FLAG = 1 << 2;
@@ -14,11 +25,80 @@ void gpu_init(CPU& cpu, GPU& gpu) {
     gpu.frame_buffer[i] = 0xFFFF;
   }
 
+  // Nothing has been presented yet.
+  memset(gpu.frame_dirty_lines, 0xFF, sizeof(gpu.frame_dirty_lines));
+
   // TODO: Initialize the GPU registers.
+
+  // Every byte of BGxX/BGxY is hooked, so writes of any size are seen.
+  for (uint32_t i = 0; i < 4; i++) {
+    for (uint32_t offset = 0; offset < 4; offset++) {
+      ram_register_write_hook(cpu.ram, GPU_AFFINE_REFERENCE_REGISTERS[i] + offset, [i](RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+        ram_write_direct(ram, address, value, size);
+        ram.gba->gpu.affine_ref_written |= 1 << i;
+      });
+    }
+  }
+}
+
+void gpu_set_tile_cache_enabled(CPU& cpu, GPU& gpu, bool enabled) {
+  if (enabled && gpu.tile_cache == nullptr) {
+    gpu.tile_cache = new TileCache;
+    tile_cache_invalidate_all(*gpu.tile_cache);
+
+    // The cache starts empty, so pending dirty blocks are irrelevant.
+    memset(cpu.ram.vram_dirty_blocks, 0, sizeof(cpu.ram.vram_dirty_blocks));
+  } else if (!enabled && gpu.tile_cache != nullptr) {
+    delete gpu.tile_cache;
+    gpu.tile_cache = nullptr;
+  }
+}
+
+void gpu_set_render_pipeline(CPU& cpu, GPU& gpu, uint32_t worker_count) {
+  if (gpu.render_pipeline != nullptr) {
+    render_pipeline_destroy(gpu.render_pipeline);
+    gpu.render_pipeline = nullptr;
+
+    // The pipeline consumed the dirty bitmaps, the tile cache has to start over.
+    ram_mark_all_video_memory_dirty(cpu.ram);
+  }
+
+  if (worker_count > 0) {
+    gpu.render_pipeline = render_pipeline_create(cpu.ram, gpu, worker_count);
+  }
+}
+
+void gpu_set_frame_skip(GPU& gpu, uint32_t frames_rendered, uint32_t period) {
+  // Render every frame for a zero period, and at least one frame per period otherwise.
+  if (period == 0) {
+    period = 1;
+    frames_rendered = 1;
+  }
+  if (frames_rendered == 0) {
+    frames_rendered = 1;
+  }
+  if (frames_rendered > period) {
+    frames_rendered = period;
+  }
+
+  gpu.frame_skip_rendered = frames_rendered;
+  gpu.frame_skip_period = period;
+  gpu.frame_skip_accumulator = 0;
 }
 
-inline uint16_t gpu_get_backdrop_color(CPU& cpu) {
-  uint16_t* bg_palette_ram = (uint16_t*)(cpu.ram.palette_ram);
+// Decides at the start of a frame whether it gets rasterized.
+// The rendered frames are spread evenly over the period.
+inline bool gpu_should_render_frame(GPU& gpu) {
+  gpu.frame_skip_accumulator += gpu.frame_skip_rendered;
+  if (gpu.frame_skip_accumulator >= gpu.frame_skip_period) {
+    gpu.frame_skip_accumulator -= gpu.frame_skip_period;
+    return true;
+  }
+  return false;
+}
+
+inline uint16_t gpu_get_backdrop_color(GPUMemory const& memory) {
+  uint16_t* bg_palette_ram = (uint16_t*)(memory.palette_ram);
   uint16_t backdrop_color = bg_palette_ram[0];
   return backdrop_color > 0 ? backdrop_color | ENABLE_PIXEL : ENABLE_PIXEL;
 }
@@ -29,88 +109,49 @@ inline void gpu_clear_scanline_buffers(GPU& gpu) {
   memset(gpu.scanline_special_effects_buffer, 0, FRAME_WIDTH * sizeof(uint16_t));
   memset(gpu.scanline_obj_window_buffer, 0, FRAME_WIDTH * sizeof(bool));
   memset(gpu.scanline_semi_transparent_buffer, 0, FRAME_WIDTH * sizeof(bool));
-  for (int x = 0; x < FRAME_WIDTH; x++) {
-    for (int priority = 0; priority < 4; priority++) {
-      for (int pixel_source = 0; pixel_source < 6; pixel_source++) {
-        gpu.scanline_by_priority_and_pixel_source[x][priority][pixel_source] = 0;
-      }
-    }
+  memset(gpu.scanline_obj_mosaic_buffer, 0, FRAME_WIDTH * sizeof(bool));
+  gpu.obj_mosaic_exists = false;
+  memset(gpu.scanline_by_priority_and_pixel_source, 0, sizeof(gpu.scanline_by_priority_and_pixel_source));
+}
+
+// A window covers a line when top <= y < bottom, wrapping around when top > bottom.
+inline bool gpu_window_covers_line(WindowVertical const& vertical, uint8_t y) {
+  if (vertical.top_most <= vertical.bottom_most) {
+    return y >= vertical.top_most && y < vertical.bottom_most;
   }
+  return y >= vertical.top_most || y < vertical.bottom_most;
 }
 
-inline bool gpu_test_pixel_in_window(uint8_t const& x, uint8_t const& y, Window const& window) {
-  return x >= window.horizontal.left_most && x < window.horizontal.right_most &&
-         y >= window.vertical.top_most && y < window.vertical.bottom_most;
-}
-
-inline void gpu_apply_window_effects(CPU& cpu, GPU& gpu, uint8_t scanline) {
-  uint16_t disp_cnt = ram_read_half_word_from_io_registers_fast<REG_LCD_CONTROL>(cpu.ram);
-  uint16_t inside_window = ram_read_half_word_from_io_registers_fast<REG_WINDOW_INSIDE>(cpu.ram);
-  uint16_t outside_window = ram_read_half_word_from_io_registers_fast<REG_WINDOW_OUTSIDE>(cpu.ram);
-
-  bool layer_enabled_inside_window[2][6] = {
-    // Window 0
-    {
-      // BG0
-      (inside_window & 1) > 0,
-      // BG1
-      (inside_window & (1 << 1)) > 0,
-      // BG2
-      (inside_window & (1 << 2)) > 0,
-      // BG3
-      (inside_window & (1 << 3)) > 0,
-      // OBJ
-      (inside_window & (1 << 4)) > 0,
-    },
-    // Window 1
-    {
-      // BG0
-      (inside_window & (1 << 8)) > 0,
-      // BG1
-      (inside_window & (1 << 9)) > 0,
-      // BG2
-      (inside_window & (1 << 10)) > 0,
-      // BG3
-      (inside_window & (1 << 11)) > 0,
-      // OBJ
-      (inside_window & (1 << 12)) > 0,
-    }
-  };
+// Marks the pixels covered by a window horizontally, wrapping around when left > right.
+inline void gpu_fill_window_region(uint8_t (&region)[FRAME_WIDTH], WindowHorizontal const& horizontal, uint8_t window_region) {
+  uint32_t left = horizontal.left_most < FRAME_WIDTH ? horizontal.left_most : FRAME_WIDTH;
+  uint32_t right = horizontal.right_most < FRAME_WIDTH ? horizontal.right_most : FRAME_WIDTH;
 
-  bool layer_enabled_outside_window[6] = {
-    // BG0
-    (outside_window & 1) > 0,
-    // BG1
-    (outside_window & (1 << 1)) > 0,
-    // BG2
-    (outside_window & (1 << 2)) > 0,
-    // BG3
-    (outside_window & (1 << 3)) > 0,
-    // OBJ
-    (outside_window & (1 << 4)) > 0,
-  };
+  if (horizontal.left_most <= horizontal.right_most) {
+    memset(region + left, window_region, right - left);
+  } else {
+    memset(region + left, window_region, FRAME_WIDTH - left);
+    memset(region, window_region, right);
+  }
+}
 
-  bool layer_enabled_in_obj_window[6] = {
-    // BG0
-    (outside_window & (1 << 8)) > 0,
-    // BG1
-    (outside_window & (1 << 9)) > 0,
-    // BG2
-    (outside_window & (1 << 10)) > 0,
-    // BG3
-    (outside_window & (1 << 11)) > 0,
-    // OBJ
-    (outside_window & (1 << 12)) > 0
-  };
+// Whether pixel `x` is inside a window horizontally, matching gpu_fill_window_region.
+inline bool gpu_window_covers_pixel(WindowHorizontal const& horizontal, uint32_t x) {
+  uint32_t left = horizontal.left_most < FRAME_WIDTH ? horizontal.left_most : FRAME_WIDTH;
+  uint32_t right = horizontal.right_most < FRAME_WIDTH ? horizontal.right_most : FRAME_WIDTH;
 
-  auto window_0_horizontal = *(WindowHorizontal*)ram_read_memory_from_io_registers_fast<REG_WINDOW0_HORIZONTAL>(cpu.ram);
-  auto window_0_vertical = *(WindowVertical*)ram_read_memory_from_io_registers_fast<REG_WINDOW0_VERTICAL>(cpu.ram);
-  auto window_0 = Window { window_0_horizontal, window_0_vertical };
+  if (horizontal.left_most <= horizontal.right_most) {
+    return x >= left && x < right;
+  }
+  return x >= left || x < right;
+}
 
-  auto window_1_horizontal = *(WindowHorizontal*)ram_read_memory_from_io_registers_fast<REG_WINDOW1_HORIZONTAL>(cpu.ram);
-  auto window_1_vertical = *(WindowVertical*)ram_read_memory_from_io_registers_fast<REG_WINDOW1_VERTICAL>(cpu.ram);
-  auto window_1 = Window { window_1_horizontal, window_1_vertical };
+// Resolves the windows of a scanline into spans of pixels that share the same window, in order of priority
+// (WIN0, WIN1, OBJ window, outside). Each span carries the WININ/WINOUT enable bits of its window.
+inline void gpu_compute_window_spans(GPUMemory const& memory, GPU& gpu, uint8_t scanline) {
+  gpu.window_span_count = 0;
 
+  uint16_t disp_cnt = gpu_read_half_word_from_io_registers<REG_LCD_CONTROL>(memory);
   bool window_0_enabled = disp_cnt & (1 << 13);
   bool window_1_enabled = disp_cnt & (1 << 14);
   bool obj_window_enabled = (
@@ -121,43 +162,99 @@ inline void gpu_apply_window_effects(CPU& cpu, GPU& gpu, uint8_t scanline) {
   bool any_window_enabled = window_0_enabled || window_1_enabled || obj_window_enabled;
   if (!any_window_enabled) return;
 
+  uint16_t inside_window = gpu_read_half_word_from_io_registers<REG_WINDOW_INSIDE>(memory);
+  uint16_t outside_window = gpu_read_half_word_from_io_registers<REG_WINDOW_OUTSIDE>(memory);
+  uint8_t enable_masks[4] = {
+    (uint8_t)(inside_window & WINDOW_ENABLE_ALL),
+    (uint8_t)((inside_window >> 8) & WINDOW_ENABLE_ALL),
+    (uint8_t)((outside_window >> 8) & WINDOW_ENABLE_ALL),
+    (uint8_t)(outside_window & WINDOW_ENABLE_ALL)
+  };
+
+  auto window_0_horizontal = *(WindowHorizontal*)gpu_read_memory_from_io_registers<REG_WINDOW0_HORIZONTAL>(memory);
+  auto window_0_vertical = *(WindowVertical*)gpu_read_memory_from_io_registers<REG_WINDOW0_VERTICAL>(memory);
+  auto window_1_horizontal = *(WindowHorizontal*)gpu_read_memory_from_io_registers<REG_WINDOW1_HORIZONTAL>(memory);
+  auto window_1_vertical = *(WindowVertical*)gpu_read_memory_from_io_registers<REG_WINDOW1_VERTICAL>(memory);
+
+  bool window_0_on_line = window_0_enabled && gpu_window_covers_line(window_0_vertical, scanline);
+  bool window_1_on_line = window_1_enabled && gpu_window_covers_line(window_1_vertical, scanline);
+
+  if (!obj_window_enabled) {
+    // The region only changes at the edges of WIN0 and WIN1, which gives at most 5 spans.
+    uint32_t edges[6] = {0, FRAME_WIDTH};
+    uint32_t edge_count = 2;
+    if (window_0_on_line) {
+      edges[edge_count++] = std::min<uint32_t>(window_0_horizontal.left_most, FRAME_WIDTH);
+      edges[edge_count++] = std::min<uint32_t>(window_0_horizontal.right_most, FRAME_WIDTH);
+    }
+    if (window_1_on_line) {
+      edges[edge_count++] = std::min<uint32_t>(window_1_horizontal.left_most, FRAME_WIDTH);
+      edges[edge_count++] = std::min<uint32_t>(window_1_horizontal.right_most, FRAME_WIDTH);
+    }
+    std::sort(edges, edges + edge_count);
+
+    uint8_t last_region = 0xFF;
+    for (uint32_t i = 0; i + 1 < edge_count; i++) {
+      if (edges[i] == edges[i + 1]) continue;
+      uint8_t window_region = WINDOW_REGION_OUTSIDE;
+      if (window_0_on_line && gpu_window_covers_pixel(window_0_horizontal, edges[i])) {
+        window_region = WINDOW_REGION_0;
+      } else if (window_1_on_line && gpu_window_covers_pixel(window_1_horizontal, edges[i])) {
+        window_region = WINDOW_REGION_1;
+      }
+
+      if (window_region != last_region) {
+        WindowSpan& span = gpu.window_spans[gpu.window_span_count++];
+        span.start = edges[i];
+        span.enable_mask = enable_masks[window_region];
+        last_region = window_region;
+      }
+      gpu.window_spans[gpu.window_span_count - 1].end = edges[i + 1];
+    }
+    return;
+  }
+
+  // The OBJ window is per pixel, paint the windows from lowest to highest priority.
+  uint8_t region[FRAME_WIDTH];
+  memset(region, WINDOW_REGION_OUTSIDE, FRAME_WIDTH);
   for (int x = 0; x < FRAME_WIDTH; x++) {
-    for (int priority = 0; priority < 4; priority++) {
-      for (int pixel_source = 0; pixel_source < 5; pixel_source++) {
-        uint16_t color = gpu.scanline_by_priority_and_pixel_source[x][priority][pixel_source];
-        if (color == 0) continue;
-
-        // Test if pixel is inside a window.
-        bool pixel_in_window = false;
-        if (window_0_enabled && gpu_test_pixel_in_window(x, scanline, window_0)) {
-          // Window 0
-          gpu.scanline_by_priority_and_pixel_source[x][priority][pixel_source] = layer_enabled_inside_window[0][pixel_source] ? color : 0;
-          pixel_in_window = true;
-        }
-        
-        if (window_1_enabled && gpu_test_pixel_in_window(x, scanline, window_1)) {
-          // Window 1
-          gpu.scanline_by_priority_and_pixel_source[x][priority][pixel_source] = layer_enabled_inside_window[1][pixel_source] ? color : 0;
-          pixel_in_window = true;
-        }
-        
-        if (obj_window_enabled && gpu.scanline_obj_window_buffer[x]) {
-          // OBJ Window
-          gpu.scanline_by_priority_and_pixel_source[x][priority][pixel_source] = layer_enabled_in_obj_window[pixel_source] ? color : 0;
-          pixel_in_window = true;
-        }
-        
-        // Hide pixel if its not in a window and the layer is not enabled outside the window.
-        if (!pixel_in_window && !layer_enabled_outside_window[pixel_source]) {
-          gpu.scanline_by_priority_and_pixel_source[x][priority][pixel_source] = 0;
-        }
+    if (gpu.scanline_obj_window_buffer[x]) region[x] = WINDOW_REGION_OBJ;
+  }
+  if (window_1_on_line) {
+    gpu_fill_window_region(region, window_1_horizontal, WINDOW_REGION_1);
+  }
+  if (window_0_on_line) {
+    gpu_fill_window_region(region, window_0_horizontal, WINDOW_REGION_0);
+  }
+
+  // Collapse runs of the same window into spans.
+  for (int x = 0; x < FRAME_WIDTH; x++) {
+    if (x == 0 || region[x] != region[x - 1]) {
+      WindowSpan& span = gpu.window_spans[gpu.window_span_count++];
+      span.start = x;
+      span.enable_mask = enable_masks[region[x]];
+    }
+    gpu.window_spans[gpu.window_span_count - 1].end = x + 1;
+  }
+}
+
+inline void gpu_apply_window_effects(GPU& gpu) {
+  for (int i = 0; i < gpu.window_span_count; i++) {
+    WindowSpan const& span = gpu.window_spans[i];
+    uint32_t length = span.end - span.start;
+
+    // Clear every layer hidden by the window of this span.
+    for (int pixel_source = 0; pixel_source < 5; pixel_source++) {
+      if (span.enable_mask & (1 << pixel_source)) continue;
+      for (int priority = 0; priority < 4; priority++) {
+        memset(&gpu.scanline_by_priority_and_pixel_source[priority][pixel_source][span.start], 0, length * sizeof(uint16_t));
       }
     }
   }
 }
 
-inline void gpu_apply_special_effects(CPU& cpu, GPU& gpu) {
-  uint16_t special_effects_control = ram_read_half_word_from_io_registers_fast<REG_BLDCNT>(cpu.ram);
+inline void gpu_apply_special_effects(GPUMemory const& memory, GPU& gpu) {
+  uint16_t special_effects_control = gpu_read_half_word_from_io_registers<REG_BLDCNT>(memory);
   uint8_t special_effects_mode = (special_effects_control >> 6) & 0x3;
   bool target_1[6] = {
     // BG0
@@ -182,7 +279,7 @@ inline void gpu_apply_special_effects(CPU& cpu, GPU& gpu) {
     (special_effects_control & 0x2000) > 0
   };
 
-  uint16_t backdrop_color = gpu_get_backdrop_color(cpu);
+  uint16_t backdrop_color = gpu_get_backdrop_color(memory);
 
   // TODO: Special effects mode is ignored on pixels that contain semi-transparent pixels from OBJ sprites.
   switch (special_effects_mode) {
@@ -192,7 +289,7 @@ inline void gpu_apply_special_effects(CPU& cpu, GPU& gpu) {
     }
     case 1: {
       // Alpha Blending
-      uint16_t blend_alpha_coefficients = ram_read_half_word_from_io_registers_fast<REG_BLDALPHA>(cpu.ram);
+      uint16_t blend_alpha_coefficients = gpu_read_half_word_from_io_registers<REG_BLDALPHA>(memory);
       uint8_t alpha_a = blend_alpha_coefficients & 0x1F;
       uint8_t alpha_b = (blend_alpha_coefficients >> 8) & 0x1F;
 
@@ -215,9 +312,8 @@ inline void gpu_apply_special_effects(CPU& cpu, GPU& gpu) {
 
         // Get top most pixel and it's source.
         for (int j = 0; j < 4; j++) {
-          auto color_by_priority_and_pixel_source = gpu.scanline_by_priority_and_pixel_source[i][j];
           for (int k = 4; k >= 0; k--) {
-            uint16_t color = color_by_priority_and_pixel_source[k];
+            uint16_t color = gpu.scanline_by_priority_and_pixel_source[j][k][i];
             if (color > 0) {
               if (target_1_color == 0) {
                 // Find top most pixel for Target 1.
@@ -306,7 +402,7 @@ inline void gpu_apply_special_effects(CPU& cpu, GPU& gpu) {
     case 2:
     case 3: {
       // Brightness Increase Effect / Brightness Decrease Effect
-      uint8_t effect_coefficients = ram_read_byte_from_io_registers_fast<REG_BLDY>(cpu.ram);
+      uint8_t effect_coefficients = gpu_read_byte_from_io_registers<REG_BLDY>(memory);
       if (effect_coefficients > 16) {
         effect_coefficients = 16;
       }
@@ -318,10 +414,8 @@ inline void gpu_apply_special_effects(CPU& cpu, GPU& gpu) {
 
         // Get top most pixel and it's source.
         for (int priority = 0; priority < 4; priority++) {
-          auto color_by_priority_and_pixel_source = gpu.scanline_by_priority_and_pixel_source[i][priority];
-
           for (int pixel_source = 4; pixel_source >= 0; pixel_source--) {
-            uint16_t color = color_by_priority_and_pixel_source[pixel_source];
+            uint16_t color = gpu.scanline_by_priority_and_pixel_source[priority][pixel_source][i];
             if (color > 0) {
               if (target_1_color == 0) {
                 // Find top most pixel for Target 1.
@@ -379,68 +473,15 @@ inline void gpu_apply_special_effects(CPU& cpu, GPU& gpu) {
   }
 }
 
-inline void gpu_apply_window_to_special_effects(CPU& cpu, GPU& gpu, uint8_t scanline) {
-  uint16_t disp_cnt = ram_read_half_word_from_io_registers_fast<REG_LCD_CONTROL>(cpu.ram);
-  bool window_0_enabled = disp_cnt & (1 << 13);
-  bool window_1_enabled = disp_cnt & (1 << 14);
-  bool obj_window_enabled = (
-    (disp_cnt & (1 << 12)) &&
-    (disp_cnt & (1 << 15)) &&
-    gpu.obj_window_exists
-  );
-  bool any_window_enabled = window_0_enabled || window_1_enabled || obj_window_enabled;
-  if (!any_window_enabled) return;
-
-  uint16_t inside_window = ram_read_half_word_from_io_registers_fast<REG_WINDOW_INSIDE>(cpu.ram);
-  uint16_t outside_window = ram_read_half_word_from_io_registers_fast<REG_WINDOW_OUTSIDE>(cpu.ram);
-  bool sfx_enabled_outside_window = (outside_window & (1 << 5)) > 0;
-  bool sfx_enabled_in_obj_window = (outside_window & (1 << 13)) > 0;
-
-  auto window_0_horizontal = *(WindowHorizontal*)ram_read_memory_from_io_registers_fast<REG_WINDOW0_HORIZONTAL>(cpu.ram);
-  auto window_0_vertical = *(WindowVertical*)ram_read_memory_from_io_registers_fast<REG_WINDOW0_VERTICAL>(cpu.ram);
-  auto window_0 = Window { window_0_horizontal, window_0_vertical };
-
-  auto window_1_horizontal = *(WindowHorizontal*)ram_read_memory_from_io_registers_fast<REG_WINDOW1_HORIZONTAL>(cpu.ram);
-  auto window_1_vertical = *(WindowVertical*)ram_read_memory_from_io_registers_fast<REG_WINDOW1_VERTICAL>(cpu.ram);
-  auto window_1 = Window { window_1_horizontal, window_1_vertical };
-
-  bool sfx_enabled_in_window[2] = {
-    (inside_window & (1 << 5)) > 0,
-    (inside_window & (1 << 13)) > 0
-  };
-
-  for (uint8_t x = 0; x < FRAME_WIDTH; x++) {
-    uint16_t special_effect_color = gpu.scanline_special_effects_buffer[x];
-    if (special_effect_color == 0) continue;
-
-    // Test if pixel is inside a window.
-    bool pixel_in_window = false;
-    if (window_0_enabled && gpu_test_pixel_in_window(x, scanline, window_0)) {
-      // Window 0
-      gpu.scanline_special_effects_buffer[x] = sfx_enabled_in_window[0] ? special_effect_color : 0;
-      pixel_in_window = true;
-    }
-
-    if (window_1_enabled && gpu_test_pixel_in_window(x, scanline, window_1)) {
-      // Window 1
-      gpu.scanline_special_effects_buffer[x] = sfx_enabled_in_window[1] ? special_effect_color : 0;
-      pixel_in_window = true;
-    }
-
-    if (obj_window_enabled && gpu.scanline_obj_window_buffer[x]) {
-      // OBJ Window
-      gpu.scanline_special_effects_buffer[x] = sfx_enabled_in_obj_window ? special_effect_color : 0;
-      pixel_in_window = true;
-    }
-
-    // Hide pixel if its not in a window and the special effect is not enabled outside the window.
-    if (!pixel_in_window && !sfx_enabled_outside_window) {
-      gpu.scanline_special_effects_buffer[x] = 0;
-    }
+inline void gpu_apply_window_to_special_effects(GPU& gpu) {
+  for (int i = 0; i < gpu.window_span_count; i++) {
+    WindowSpan const& span = gpu.window_spans[i];
+    if (span.enable_mask & WINDOW_ENABLE_SPECIAL_EFFECTS) continue;
+    memset(&gpu.scanline_special_effects_buffer[span.start], 0, (span.end - span.start) * sizeof(uint16_t));
   }
 }
 
-inline void gpu_resolve_scanline_buffer(CPU& cpu, GPU& gpu) {
+inline void gpu_resolve_scanline_buffer(GPU& gpu) {
   for (int x = 0; x < FRAME_WIDTH; x++) {
     uint16_t special_effects_color = gpu.scanline_special_effects_buffer[x];
     if (special_effects_color > 0) {
@@ -448,18 +489,17 @@ inline void gpu_resolve_scanline_buffer(CPU& cpu, GPU& gpu) {
       continue;
     }
 
-    auto pixel_priority_map = gpu.scanline_by_priority_and_pixel_source[x];
     for (int priority = 3; priority >= 0; priority--) {
       // Check the OBJ layer first.
-      if (pixel_priority_map[priority][PIXEL_SOURCE_OBJ] > 0) {
-        gpu.scanline_buffer[x] = pixel_priority_map[priority][PIXEL_SOURCE_OBJ];
+      if (gpu.scanline_by_priority_and_pixel_source[priority][PIXEL_SOURCE_OBJ][x] > 0) {
+        gpu.scanline_buffer[x] = gpu.scanline_by_priority_and_pixel_source[priority][PIXEL_SOURCE_OBJ][x];
         continue;
       }
 
       // Then check the BG/Backdrop layers.
       for (int pixel_source = 0; pixel_source < 4; pixel_source++) {
-        if (pixel_priority_map[priority][pixel_source] > 0) {
-          gpu.scanline_buffer[x] = pixel_priority_map[priority][pixel_source];
+        if (gpu.scanline_by_priority_and_pixel_source[priority][pixel_source][x] > 0) {
+          gpu.scanline_buffer[x] = gpu.scanline_by_priority_and_pixel_source[priority][pixel_source][x];
           break;
         }
       }
@@ -467,228 +507,348 @@ inline void gpu_resolve_scanline_buffer(CPU& cpu, GPU& gpu) {
   }
 }
 
-void gpu_render_bg_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
-  uint16_t disp_cnt_data = ram_read_half_word_from_io_registers_fast<REG_LCD_CONTROL>(cpu.ram);
-  DisplayControl const& disp_cnt = *(DisplayControl*)&disp_cnt_data;
+inline uint8_t const* gpu_fetch_bg_tile(
+  GPU& gpu,
+  uint8_t const* vram,
+  uint32_t tile_address,
+  bool is_256_color_mode,
+  bool horizontal_flip,
+  uint8_t (&decoded_tile)[TILE_CACHE_PIXELS_PER_TILE]
+) {
+  if (gpu.tile_cache != nullptr) {
+    return tile_cache_get_tile(*gpu.tile_cache, vram, tile_address, is_256_color_mode, horizontal_flip);
+  }
 
-  uint8_t* vram = cpu.ram.video_ram;
-  uint16_t* palette_ram = (uint16_t*)(cpu.ram.palette_ram);
-  uint8_t* bg_control_mem = ram_read_memory_from_io_registers_fast<REG_BG0_CONTROL>(cpu.ram);
+  // No cache, expand the tile into the caller's buffer.
+  uint32_t tile_size_bytes = is_256_color_mode ? TILE_8BPP_BYTES : TILE_4BPP_BYTES;
+  if (tile_address + tile_size_bytes > VRAM_SIZE) {
+    memset(decoded_tile, 0, sizeof(decoded_tile));
+    return decoded_tile;
+  }
 
-  bool display_bg[4] = {
-    disp_cnt.display_bg0,
-    disp_cnt.display_bg1,
-    disp_cnt.display_bg2,
-    disp_cnt.display_bg3
-  };
+  uint8_t const* tile_data = vram + tile_address;
+  for (int y = 0; y < TILE_SIZE; y++) {
+    for (int x = 0; x < TILE_SIZE; x++) {
+      int src_x = horizontal_flip ? TILE_SIZE - 1 - x : x;
+      decoded_tile[y * TILE_SIZE + x] = is_256_color_mode
+        ? tile_data[y * TILE_SIZE + src_x]
+        : (tile_data[y * HALF_TILE_SIZE + src_x / 2] >> ((src_x % 2) * 4)) & 0xF;
+    }
+  }
+  return decoded_tile;
+}
 
-  for (int bg = 0; bg < 4; bg++) {
-    // Skip rendering the background if it's not enabled.
-    if (!display_bg[bg]) {
-      continue;
+// Replicates the first pixel of every mosaic block across the rest of the block.
+inline void gpu_apply_horizontal_mosaic(uint16_t* line, uint32_t size) {
+  for (uint32_t start = 0; start < FRAME_WIDTH; start += size) {
+    uint32_t end = start + size < FRAME_WIDTH ? start + size : FRAME_WIDTH;
+    for (uint32_t x = start + 1; x < end; x++) {
+      line[x] = line[start];
     }
+  }
+}
 
-    // Prevent rendering other bg layers if in mode 3-5 and bg is not 2.
-    if (bg != 2 && disp_cnt.background_mode > 2) {
-      continue;
+void gpu_render_text_bg(GPUMemory const& memory, GPU& gpu, uint8_t bg, BackgroundControl const& bg_control, uint8_t scanline) {
+  uint8_t* vram = memory.video_ram;
+  uint16_t* palette_ram = (uint16_t*)(memory.palette_ram);
+  uint32_t char_base = bg_control.char_base_block * 0x4000;
+  uint16_t* base_screen_block_ram = (uint16_t*)(vram + bg_control.screen_base_block * 0x800);
+
+  uint32_t width_in_tiles = 0;
+  uint32_t height_in_tiles = 0;
+  gpu_get_bg_size_in_tiles(false, bg_control.screen_size, width_in_tiles, height_in_tiles);
+
+  uint32_t width_in_pixels = width_in_tiles * TILE_SIZE;
+  uint32_t height_in_pixels = height_in_tiles * TILE_SIZE;
+
+  uint8_t* bg_offset_x_mem = gpu_read_memory_from_io_registers<REG_BG0_X_OFFSET>(memory);
+  uint8_t* bg_offset_y_mem = gpu_read_memory_from_io_registers<REG_BG0_Y_OFFSET>(memory);
+  uint32_t bg_offset_x = (*(uint16_t*)(bg_offset_x_mem + bg * 4)) & 0x1FF;
+  uint32_t bg_offset_y = (*(uint16_t*)(bg_offset_y_mem + bg * 4)) & 0x1FF;
+
+  uint32_t texture_y = (scanline + bg_offset_y) % height_in_pixels;
+  uint32_t tile_y = texture_y / TILE_SIZE;
+  uint32_t pos_y_in_tile = texture_y % TILE_SIZE;
+  uint32_t tile_size_bytes = bg_control.is_256_color_mode ? TILE_8BPP_BYTES : TILE_4BPP_BYTES;
+
+  // The screen entry (and so the tile row) only changes every 8 pixels.
+  uint8_t decoded_tile[TILE_CACHE_PIXELS_PER_TILE];
+  uint8_t const* tile_row = nullptr;
+  uint16_t palette_base = 0;
+  int32_t current_tile_x = -1;
+
+  for (int screen_x = 0; screen_x < FRAME_WIDTH; ++screen_x) {
+    uint32_t texture_x = (screen_x + bg_offset_x) % width_in_pixels;
+    uint32_t tile_x = texture_x / TILE_SIZE;
+
+    if ((int32_t)tile_x != current_tile_x) {
+      current_tile_x = tile_x;
+
+      // 2 bytes per screen entry, can be 16 (4bpp) or 256 colors (8bpp).
+      int screen_block_idx = 0;
+      if (width_in_tiles == height_in_tiles) {
+        screen_block_idx = (tile_y / 32) * (width_in_tiles / 32) + (tile_x / 32);
+      } else if (width_in_tiles > height_in_tiles) {
+        screen_block_idx = tile_x / 32;
+      } else {
+        screen_block_idx = tile_y / 32;
+      }
+
+      uint16_t screen_block_entry = base_screen_block_ram[screen_block_idx * 1024 + (tile_y % 32) * 32 + (tile_x % 32)];
+      uint16_t tile_index = screen_block_entry & 0x3FF;
+      bool horizontal_flip = screen_block_entry & (1 << 10);
+      bool vertical_flip = screen_block_entry & (1 << 11);
+      uint8_t palette_bank = (screen_block_entry >> 12) & 0xF;
+
+      uint8_t const* tile = gpu_fetch_bg_tile(
+        gpu,
+        vram,
+        char_base + tile_index * tile_size_bytes,
+        bg_control.is_256_color_mode,
+        horizontal_flip,
+        decoded_tile
+      );
+
+      uint32_t row = vertical_flip ? TILE_SIZE - 1 - pos_y_in_tile : pos_y_in_tile;
+      tile_row = tile + row * TILE_SIZE;
+      palette_base = bg_control.is_256_color_mode ? 0 : palette_bank * 16;
     }
 
-    BackgroundControl const& bg_control = *(BackgroundControl*)(bg_control_mem + bg * 2);
-    uint8_t* base_bg_tile_ram = vram + bg_control.char_base_block * 0x4000;
-    uint16_t* base_screen_block_ram = (uint16_t*)(vram + bg_control.screen_base_block * 0x800);
-    bool is_rotation_scaling = disp_cnt.background_mode >= 2 || (disp_cnt.background_mode == 1 && bg == 2);
+    uint8_t palette_index = tile_row[texture_x % TILE_SIZE];
 
-    uint32_t width_in_pixels = 0;
-    uint32_t height_in_pixels = 0;
+    // Skip transparent pixels.
+    if (palette_index == 0) continue;
 
-    uint32_t width_in_tiles = 0;
-    uint32_t height_in_tiles = 0;
+    uint16_t color = palette_ram[palette_base + palette_index] | ENABLE_PIXEL;
+    gpu.scanline_by_priority_and_pixel_source[bg_control.priority][bg][screen_x] = color;
+  }
+}
 
-    bool bitmap_mode = disp_cnt.background_mode > 2;
-    if (bitmap_mode) {
-      width_in_pixels = disp_cnt.background_mode == 5 ? 160 : 240;
-      height_in_pixels = disp_cnt.background_mode == 5 ? 128 : 160;
-    } else {
-      gpu_get_bg_size_in_tiles(
-        is_rotation_scaling,
-        bg_control.screen_size,
-        width_in_tiles,
-        height_in_tiles
-      );
+// Bitmap frame geometry. Frame 1 of the page flipped modes starts at 0xA000.
+static constexpr uint32_t BITMAP_FRAME_1_OFFSET = 0xA000;
+static constexpr uint32_t MODE_5_WIDTH = 160;
+static constexpr uint32_t MODE_5_HEIGHT = 128;
+
+// Copies a line of 15-bit colors, marking every pixel as opaque.
+inline void gpu_copy_direct_color_line(uint16_t* dst, uint16_t const* src, uint32_t width) {
+  uint32_t x = 0;
+#if defined(__SSE2__)
+  __m128i const enable_pixel = _mm_set1_epi16((short)ENABLE_PIXEL);
+  for (; x + 8 <= width; x += 8) {
+    __m128i colors = _mm_loadu_si128((__m128i const*)(src + x));
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(colors, enable_pixel));
+  }
+#endif
+  for (; x < width; x++) {
+    dst[x] = src[x] | ENABLE_PIXEL;
+  }
+}
+
+void gpu_render_bitmap_bg(GPUMemory const& memory, GPU& gpu, DisplayControl const& disp_cnt, BackgroundControl const& bg_control, uint8_t scanline) {
+  uint8_t* vram = memory.video_ram;
+  uint16_t* palette_ram = (uint16_t*)(memory.palette_ram);
+  uint16_t* line = gpu.scanline_by_priority_and_pixel_source[bg_control.priority][2];
 
-      width_in_pixels = width_in_tiles * TILE_SIZE;
-      height_in_pixels = height_in_tiles * TILE_SIZE;
+  // Only modes 4 and 5 have a back buffer, mode 3 fills the whole frame.
+  uint32_t frame_offset = disp_cnt.display_frame_select ? BITMAP_FRAME_1_OFFSET : 0;
+
+  switch (disp_cnt.background_mode) {
+    case 3: {
+      // 240x160, 32k colors. 2 bytes per pixel.
+      uint16_t const* src = (uint16_t const*)vram + scanline * FRAME_WIDTH;
+      gpu_copy_direct_color_line(line, src, FRAME_WIDTH);
+      break;
     }
+    case 4: {
+      // 240x160, 256 colors. 1 byte per pixel, index 0 is transparent.
+      uint8_t const* src = vram + frame_offset + scanline * FRAME_WIDTH;
+      for (int screen_x = 0; screen_x < FRAME_WIDTH; ++screen_x) {
+        uint8_t palette_index = src[screen_x];
+        line[screen_x] = palette_index != 0 ? palette_ram[palette_index] | ENABLE_PIXEL : 0;
+      }
+      break;
+    }
+    case 5: {
+      // 160x128, 32k colors. Outside the frame is transparent.
+      if (scanline >= MODE_5_HEIGHT) break;
 
-    int32_t bg_offset_x = 0;
-    int32_t bg_offset_y = 0;
+      uint16_t const* src = (uint16_t const*)(vram + frame_offset) + scanline * MODE_5_WIDTH;
+      gpu_copy_direct_color_line(line, src, MODE_5_WIDTH);
+      break;
+    }
+    default:
+      // Modes 6 and 7 are invalid and display nothing.
+      break;
+  }
+}
 
-    int16_t pa = 1 << 8;
-    int16_t pb = 0;
-    int16_t pc = 0;
-    int16_t pd = 1 << 8;
+// Reference points are 28-bit signed fixed point values (20.8).
+inline int32_t gpu_sign_extend_affine_reference(uint32_t value) {
+  return (int32_t)(value << 4) >> 4;
+}
 
-    if (is_rotation_scaling && bg >= 2) {
-      bg_offset_x = bg == 2 
-        ? ram_read_word_from_io_registers_fast<REG_BG2_X_REF>(cpu.ram)
-        : ram_read_word_from_io_registers_fast<REG_BG3_X_REF>(cpu.ram);
-      bg_offset_y = bg == 2 
-        ? ram_read_word_from_io_registers_fast<REG_BG2_Y_REF>(cpu.ram)
-        : ram_read_word_from_io_registers_fast<REG_BG3_Y_REF>(cpu.ram);
-
-      pa = bg == 2
-        ? ram_read_half_word_from_io_registers_fast<REG_BG2_PARAM_A>(cpu.ram)
-        : ram_read_half_word_from_io_registers_fast<REG_BG3_PARAM_A>(cpu.ram);
-      pb = bg == 2
-        ? ram_read_half_word_from_io_registers_fast<REG_BG2_PARAM_B>(cpu.ram)
-        : ram_read_half_word_from_io_registers_fast<REG_BG3_PARAM_B>(cpu.ram);
-      pc = bg == 2
-        ? ram_read_half_word_from_io_registers_fast<REG_BG2_PARAM_C>(cpu.ram)
-        : ram_read_half_word_from_io_registers_fast<REG_BG3_PARAM_C>(cpu.ram);
-      pd = bg == 2
-        ? ram_read_half_word_from_io_registers_fast<REG_BG2_PARAM_D>(cpu.ram)
-        : ram_read_half_word_from_io_registers_fast<REG_BG3_PARAM_D>(cpu.ram);
-    } else {
-      uint8_t* bg_offset_x_mem = ram_read_memory_from_io_registers_fast<REG_BG0_X_OFFSET>(cpu.ram);
-      uint8_t* bg_offset_y_mem = ram_read_memory_from_io_registers_fast<REG_BG0_Y_OFFSET>(cpu.ram);
+inline void gpu_latch_affine_reference_points(CPU& cpu, GPU& gpu) {
+  gpu.affine_ref_x[0] = gpu_sign_extend_affine_reference(ram_read_word_from_io_registers_fast<REG_BG2_X_REF>(cpu.ram));
+  gpu.affine_ref_y[0] = gpu_sign_extend_affine_reference(ram_read_word_from_io_registers_fast<REG_BG2_Y_REF>(cpu.ram));
+  gpu.affine_ref_x[1] = gpu_sign_extend_affine_reference(ram_read_word_from_io_registers_fast<REG_BG3_X_REF>(cpu.ram));
+  gpu.affine_ref_y[1] = gpu_sign_extend_affine_reference(ram_read_word_from_io_registers_fast<REG_BG3_Y_REF>(cpu.ram));
+  gpu.affine_ref_written = 0;
+}
 
-      // TODO: Fix this, doesn't seem to be working...
-      bg_offset_x = (int32_t)(*(int16_t*)(bg_offset_x_mem + bg * 4)) & 0x1FF;
-      bg_offset_y = (int32_t)(*(int16_t*)(bg_offset_y_mem + bg * 4)) & 0x1FF;
+// Writing BGxX/BGxY mid-frame reloads the internal reference point, taking effect from the next line.
+inline void gpu_reload_written_affine_reference_points(CPU& cpu, GPU& gpu) {
+  if (gpu.affine_ref_written == 0) return;
+
+  int32_t* points[4] = {&gpu.affine_ref_x[0], &gpu.affine_ref_y[0], &gpu.affine_ref_x[1], &gpu.affine_ref_y[1]};
+  for (uint32_t i = 0; i < 4; i++) {
+    if (gpu.affine_ref_written & (1 << i)) {
+      *points[i] = gpu_sign_extend_affine_reference(ram_read_word_direct(cpu.ram, GPU_AFFINE_REFERENCE_REGISTERS[i]));
     }
+  }
+  gpu.affine_ref_written = 0;
+}
 
-    for (int screen_x = 0; screen_x < FRAME_WIDTH; ++screen_x) {
-      int texture_x = 0;
-      int texture_y = 0;
+// After each visible scanline the reference points move by (PB, PD).
+inline void gpu_advance_affine_reference_points(CPU& cpu, GPU& gpu) {
+  gpu.affine_ref_x[0] += (int16_t)ram_read_half_word_from_io_registers_fast<REG_BG2_PARAM_B>(cpu.ram);
+  gpu.affine_ref_y[0] += (int16_t)ram_read_half_word_from_io_registers_fast<REG_BG2_PARAM_D>(cpu.ram);
+  gpu.affine_ref_x[1] += (int16_t)ram_read_half_word_from_io_registers_fast<REG_BG3_PARAM_B>(cpu.ram);
+  gpu.affine_ref_y[1] += (int16_t)ram_read_half_word_from_io_registers_fast<REG_BG3_PARAM_D>(cpu.ram);
+}
 
-      if (is_rotation_scaling) {
-        // Formula for calculating the texture coordinates using the screen coordinates:
-        // texture_pos = offset + dot(transform, screen_pos)
-        
-        // dot(transform, screen_pos)
-        int transformed_x = pa * screen_x + pb * scanline;
-        int transformed_y = pc * screen_x + pd * scanline;
+void gpu_render_affine_bg(GPUMemory const& memory, GPU& gpu, uint8_t bg, BackgroundControl const& bg_control, uint8_t mosaic_lines) {
+  uint8_t* vram = memory.video_ram;
+  uint16_t* palette_ram = (uint16_t*)(memory.palette_ram);
+  uint8_t* base_bg_tile_ram = vram + bg_control.char_base_block * 0x4000;
+  uint8_t* base_screen_block_ram = vram + bg_control.screen_base_block * 0x800;
+
+  uint32_t width_in_tiles = 0;
+  uint32_t height_in_tiles = 0;
+  gpu_get_bg_size_in_tiles(true, bg_control.screen_size, width_in_tiles, height_in_tiles);
+
+  // Affine backgrounds are always square with a power of two size.
+  int32_t size_in_pixels = width_in_tiles * TILE_SIZE;
+  int32_t size_mask = size_in_pixels - 1;
+
+  int16_t pa = bg == 2
+    ? gpu_read_half_word_from_io_registers<REG_BG2_PARAM_A>(memory)
+    : gpu_read_half_word_from_io_registers<REG_BG3_PARAM_A>(memory);
+  int16_t pc = bg == 2
+    ? gpu_read_half_word_from_io_registers<REG_BG2_PARAM_C>(memory)
+    : gpu_read_half_word_from_io_registers<REG_BG3_PARAM_C>(memory);
+
+  // Step along the line from the internal reference point, one (PA, PC) per pixel.
+  int32_t texture_x_fixed = gpu.affine_ref_x[bg - 2];
+  int32_t texture_y_fixed = gpu.affine_ref_y[bg - 2];
+
+  // Vertical mosaic repeats the first line of the block, undo the (PB, PD) steps taken since.
+  if (mosaic_lines > 0) {
+    int16_t pb = bg == 2
+      ? gpu_read_half_word_from_io_registers<REG_BG2_PARAM_B>(memory)
+      : gpu_read_half_word_from_io_registers<REG_BG3_PARAM_B>(memory);
+    int16_t pd = bg == 2
+      ? gpu_read_half_word_from_io_registers<REG_BG2_PARAM_D>(memory)
+      : gpu_read_half_word_from_io_registers<REG_BG3_PARAM_D>(memory);
+    texture_x_fixed -= pb * mosaic_lines;
+    texture_y_fixed -= pd * mosaic_lines;
+  }
 
-        // offset + dot(transform, screen_pos)
-        texture_x = (bg_offset_x + transformed_x) >> 8;
-        texture_y = (bg_offset_y + transformed_y) >> 8;
-      } else {
-        texture_x = screen_x + bg_offset_x;
-        texture_y = scanline + bg_offset_y;
-      }
+  for (int screen_x = 0; screen_x < FRAME_WIDTH; ++screen_x, texture_x_fixed += pa, texture_y_fixed += pc) {
+    int32_t texture_x = texture_x_fixed >> 8;
+    int32_t texture_y = texture_y_fixed >> 8;
 
-      // Wrap around the texture coordinates.
-      texture_x = texture_x % width_in_pixels;
-      texture_y = texture_y % height_in_pixels;
+    if (bg_control.display_area_overflow) {
+      texture_x &= size_mask;
+      texture_y &= size_mask;
+    } else if (texture_x < 0 || texture_x >= size_in_pixels || texture_y < 0 || texture_y >= size_in_pixels) {
+      // Outside the map and not wrapping, the pixel is transparent.
+      continue;
+    }
 
-      // TODO: Handle wrap around.
-      if (texture_x < 0 || texture_x >= width_in_pixels || texture_y < 0 || texture_y >= height_in_pixels) {
-        continue;
-      }
+    // 1 byte per screen entry. Always 256 color mode (8bpp).
+    uint8_t tile_index = base_screen_block_ram[(texture_y / TILE_SIZE) * width_in_tiles + texture_x / TILE_SIZE];
+    uint8_t palette_index = base_bg_tile_ram[tile_index * TILE_8BPP_BYTES + (texture_y % TILE_SIZE) * TILE_SIZE + texture_x % TILE_SIZE];
 
-      if (bitmap_mode) {
-        uint32_t frame_offset = disp_cnt.display_frame_select 
-          ? 256 * height_in_pixels 
-          : 0;
-        if (disp_cnt.background_mode == 4) {
-          // 256 color mode. 1 byte per pixel.
-          uint8_t palette_idx = vram[scanline * width_in_pixels + screen_x + frame_offset];
-          if (palette_idx == 0) continue;
-          
-          uint16_t color = palette_ram[palette_idx] | ENABLE_PIXEL;
-          gpu.scanline_by_priority_and_pixel_source[screen_x][bg_control.priority][bg] = color;
-        } else {
-          // 32k color mode. 2 bytes per pixel.
-          uint16_t color = ((uint16_t*)vram)[scanline * width_in_pixels + screen_x + frame_offset] | ENABLE_PIXEL;
-          gpu.scanline_by_priority_and_pixel_source[screen_x][bg_control.priority][bg] = color;
-        }
-      } else {
-        // Get the tile coordinates.
-        int tile_x = texture_x / TILE_SIZE;
-        int tile_y = texture_y / TILE_SIZE;
+    // Zero palette index means transparent pixel for backgrounds.
+    if (palette_index == 0) continue;
 
-        int pos_x_in_tile = texture_x % TILE_SIZE;
-        int pos_y_in_tile = texture_y % TILE_SIZE;
+    gpu.scanline_by_priority_and_pixel_source[bg_control.priority][bg][screen_x] = palette_ram[palette_index] | ENABLE_PIXEL;
+  }
+}
 
-        uint8_t tile_size_bytes = bg_control.is_256_color_mode ? TILE_8BPP_BYTES : TILE_4BPP_BYTES;
+void gpu_render_bg_layer(GPUMemory const& memory, GPU& gpu, uint8_t scanline) {
+  uint16_t disp_cnt_data = gpu_read_half_word_from_io_registers<REG_LCD_CONTROL>(memory);
+  DisplayControl const& disp_cnt = *(DisplayControl*)&disp_cnt_data;
 
-        if (is_rotation_scaling) {
-          // 1 byte per entry. Always 256 color mode (8bpp).
-          int screen_entry_idx = tile_y * width_in_tiles + tile_x;
-          uint8_t tile_index = ((uint8_t*)base_screen_block_ram)[screen_entry_idx];
-          uint8_t palette_number = *(base_bg_tile_ram + tile_index * tile_size_bytes + pos_y_in_tile * TILE_SIZE + pos_x_in_tile);
-          
-          // Zero palette number means transparent pixel for backgrounds.
-          if (palette_number == 0) continue;
+  uint8_t* bg_control_mem = gpu_read_memory_from_io_registers<REG_BG0_CONTROL>(memory);
 
-          uint16_t color = palette_ram[palette_number];
-          color |= ENABLE_PIXEL;
-          gpu.scanline_by_priority_and_pixel_source[screen_x][bg_control.priority][bg] = color;
-        } else {
-          // 2 bytes per screen entry, can be 16 (4bpp) or 256 colors (8bpp).
-          int screen_block_idx = 0;
-          if (width_in_tiles == height_in_tiles) {
-            screen_block_idx = (tile_y / 32) * (width_in_tiles / 32) + (tile_x / 32);
-          } else if (width_in_tiles > height_in_tiles) {
-            screen_block_idx = tile_x / 32;
-          } else {
-            screen_block_idx = tile_y / 32;
-          }
+  // Drop decoded tiles whose VRAM has been written since the last scanline.
+  if (gpu.tile_cache != nullptr) {
+    tile_cache_sync(*gpu.tile_cache, memory.vram_dirty_blocks);
+  }
 
-          uint16_t screen_block_entry = ((uint16_t*)base_screen_block_ram)[screen_block_idx * 1024 + (tile_y % 32) * 32 + (tile_x % 32)];
-          uint16_t tile_index = screen_block_entry & 0x3FF;
-          uint8_t flip_mode = (screen_block_entry >> 10) & 0x3;
-          bool horizontal_flip = flip_mode & 0x1;
-          bool vertical_flip = flip_mode & 0x2;
-          uint8_t palette_bank = (screen_block_entry >> 12) & 0xF;
+  uint16_t mosaic_size = gpu_read_half_word_from_io_registers<REG_MOSAIC_SIZE>(memory);
+  uint8_t mosaic_width = (mosaic_size & 0xF) + 1;
+  uint8_t mosaic_height = ((mosaic_size >> 4) & 0xF) + 1;
 
-          if (horizontal_flip) {
-            pos_x_in_tile = TILE_SIZE - 1 - pos_x_in_tile;
-          }
-          if (vertical_flip) {
-            pos_y_in_tile = TILE_SIZE - 1 - pos_y_in_tile;
-          }
+  bool display_bg[4] = {
+    disp_cnt.display_bg0,
+    disp_cnt.display_bg1,
+    disp_cnt.display_bg2,
+    disp_cnt.display_bg3
+  };
 
-          uint8_t* tile_data = &base_bg_tile_ram[tile_index * tile_size_bytes];
-
-          if (bg_control.is_256_color_mode) {
-            // TODO: This code path is untested.
-            uint8_t palette_index = tile_data[pos_y_in_tile * TILE_SIZE + pos_x_in_tile];
-            uint16_t color = palette_ram[palette_index];
-
-            // Skip transparent pixels.
-            if (palette_index == 0) continue;
-
-            color |= ENABLE_PIXEL;
-            gpu.scanline_by_priority_and_pixel_source[screen_x][bg_control.priority][bg] = color;
-          } else {
-            uint8_t palette_indices = tile_data[pos_y_in_tile * HALF_TILE_SIZE + pos_x_in_tile / 2];
-            uint8_t palette_index = pos_x_in_tile % 2 == 0
-              ? palette_indices & 0xF 
-              : (palette_indices >> 4) & 0xF;
-
-            // Skip transparent pixels.
-            if (palette_index == 0) continue;
-            
-            uint16_t color = palette_ram[palette_bank * 16 + palette_index];
-            color |= ENABLE_PIXEL;
-            gpu.scanline_by_priority_and_pixel_source[screen_x][bg_control.priority][bg] = color;
-          }
-        }
-      }
+  for (int bg = 0; bg < 4; bg++) {
+    // Skip rendering the background if it's not enabled.
+    if (!display_bg[bg]) {
+      continue;
+    }
+
+    // Prevent rendering other bg layers if in mode 3-5 and bg is not 2.
+    if (bg != 2 && disp_cnt.background_mode > 2) {
+      continue;
+    }
+
+    // Mode 2 only has the two affine backgrounds.
+    if (bg < 2 && disp_cnt.background_mode == 2) {
+      continue;
+    }
+
+    BackgroundControl const& bg_control = *(BackgroundControl*)(bg_control_mem + bg * 2);
+    bool bitmap_mode = disp_cnt.background_mode > 2;
+    bool is_rotation_scaling = disp_cnt.background_mode == 2 || (disp_cnt.background_mode == 1 && bg == 2);
+
+    // Vertical mosaic renders the first line of the mosaic block again.
+    uint8_t mosaic_lines = bg_control.mosaic ? scanline % mosaic_height : 0;
+    uint8_t bg_scanline = scanline - mosaic_lines;
+
+    if (bitmap_mode) {
+      gpu_render_bitmap_bg(memory, gpu, disp_cnt, bg_control, bg_scanline);
+    } else if (is_rotation_scaling) {
+      gpu_render_affine_bg(memory, gpu, bg, bg_control, mosaic_lines);
+    } else {
+      gpu_render_text_bg(memory, gpu, bg, bg_control, bg_scanline);
+    }
+
+    // Horizontal mosaic is a pass over the finished layer line.
+    if (bg_control.mosaic && mosaic_width > 1) {
+      gpu_apply_horizontal_mosaic(gpu.scanline_by_priority_and_pixel_source[bg_control.priority][bg], mosaic_width);
     }
   }
 }
 
-void gpu_render_obj_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
-  uint16_t disp_cnt_data = ram_read_half_word_from_io_registers_fast<REG_LCD_CONTROL>(cpu.ram);
+void gpu_render_obj_layer(GPUMemory const& memory, GPU& gpu, uint8_t scanline) {
+  uint16_t disp_cnt_data = gpu_read_half_word_from_io_registers<REG_LCD_CONTROL>(memory);
   DisplayControl const& disp_cnt = *(DisplayControl*)&disp_cnt_data;
 
-  uint8_t* vram = cpu.ram.video_ram;
-  uint16_t* oam = (uint16_t*)cpu.ram.object_attribute_memory;
-  uint16_t* sprite_palette_ram = (uint16_t*)(cpu.ram.palette_ram + 0x200);
+  uint8_t* vram = memory.video_ram;
+  uint16_t* oam = (uint16_t*)memory.object_attribute_memory;
+  uint16_t* sprite_palette_ram = (uint16_t*)(memory.palette_ram + 0x200);
   uint8_t* base_sprite_tile_ram = vram + 0x10000;
 
+  uint16_t mosaic_size = gpu_read_half_word_from_io_registers<REG_MOSAIC_SIZE>(memory);
+  uint8_t mosaic_height = ((mosaic_size >> 12) & 0xF) + 1;
+
   for (int i = 127; i >= 0; i--) {
     uint16_t attr0 = oam[i * 4];
 
@@ -758,7 +918,7 @@ void gpu_render_obj_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
     int16_t pc = 0;
     int16_t pd = 1 << 8;
     if (rotation_scaling) {
-      gpu_get_obj_affine_params(cpu, attr1, pa, pb, pc, pd);
+      gpu_get_obj_affine_params(memory.object_attribute_memory, attr1, pa, pb, pc, pd);
     }
 
     uint8_t width_in_tiles = width / TILE_SIZE;
@@ -783,17 +943,28 @@ void gpu_render_obj_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
       gpu.obj_window_exists = true;
     }
 
+    bool mosaic = attr0 & (1 << 12);
+
     int iy = y_in_draw_area - half_height;
+
+    // Vertical mosaic samples the first line of the mosaic block, but never above the sprite.
+    int sample_iy = iy;
+    if (mosaic) {
+      uint8_t mosaic_lines = scanline % mosaic_height;
+      sample_iy -= mosaic_lines < y_in_draw_area ? mosaic_lines : y_in_draw_area;
+      gpu.obj_mosaic_exists = true;
+    }
+
     for (int ix = -half_width; ix < half_width; ix++) {
       int texture_x = 0;
       int texture_y = 0;
 
       if (rotation_scaling) {
-        texture_x = (pa * ix + pb * iy) >> 8;
-        texture_y = (pc * ix + pd * iy) >> 8;
+        texture_x = (pa * ix + pb * sample_iy) >> 8;
+        texture_y = (pc * ix + pd * sample_iy) >> 8;
       } else {
         texture_x = ix;
-        texture_y = iy;
+        texture_y = sample_iy;
       }
 
       texture_x += center_x_texture_space;
@@ -841,7 +1012,8 @@ void gpu_render_obj_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
       uint8_t tile_y = row_idx * TILE_SIZE;
       uint8_t texture_x_in_tile = texture_x - tile_x;
       uint8_t texture_y_in_tile = texture_y - tile_y;
-      uint8_t* current_tile = &base_sprite_tile_ram[tile_idx * tile_size_bytes];
+      // Tile numbers wrap around inside the 32kb of OBJ VRAM.
+      uint8_t* current_tile = &base_sprite_tile_ram[(tile_idx * tile_size_bytes) & OBJ_VRAM_MASK];
 
       if (is_256_color_mode) {
         uint8_t palette_idx = current_tile[texture_y_in_tile * TILE_SIZE + texture_x_in_tile];
@@ -852,7 +1024,7 @@ void gpu_render_obj_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
 
         if (obj_mode != OBJ_MODE_WINDOW) {
           color |= ENABLE_PIXEL;
-          gpu.scanline_by_priority_and_pixel_source[x][priority][PIXEL_SOURCE_OBJ] = color;
+          gpu.scanline_by_priority_and_pixel_source[priority][PIXEL_SOURCE_OBJ][x] = color;
         }
       } else {
         uint8_t palette_indices = current_tile[texture_y_in_tile * HALF_TILE_SIZE + texture_x_in_tile / 2];
@@ -866,7 +1038,7 @@ void gpu_render_obj_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
         
         if (obj_mode != OBJ_MODE_WINDOW) {
           color |= ENABLE_PIXEL;
-          gpu.scanline_by_priority_and_pixel_source[x][priority][PIXEL_SOURCE_OBJ] = color;
+          gpu.scanline_by_priority_and_pixel_source[priority][PIXEL_SOURCE_OBJ][x] = color;
         }
       }
 
@@ -875,41 +1047,132 @@ void gpu_render_obj_layer(CPU& cpu, GPU& gpu, uint8_t scanline) {
       } else if (obj_mode == OBJ_MODE_WINDOW) {
         gpu.scanline_obj_window_buffer[x] = true;
       }
+
+      // Sprites drawn later (lower OAM index) replace the mosaic flag too.
+      if (obj_mode != OBJ_MODE_WINDOW) {
+        gpu.scanline_obj_mosaic_buffer[x] = mosaic;
+      }
+    }
+  }
+}
+
+// Horizontal OBJ mosaic, applied to the OBJ line after all sprites are drawn.
+// Pixels of mosaic sprites take the value at the start of their mosaic block, if a mosaic sprite drew it.
+inline void gpu_apply_obj_mosaic(GPUMemory const& memory, GPU& gpu) {
+  if (!gpu.obj_mosaic_exists) return;
+
+  uint16_t mosaic_size = gpu_read_half_word_from_io_registers<REG_MOSAIC_SIZE>(memory);
+  uint8_t mosaic_width = ((mosaic_size >> 8) & 0xF) + 1;
+  if (mosaic_width == 1) return;
+
+  for (int x = 0; x < FRAME_WIDTH; x++) {
+    if (!gpu.scanline_obj_mosaic_buffer[x]) continue;
+
+    int block_start = x - x % mosaic_width;
+    if (block_start == x || !gpu.scanline_obj_mosaic_buffer[block_start]) continue;
+
+    for (int priority = 0; priority < 4; priority++) {
+      gpu.scanline_by_priority_and_pixel_source[priority][PIXEL_SOURCE_OBJ][x] =
+        gpu.scanline_by_priority_and_pixel_source[priority][PIXEL_SOURCE_OBJ][block_start];
     }
+    gpu.scanline_semi_transparent_buffer[x] = gpu.scanline_semi_transparent_buffer[block_start];
   }
 }
 
-void gpu_render_scanline(CPU& cpu, GPU& gpu, uint8_t scanline) {
+void gpu_render_scanline(GPUMemory const& memory, GPU& gpu, uint8_t scanline) {
   // Reset layer buffers.
   gpu_clear_scanline_buffers(gpu);
 
   // Backdrop Layer.
-  uint16_t backdrop_color = gpu_get_backdrop_color(cpu);
+  uint16_t backdrop_color = gpu_get_backdrop_color(memory);
   for (int i = 0; i < FRAME_WIDTH; i++) {
     gpu.scanline_buffer[i] = backdrop_color;
   }
 
   // BG Layers.
-  gpu_render_bg_layer(cpu, gpu, scanline);
+  gpu_render_bg_layer(memory, gpu, scanline);
 
   // OBJ Layer.
-  gpu_render_obj_layer(cpu, gpu, scanline);
+  gpu_render_obj_layer(memory, gpu, scanline);
+  gpu_apply_obj_mosaic(memory, gpu);
 
   // Apply Window Effects
-  gpu_apply_window_effects(cpu, gpu, scanline);
+  gpu_compute_window_spans(memory, gpu, scanline);
+  gpu_apply_window_effects(gpu);
 
   // Apply Special Effects
-  gpu_apply_special_effects(cpu, gpu);
+  gpu_apply_special_effects(memory, gpu);
 
   // Apply Window to Special Effects
-  gpu_apply_window_to_special_effects(cpu, gpu, scanline);
+  gpu_apply_window_to_special_effects(gpu);
 
   // Composite the various priority buffers to a final scanline.
-  gpu_resolve_scanline_buffer(cpu, gpu);
+  gpu_resolve_scanline_buffer(gpu);
+}
 
-  // Copy the final scanline buffer to the frame buffer.
-  uint32_t frame_buffer_offset = scanline * FRAME_WIDTH;
-  memcpy(&gpu.frame_buffer[frame_buffer_offset], gpu.scanline_buffer, FRAME_WIDTH * sizeof(uint16_t));
+uint32_t gpu_observation_size(ObservationFormat format) {
+  switch (format) {
+    case OBSERVATION_FORMAT_RGB555: return FRAME_BUFFER_SIZE_BYTES;
+    case OBSERVATION_FORMAT_GRAY8: return FRAME_BUFFER_SIZE;
+    case OBSERVATION_FORMAT_GRAY8_HALF: return FRAME_BUFFER_SIZE / 4;
+  }
+  return 0;
+}
+
+// Bring the observation's copy of a frame buffer line up to date.
+void gpu_observe_line(GPU& gpu, uint8_t scanline) {
+  uint16_t const* line = &gpu.frame_buffer[scanline * FRAME_BUFFER_PITCH];
+  switch (gpu.observation_format) {
+    case OBSERVATION_FORMAT_RGB555:
+      memcpy((uint16_t*)gpu.observation + scanline * FRAME_WIDTH, line, FRAME_WIDTH * sizeof(uint16_t));
+      break;
+    case OBSERVATION_FORMAT_GRAY8:
+      color_convert_gray8(line, FRAME_WIDTH, (uint8_t*)gpu.observation + scanline * FRAME_WIDTH);
+      break;
+    case OBSERVATION_FORMAT_GRAY8_HALF: {
+      // Redone for either line of the pair. Both are written by the same thread, see render_pipeline_create.
+      uint32_t first_line = scanline & ~1;
+      color_convert_gray8_half(
+        &gpu.frame_buffer[first_line * FRAME_BUFFER_PITCH],
+        &gpu.frame_buffer[(first_line + 1) * FRAME_BUFFER_PITCH],
+        FRAME_WIDTH,
+        (uint8_t*)gpu.observation + (first_line / 2) * (FRAME_WIDTH / 2)
+      );
+      break;
+    }
+  }
+}
+
+void gpu_set_observation(GPU& gpu, ObservationFormat format, void* buffer) {
+  // Render workers write lines into the observation too.
+  if (gpu.render_pipeline != nullptr) {
+    render_pipeline_wait_idle(*gpu.render_pipeline);
+  }
+
+  gpu.observation = buffer;
+  gpu.observation_format = format;
+  if (buffer == nullptr) return;
+
+  for (uint32_t line = 0; line < FRAME_HEIGHT; line++) {
+    gpu_observe_line(gpu, line);
+  }
+}
+
+void gpu_write_frame_buffer_line(GPU& gpu, uint8_t scanline, uint16_t const* line) {
+  uint16_t* frame_buffer_line = &gpu.frame_buffer[scanline * FRAME_WIDTH];
+  if (memcmp(frame_buffer_line, line, FRAME_WIDTH * sizeof(uint16_t)) == 0) return;
+
+  memcpy(frame_buffer_line, line, FRAME_WIDTH * sizeof(uint16_t));
+  if (gpu.observation != nullptr) {
+    gpu_observe_line(gpu, scanline);
+  }
+  std::atomic_ref<uint64_t>(gpu.frame_dirty_lines[scanline >> 6]).fetch_or(1ULL << (scanline & 63), std::memory_order_release);
+}
+
+void gpu_take_dirty_lines(GPU& gpu, uint64_t (&dirty_lines)[FRAME_DIRTY_LINE_WORDS]) {
+  for (uint32_t i = 0; i < FRAME_DIRTY_LINE_WORDS; i++) {
+    dirty_lines[i] = std::atomic_ref<uint64_t>(gpu.frame_dirty_lines[i]).exchange(0, std::memory_order_acquire);
+  }
 }
 
 void gpu_complete_scanline(CPU& cpu, GPU& gpu) {
@@ -938,6 +1201,9 @@ void gpu_complete_scanline(CPU& cpu, GPU& gpu) {
 
   // Begin VBlank
   if (scanline == 160) {
+    // The affine reference points are reloaded from BGxX/BGxY for the next frame.
+    gpu_latch_affine_reference_points(cpu, gpu);
+
     // std::cout << "VBlank" << std::endl;
     lcd_status |= 0x1;
     ram_write_half_word_to_io_registers_fast<REG_LCD_STATUS>(cpu.ram, lcd_status);
@@ -952,9 +1218,27 @@ void gpu_complete_scanline(CPU& cpu, GPU& gpu) {
     }
   }
 
+  if (scanline == 0) {
+    gpu.render_current_frame = gpu_should_render_frame(gpu);
+  }
+
   if (scanline < 160) {
     // Render scanline if not in VBlank.
-    gpu_render_scanline(cpu, gpu, scanline);
+    // Keep the affine reference points in step even when the frame is skipped.
+    gpu_reload_written_affine_reference_points(cpu, gpu);
+    if (gpu.render_current_frame) {
+      if (gpu.render_pipeline != nullptr) {
+        // Record the line for the render worker, the frame is handed off after the last visible line.
+        render_pipeline_record_line(cpu.ram, gpu, *gpu.render_pipeline, scanline);
+        if (scanline == FRAME_HEIGHT - 1) {
+          render_pipeline_submit_frame(*gpu.render_pipeline);
+        }
+      } else {
+        gpu_render_scanline(gpu_memory_from_ram(cpu.ram), gpu, scanline);
+        gpu_write_frame_buffer_line(gpu, scanline, gpu.scanline_buffer);
+      }
+    }
+    gpu_advance_affine_reference_points(cpu, gpu);
   }
 
   // End VBlank
@@ -969,6 +1253,11 @@ void gpu_complete_scanline(CPU& cpu, GPU& gpu) {
   if (scanline == 228) {
     scanline = 0;
   }
+
+  // The last visible line is done, the frame is complete.
+  if (scanline == 160) {
+    gpu.frame_sequence++;
+  }
   ram_write_byte_to_io_registers_fast<REG_VERTICAL_COUNT>(cpu.ram, scanline);
 }
 
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "cpu.h"
+#include "tile_cache.h"
 
 static constexpr uint32_t FRAME_WIDTH = 240;
 static constexpr uint32_t FRAME_HEIGHT = 160;
 static constexpr uint32_t FRAME_BUFFER_SIZE = FRAME_WIDTH * FRAME_HEIGHT;
 static constexpr uint32_t FRAME_BUFFER_SIZE_BYTES = FRAME_BUFFER_SIZE * sizeof(uint16_t);
 static constexpr uint32_t FRAME_BUFFER_PITCH = FRAME_WIDTH;
+static constexpr uint32_t FRAME_DIRTY_LINE_WORDS = (FRAME_HEIGHT + 63) / 64;
 
 static constexpr uint32_t TILE_SIZE = 8;
 static constexpr uint32_t HALF_TILE_SIZE = 4;
@@ -14,6 +16,12 @@ static constexpr uint32_t TILE_4BPP_BYTES = 32;
 static constexpr uint32_t TILE_8BPP_BYTES = 64;
 static constexpr uint16_t ENABLE_PIXEL = 1 << 15;
 
+// The renderer only reads I/O registers below this offset (DISPCNT up to BLDY).
+static constexpr uint32_t GPU_IO_REGISTERS_SIZE = 0x58;
+
+// BGxX/BGxY, the registers the affine reference points are loaded from.
+static constexpr uint32_t GPU_AFFINE_REFERENCE_REGISTERS[4] = {REG_BG2_X_REF, REG_BG2_Y_REF, REG_BG3_X_REF, REG_BG3_Y_REF};
+
 enum PixelSource {
   PIXEL_SOURCE_BG0 = 0,
   PIXEL_SOURCE_BG1 = 1,
@@ -74,9 +82,82 @@ struct Window {
   WindowVertical vertical;
 };
 
+// Layer enable bits of WININ/WINOUT (BG0-3, OBJ), bit 5 enables special effects.
+static constexpr uint8_t WINDOW_ENABLE_SPECIAL_EFFECTS = 1 << 5;
+static constexpr uint8_t WINDOW_ENABLE_ALL = 0x3F;
+
+enum WindowRegion {
+  WINDOW_REGION_0 = 0,
+  WINDOW_REGION_1 = 1,
+  WINDOW_REGION_OBJ = 2,
+  WINDOW_REGION_OUTSIDE = 3
+};
+
+// Run of pixels [start, end) on a scanline that belong to the same window.
+struct WindowSpan {
+  uint8_t start;
+  uint8_t end;
+  uint8_t enable_mask;
+};
+
+// Memory read by the renderer. Points at the live RAM, or at a render worker's shadow copy.
+struct GPUMemory {
+  uint8_t* io_registers;
+  uint8_t* palette_ram;
+  uint8_t* video_ram;
+  uint8_t* object_attribute_memory;
+  uint64_t* vram_dirty_blocks;
+};
+
+inline GPUMemory gpu_memory_from_ram(RAM& ram) {
+  return GPUMemory {
+    ram.io_registers,
+    ram.palette_ram,
+    ram.video_ram,
+    ram.object_attribute_memory,
+    ram.vram_dirty_blocks
+  };
+}
+
+template<uint32_t Offset>
+inline uint8_t* gpu_read_memory_from_io_registers(GPUMemory const& memory) {
+  static_assert((Offset & MEMORY_NOT_MASK) < GPU_IO_REGISTERS_SIZE);
+  return &memory.io_registers[Offset & MEMORY_NOT_MASK];
+}
+
+template<uint32_t Offset>
+inline uint8_t gpu_read_byte_from_io_registers(GPUMemory const& memory) {
+  return *gpu_read_memory_from_io_registers<Offset>(memory);
+}
+
+template<uint32_t Offset>
+inline uint16_t gpu_read_half_word_from_io_registers(GPUMemory const& memory) {
+  static_assert((Offset & MEMORY_NOT_MASK) + 2 <= GPU_IO_REGISTERS_SIZE);
+  return *(uint16_t*)gpu_read_memory_from_io_registers<Offset>(memory);
+}
+
+template<uint32_t Offset>
+inline uint32_t gpu_read_word_from_io_registers(GPUMemory const& memory) {
+  static_assert((Offset & MEMORY_NOT_MASK) + 4 <= GPU_IO_REGISTERS_SIZE);
+  return *(uint32_t*)gpu_read_memory_from_io_registers<Offset>(memory);
+}
+
+// Formats a caller owned buffer can receive the frame in, see gpu_set_observation.
+enum ObservationFormat {
+  // FRAME_WIDTH x FRAME_HEIGHT pixels in the frame buffer's own 15 bit format.
+  OBSERVATION_FORMAT_RGB555 = 0,
+  // FRAME_WIDTH x FRAME_HEIGHT bytes of luma.
+  OBSERVATION_FORMAT_GRAY8 = 1,
+  // FRAME_WIDTH / 2 x FRAME_HEIGHT / 2 bytes, the luma of each 2x2 block averaged.
+  OBSERVATION_FORMAT_GRAY8_HALF = 2
+};
+
+struct GPURenderPipeline;
+
 struct GPU {
-  // 4 priority levels, 4 possible pixel sources (BACKDROP is not used here).
-  uint16_t scanline_by_priority_and_pixel_source[FRAME_WIDTH][4][5];
+  // 4 priority levels, 5 possible pixel sources (BACKDROP is not used here).
+  // Each layer line is contiguous so whole lines can be written at once.
+  uint16_t scanline_by_priority_and_pixel_source[4][5][FRAME_WIDTH];
   uint16_t scanline_special_effects_buffer[FRAME_WIDTH];
 
   // Semi-Transparent Buffer.
@@ -86,17 +167,80 @@ struct GPU {
   bool scanline_obj_window_buffer[FRAME_WIDTH];
   bool obj_window_exists = false;
 
+  // Pixels of the OBJ line drawn by sprites with mosaic enabled.
+  bool scanline_obj_mosaic_buffer[FRAME_WIDTH];
+  bool obj_mosaic_exists = false;
+
+  // Windows of the current scanline, none when windowing is disabled.
+  WindowSpan window_spans[FRAME_WIDTH];
+  uint8_t window_span_count = 0;
+
   // Final scanline color buffer.
   uint16_t scanline_buffer[FRAME_WIDTH];
 
   // Full Frame buffer.
   uint16_t frame_buffer[FRAME_BUFFER_SIZE];
+
+  // One bit per frame buffer line whose pixels changed since the presenter last took the set.
+  // Set by whichever thread renders the line, so only accessed atomically.
+  uint64_t frame_dirty_lines[FRAME_DIRTY_LINE_WORDS];
+
+  // Internal reference points of the BG2/BG3 affine backgrounds (20.8 fixed point).
+  // Latched from BGxX/BGxY at VBlank and before the next line after a write, and advanced by PB/PD every scanline.
+  int32_t affine_ref_x[2] = {0, 0};
+  int32_t affine_ref_y[2] = {0, 0};
+
+  // Reference registers written since the last reload, one bit each in GPU_AFFINE_REFERENCE_REGISTERS order.
+  // Set by write hooks, as every write reloads the point, even with the value it already had.
+  uint8_t affine_ref_written = 0;
+
+  // Optional cache of decoded BG tiles (nullptr when disabled).
+  TileCache* tile_cache = nullptr;
+
+  // Frame skipping, `frame_skip_rendered` out of every `frame_skip_period` frames are drawn.
+  // Skipped frames keep VCOUNT/DISPSTAT/IRQ timing but are not rasterized.
+  uint32_t frame_skip_rendered = 1;
+  uint32_t frame_skip_period = 1;
+  uint32_t frame_skip_accumulator = 0;
+  bool render_current_frame = true;
+
+  // Optional render worker (nullptr when scanlines are rendered on the emulation thread).
+  GPURenderPipeline* render_pipeline = nullptr;
+
+  // Caller owned copy of the frame, kept current line by line as the frame buffer changes (nullptr when unused).
+  void* observation = nullptr;
+  ObservationFormat observation_format = OBSERVATION_FORMAT_RGB555;
+
+  // Frames completed since the GPU was created, bumped as VCOUNT reaches 160. Not part of the emulated state,
+  // it keeps counting across snapshot restores so readers can tell a new frame from an old one.
+  uint64_t frame_sequence = 0;
 };
 
 void gpu_init(CPU& cpu, GPU& gpu);
+void gpu_set_tile_cache_enabled(CPU& cpu, GPU& gpu, bool enabled);
+void gpu_set_frame_skip(GPU& gpu, uint32_t frames_rendered, uint32_t period);
+// Render on `worker_count` threads, each owning a band of scanlines (0 renders on the emulation thread).
+void gpu_set_render_pipeline(CPU& cpu, GPU& gpu, uint32_t worker_count);
+// Composes a scanline into gpu.scanline_buffer.
+void gpu_render_scanline(GPUMemory const& memory, GPU& gpu, uint8_t scanline);
+
+// Keep `buffer` holding the frame in `format`, it's filled straight away and then as lines change.
+// The buffer must stay valid until replaced or cleared with nullptr.
+void gpu_set_observation(GPU& gpu, ObservationFormat format, void* buffer);
+uint32_t gpu_observation_size(ObservationFormat format);
+
+// Copies a finished line into the frame buffer, marking it dirty only if any pixel changed.
+void gpu_write_frame_buffer_line(GPU& gpu, uint8_t scanline, uint16_t const* line);
+
+// Moves the set of dirty lines into `dirty_lines` and clears it, for presenters and encoders.
+void gpu_take_dirty_lines(GPU& gpu, uint64_t (&dirty_lines)[FRAME_DIRTY_LINE_WORDS]);
+
+inline bool gpu_is_line_dirty(uint64_t const (&dirty_lines)[FRAME_DIRTY_LINE_WORDS], uint32_t line) {
+  return dirty_lines[line >> 6] & (1ULL << (line & 63));
+}
 void gpu_cycle(CPU& cpu, GPU& gpu);
 
-inline void gpu_get_obj_affine_params(CPU& cpu, uint16_t attr1, int16_t& pa, int16_t& pb, int16_t& pc, int16_t& pd) {
+inline void gpu_get_obj_affine_params(uint8_t const* object_attribute_memory, uint16_t attr1, int16_t& pa, int16_t& pb, int16_t& pc, int16_t& pd) {
   // Rotation / Scaling parameters
   // 1st Group - PA=07000006, PB=0700000E, PC=07000016, PD=0700001E
   // 2nd Group - PA=07000026, PB=0700002E, PC=07000036, PD=0700003E
@@ -107,13 +251,17 @@ inline void gpu_get_obj_affine_params(CPU& cpu, uint16_t attr1, int16_t& pa, int
   // 7th Group - PA=070000C6, PB=070000CE, PC=070000D6, PD=070000DE
   // etc.
   uint8_t matrix_index = (attr1 >> 9) & 0x1F;
-  int16_t* rotation_scaling_params = (int16_t*)(cpu.ram.object_attribute_memory + 0x6 + matrix_index * 0x20);
+  int16_t const* rotation_scaling_params = (int16_t const*)(object_attribute_memory + 0x6 + matrix_index * 0x20);
   pa = rotation_scaling_params[0];
   pb = rotation_scaling_params[4];
   pc = rotation_scaling_params[8];
   pd = rotation_scaling_params[12];
 }
 
+inline void gpu_get_obj_affine_params(CPU& cpu, uint16_t attr1, int16_t& pa, int16_t& pb, int16_t& pc, int16_t& pd) {
+  gpu_get_obj_affine_params(cpu.ram.object_attribute_memory, attr1, pa, pb, pc, pd);
+}
+
 inline void gpu_get_bg_size_in_tiles(
   bool is_rotation_scaling,
   uint8_t screen_size,
@@ -2,15 +2,11 @@
 #include "3rdparty/zengine/ZEngine-Core/Input/InputManager.h"
 
 #define DEFINE_GBA_BUTTON(name, value) \
-  static constexpr uint16_t GBA_BUTTON_##name = value; \
-  static constexpr uint16_t GBA_BUTTON_##name##_DOWN = ~value; \
-  static constexpr uint16_t GBA_BUTTON_##name##_UP = value;
+  static constexpr uint16_t GBA_BUTTON_##name = value;
 
 #define MAP_KEY_TO_GBA_BUTTON(key, button) \
   if (inputManager->GetButtonDown(key)) { \
-    key_status &= GBA_BUTTON_##button##_DOWN; \
-  } else { \
-    key_status |= GBA_BUTTON_##button##_UP; \
+    keys |= GBA_BUTTON_##button; \
   }
 
 // Define constants for the GBA buttons.
@@ -23,9 +19,28 @@ DEFINE_GBA_BUTTON(LEFT, (1 << 5))
 DEFINE_GBA_BUTTON(UP, (1 << 6))
 DEFINE_GBA_BUTTON(DOWN, (1 << 7))
 
-void input_handle_key_detection(CPU& cpu, ZEngine::InputManager* inputManager) {
-  // Read the previous key status.
-  uint16_t key_status = ram_read_half_word_from_io_registers_fast<REG_KEY_STATUS>(cpu.ram);
+void input_push_keys(InputState& input, uint16_t keys) {
+  std::lock_guard<std::mutex> lock(input.mutex);
+  if (keys == input.queued_keys) return;
+
+  if (input.queue.size() >= INPUT_QUEUE_CAPACITY) {
+    input.queue.pop_front();
+  }
+  input.queue.push_back(keys);
+  input.queued_keys = keys;
+}
+
+uint16_t input_next_frame_keys(InputState& input) {
+  std::lock_guard<std::mutex> lock(input.mutex);
+  if (!input.queue.empty()) {
+    input.frame_keys = input.queue.front();
+    input.queue.pop_front();
+  }
+  return input.frame_keys;
+}
+
+void input_handle_key_detection(InputState& input, ZEngine::InputManager* inputManager) {
+  uint16_t keys = 0;
 
   // Map the keyboard to the GBA buttons.
   MAP_KEY_TO_GBA_BUTTON(ZEngine::BUTTON_KEY_A,     A)
@@ -37,6 +52,5 @@ void input_handle_key_detection(CPU& cpu, ZEngine::InputManager* inputManager) {
   MAP_KEY_TO_GBA_BUTTON(ZEngine::BUTTON_KEY_UP,    UP)
   MAP_KEY_TO_GBA_BUTTON(ZEngine::BUTTON_KEY_DOWN,  DOWN)
 
-  // Write the new key status.
-  ram_write_half_word_to_io_registers_fast<REG_KEY_STATUS>(cpu.ram, key_status & 0x3FF);
+  input_push_keys(input, keys);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <deque>
+#include <mutex>
 #include "cpu.h"
 
 namespace ZEngine
@@ -7,4 +9,26 @@ namespace ZEngine
   class InputManager;
 }
 
-void input_handle_key_detection(CPU& cpu, ZEngine::InputManager* inputManager);
+// Changes beyond this are dropped oldest first, so input never lags more than this many frames.
+static constexpr size_t INPUT_QUEUE_CAPACITY = 8;
+
+// Keys held on the keyboard, pressed keys set as for gba_set_keys.
+// The UI thread queues every change and the emulation thread takes one per frame as it starts, never mid frame,
+// so a press shorter than a frame still reaches the game and what each frame sees doesn't depend on thread timing.
+struct InputState {
+  std::mutex mutex;
+  std::deque<uint16_t> queue;
+
+  // Last keys queued, only changes are queued.
+  uint16_t queued_keys = 0;
+
+  // Keys of the current frame, kept while the queue is empty. Emulation thread only.
+  uint16_t frame_keys = 0;
+};
+
+void input_push_keys(InputState& input, uint16_t keys);
+
+// The keys for the frame that is starting.
+uint16_t input_next_frame_keys(InputState& input);
+
+void input_handle_key_detection(InputState& input, ZEngine::InputManager* inputManager);
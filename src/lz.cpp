@@ -0,0 +1,135 @@
+#include "lz.h"
+#include <cstring>
+
+static constexpr uint32_t LZ_MIN_MATCH = 4;
+static constexpr uint32_t LZ_MAX_OFFSET = 0xFFFF;
+static constexpr uint32_t LZ_HASH_BITS = 14;
+static constexpr uint32_t LZ_NO_POSITION = UINT32_MAX;
+
+// The last bytes are always stored as literals, so the match search never reads past the input.
+static constexpr uint32_t LZ_END_LITERALS = 8;
+
+// Lengths of 15 or more continue in extra bytes after the token.
+static constexpr uint32_t LZ_TOKEN_LENGTH_MAX = 15;
+
+inline uint32_t lz_read_u32(uint8_t const* src) {
+  uint32_t value;
+  memcpy(&value, src, sizeof(value));
+  return value;
+}
+
+inline uint32_t lz_hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+inline void lz_put_length(std::vector<uint8_t>& dst, size_t length) {
+  length -= LZ_TOKEN_LENGTH_MAX;
+  while (length >= 255) {
+    dst.push_back(255);
+    length -= 255;
+  }
+  dst.push_back((uint8_t)length);
+}
+
+inline bool lz_get_length(uint8_t const* src, size_t size, size_t& in, size_t& length) {
+  uint8_t byte;
+  do {
+    if (in >= size) return false;
+    byte = src[in++];
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// A match length of 0 marks the last sequence, which only has literals.
+inline void lz_put_sequence(std::vector<uint8_t>& dst, uint8_t const* literals, size_t literal_count, size_t match_length, uint32_t offset) {
+  size_t match_code = match_length > 0 ? match_length - LZ_MIN_MATCH : 0;
+  uint8_t token = (uint8_t)(
+    (literal_count < LZ_TOKEN_LENGTH_MAX ? literal_count : LZ_TOKEN_LENGTH_MAX) << 4 |
+    (match_code < LZ_TOKEN_LENGTH_MAX ? match_code : LZ_TOKEN_LENGTH_MAX)
+  );
+  dst.push_back(token);
+  if (literal_count >= LZ_TOKEN_LENGTH_MAX) lz_put_length(dst, literal_count);
+  dst.insert(dst.end(), literals, literals + literal_count);
+
+  if (match_length == 0) return;
+  dst.push_back(offset & 0xFF);
+  dst.push_back(offset >> 8);
+  if (match_code >= LZ_TOKEN_LENGTH_MAX) lz_put_length(dst, match_code);
+}
+
+void lz_compress(uint8_t const* src, size_t size, std::vector<uint8_t>& dst) {
+  std::vector<uint32_t> table(1 << LZ_HASH_BITS, LZ_NO_POSITION);
+
+  size_t anchor = 0;
+  size_t position = 0;
+  size_t limit = size > LZ_END_LITERALS ? size - LZ_END_LITERALS : 0;
+  while (position < limit) {
+    uint32_t sequence = lz_read_u32(src + position);
+    uint32_t& slot = table[lz_hash(sequence)];
+    uint32_t candidate = slot;
+    slot = (uint32_t)position;
+
+    if (
+      candidate == LZ_NO_POSITION ||
+      position - candidate > LZ_MAX_OFFSET ||
+      lz_read_u32(src + candidate) != sequence
+    ) {
+      // Step faster through data that keeps failing to match, incompressible input stays cheap.
+      position += 1 + ((position - anchor) >> 6);
+      continue;
+    }
+
+    size_t match_length = LZ_MIN_MATCH;
+    while (position + match_length < limit && src[candidate + match_length] == src[position + match_length]) {
+      match_length++;
+    }
+
+    lz_put_sequence(dst, src + anchor, position - anchor, match_length, (uint32_t)(position - candidate));
+    position += match_length;
+    anchor = position;
+  }
+
+  lz_put_sequence(dst, src + anchor, size - anchor, 0, 0);
+}
+
+bool lz_decompress(uint8_t const* src, size_t size, uint8_t* dst, size_t dst_size) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < size) {
+    uint8_t token = src[in++];
+
+    size_t literal_count = token >> 4;
+    if (literal_count == LZ_TOKEN_LENGTH_MAX && !lz_get_length(src, size, in, literal_count)) return false;
+    if (literal_count > size - in || literal_count > dst_size - out) return false;
+    memcpy(dst + out, src + in, literal_count);
+    in += literal_count;
+    out += literal_count;
+
+    // The last sequence ends with its literals.
+    if (in == size) break;
+
+    if (size - in < 2) return false;
+    size_t offset = src[in] | (src[in + 1] << 8);
+    in += 2;
+    if (offset == 0 || offset > out) return false;
+
+    size_t match_length = token & 0xF;
+    if (match_length == LZ_TOKEN_LENGTH_MAX && !lz_get_length(src, size, in, match_length)) return false;
+    match_length += LZ_MIN_MATCH;
+    if (match_length > dst_size - out) return false;
+
+    // Matches may overlap their own output (runs), so those are copied a byte at a time.
+    uint8_t const* match = dst + out - offset;
+    if (offset >= match_length) {
+      memcpy(dst + out, match, match_length);
+    } else {
+      for (size_t i = 0; i < match_length; i++) {
+        dst[out + i] = match[i];
+      }
+    }
+    out += match_length;
+  }
+
+  return out == dst_size;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Byte oriented LZ77 codec in the style of an LZ4 block: fast to compress, faster to decompress.
+// Sequences are a token (literal count, match length), the literals, then a 16 bit match offset.
+
+// Appends the compressed form of `src` to `dst`.
+void lz_compress(uint8_t const* src, size_t size, std::vector<uint8_t>& dst);
+
+// Decompresses into exactly `dst_size` bytes. Returns false if the input is malformed or does not fill `dst`.
+bool lz_decompress(uint8_t const* src, size_t size, uint8_t* dst, size_t dst_size);
@@ -107,6 +107,39 @@ static constexpr uint32_t REG_WINDOW_OUTSIDE = 0x400004A; // WINOUT - Inside of
 // Mosaic Size Register
 static constexpr uint32_t REG_MOSAIC_SIZE = 0x400004C; // MOSAIC - Mosaic Size
 
+// =====================
+// Sound Registers
+// =====================
+
+// Channel 1 (Tone & Sweep)
+static constexpr uint32_t REG_SOUND1_SWEEP = 0x4000060;         // SOUND1CNT_L - Channel 1 Sweep
+static constexpr uint32_t REG_SOUND1_DUTY_LENGTH = 0x4000062;   // SOUND1CNT_H - Channel 1 Duty/Length/Envelope
+static constexpr uint32_t REG_SOUND1_FREQUENCY = 0x4000064;     // SOUND1CNT_X - Channel 1 Frequency/Control
+
+// Channel 2 (Tone)
+static constexpr uint32_t REG_SOUND2_DUTY_LENGTH = 0x4000068;   // SOUND2CNT_L - Channel 2 Duty/Length/Envelope
+static constexpr uint32_t REG_SOUND2_FREQUENCY = 0x400006C;     // SOUND2CNT_H - Channel 2 Frequency/Control
+
+// Channel 3 (Wave Output)
+static constexpr uint32_t REG_SOUND3_SELECT = 0x4000070;        // SOUND3CNT_L - Channel 3 Stop/Wave RAM Select
+static constexpr uint32_t REG_SOUND3_LENGTH_VOLUME = 0x4000072; // SOUND3CNT_H - Channel 3 Length/Volume
+static constexpr uint32_t REG_SOUND3_FREQUENCY = 0x4000074;     // SOUND3CNT_X - Channel 3 Frequency/Control
+static constexpr uint32_t REG_WAVE_RAM = 0x4000090;             // WAVE_RAM - Channel 3 Wave Pattern RAM (2 banks)
+
+// Channel 4 (Noise)
+static constexpr uint32_t REG_SOUND4_LENGTH_ENVELOPE = 0x4000078; // SOUND4CNT_L - Channel 4 Length/Envelope
+static constexpr uint32_t REG_SOUND4_FREQUENCY = 0x400007C;       // SOUND4CNT_H - Channel 4 Frequency/Control
+
+// Sound Control Registers
+static constexpr uint32_t REG_SOUND_CONTROL_L = 0x4000080; // SOUNDCNT_L - PSG Volume/Enable
+static constexpr uint32_t REG_SOUND_CONTROL_H = 0x4000082; // SOUNDCNT_H - DMA Sound Control/Mixing
+static constexpr uint32_t REG_SOUND_CONTROL_X = 0x4000084; // SOUNDCNT_X - Sound On/Off
+static constexpr uint32_t REG_SOUND_BIAS = 0x4000088;      // SOUNDBIAS - Sound PWM Control
+
+// DirectSound FIFOs
+static constexpr uint32_t REG_FIFO_A = 0x40000A0; // FIFO_A - Sound A FIFO
+static constexpr uint32_t REG_FIFO_B = 0x40000A4; // FIFO_B - Sound B FIFO
+
 // =====================
 // Direct Memory Access (DMA) Registers
 // =====================
@@ -162,6 +195,11 @@ static constexpr uint32_t REG_TIMER3_CONTROL = 0x400010E;        // TM3CNT_H - T
 static constexpr uint32_t REG_KEY_STATUS = 0x4000130;            // KEYINPUT - Key Status
 static constexpr uint32_t REG_KEY_INTERRUPT_CONTROL = 0x4000132; // KEYCNT - Key Interrupt Control
 
+// KEYCNT bits 0-9 select keys in REG_KEY_STATUS order.
+static constexpr uint16_t REG_KEY_INTERRUPT_CONTROL_KEYS = 0x3FF;
+static constexpr uint16_t REG_KEY_INTERRUPT_CONTROL_ENABLE = 1 << 14;
+static constexpr uint16_t REG_KEY_INTERRUPT_CONTROL_ALL_KEYS = 1 << 15; // Set: all selected keys, clear: any of them
+
 // =====================
 // Interrupt Registers
 // =====================
@@ -171,3 +209,8 @@ static constexpr uint32_t REG_INTERRUPT_ENABLE = 0x4000200;          // IE - Int
 static constexpr uint32_t REG_INTERRUPT_REQUEST_FLAGS = 0x4000202;   // IF - Interrupt Request Flags / IRQ Acknowledge
 static constexpr uint32_t REG_WAIT_STATE_CONTROL = 0x4000204;        // WAITCNT - Game Pak Waitstate Control
 static constexpr uint32_t REG_INTERRUPT_MASTER_ENABLE = 0x4000208;   // IME - Interrupt Master Enable Register
+static constexpr uint32_t REG_POST_BOOT_FLAG = 0x4000300;            // POSTFLG - Undocumented - Post Boot Flag
+static constexpr uint32_t REG_HALT_CONTROL = 0x4000301;              // HALTCNT - Power Down Control
+
+// Bit 12 of IE and IF.
+static constexpr uint16_t INTERRUPT_KEYPAD = 1 << 12;
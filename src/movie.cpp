@@ -0,0 +1,192 @@
+#include "movie.h"
+#include "state_io.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+
+static constexpr char MOVIE_MAGIC[8] = {'G', 'B', 'A', 'M', 'O', 'V', 'I', 'E'};
+
+struct MovieHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t frame_count;
+  uint64_t rom_hash;
+  uint32_t state_size;
+  uint32_t run_count;
+};
+
+Movie* movie_create(MovieMode mode) {
+  Movie* movie = new Movie();
+  movie->mode = mode;
+  return movie;
+}
+
+void movie_destroy(Movie* movie) {
+  delete movie;
+}
+
+void movie_start(Movie& movie, GBA& gba) {
+  if (movie.mode == MOVIE_RECORDING) {
+    movie.rom_hash = movie_hash_rom(gba.cpu.ram);
+    state_serialize(gba, movie.start_state, true);
+    movie.frame_keys.clear();
+  } else {
+    if (movie_hash_rom(gba.cpu.ram) != movie.rom_hash) {
+      throw std::runtime_error("Error: The movie was recorded with a different ROM.");
+    }
+    state_deserialize(gba, movie.start_state.data(), movie.start_state.size());
+  }
+  movie.frame = 0;
+}
+
+uint16_t movie_frame_keys(Movie& movie, uint16_t keys) {
+  if (movie.mode == MOVIE_RECORDING) {
+    movie.frame_keys.push_back(keys);
+    movie.frame++;
+    return keys;
+  }
+
+  if (movie_finished(movie)) return keys;
+  return movie.frame_keys[movie.frame++];
+}
+
+bool movie_finished(Movie const& movie) {
+  return movie.mode == MOVIE_PLAYING && movie.frame >= movie.frame_keys.size();
+}
+
+uint64_t movie_hash_rom(RAM const& ram) {
+  // FNV-1a.
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (uint32_t i = 0; i < ram.game_pak_rom_size; i++) {
+    hash = (hash ^ ram.game_pak_rom[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+inline void movie_put_varint(std::vector<uint8_t>& out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+inline bool movie_get_varint(uint8_t const* data, size_t size, size_t& offset, uint32_t& value) {
+  value = 0;
+  for (uint32_t shift = 0; shift < 32; shift += 7) {
+    if (offset >= size) return false;
+    uint8_t byte = data[offset++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+void movie_serialize(Movie const& movie, std::vector<uint8_t>& out) {
+  // Keys are held for many frames at a time, so they are stored as (keys, frame count) runs.
+  std::vector<uint8_t> runs;
+  uint32_t run_count = 0;
+  for (size_t i = 0; i < movie.frame_keys.size();) {
+    size_t end = i + 1;
+    while (end < movie.frame_keys.size() && movie.frame_keys[end] == movie.frame_keys[i]) {
+      end++;
+    }
+    runs.push_back(movie.frame_keys[i] & 0xFF);
+    runs.push_back(movie.frame_keys[i] >> 8);
+    movie_put_varint(runs, (uint32_t)(end - i));
+    run_count++;
+    i = end;
+  }
+
+  MovieHeader header;
+  memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+  header.version = MOVIE_VERSION;
+  header.frame_count = (uint32_t)movie.frame_keys.size();
+  header.rom_hash = movie.rom_hash;
+  header.state_size = (uint32_t)movie.start_state.size();
+  header.run_count = run_count;
+
+  out.resize(sizeof(header));
+  memcpy(out.data(), &header, sizeof(header));
+  out.insert(out.end(), movie.start_state.begin(), movie.start_state.end());
+  out.insert(out.end(), runs.begin(), runs.end());
+}
+
+// A run is its keys followed by a varint frame count.
+inline bool movie_get_run(uint8_t const* data, size_t size, size_t& offset, uint16_t& keys, uint32_t& length) {
+  if (size - offset < 2) return false;
+  keys = data[offset] | data[offset + 1] << 8;
+  offset += 2;
+  return movie_get_varint(data, size, offset, length);
+}
+
+Movie* movie_deserialize(uint8_t const* data, size_t size) {
+  MovieHeader header;
+  if (size < sizeof(header) || memcmp(data, MOVIE_MAGIC, sizeof(MOVIE_MAGIC)) != 0) {
+    throw std::runtime_error("Error: Not a movie.");
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.version > MOVIE_VERSION) {
+    throw std::runtime_error("Error: Movie version " + std::to_string(header.version) + " is newer than this emulator.");
+  }
+  size_t offset = sizeof(header);
+  if (size - offset < header.state_size) {
+    throw std::runtime_error("Error: Movie is truncated.");
+  }
+  size_t state_offset = offset;
+  offset += header.state_size;
+
+  // Check the runs fit in the data and add up to the frame count before allocating the frames.
+  // Every run takes at least 3 bytes.
+  size_t runs_offset = offset;
+  bool valid = header.run_count <= (size - offset) / 3;
+  uint64_t frame_count = 0;
+  for (uint32_t i = 0; valid && i < header.run_count; i++) {
+    uint16_t keys;
+    uint32_t length;
+    valid = movie_get_run(data, size, offset, keys, length);
+    frame_count += length;
+  }
+  if (!valid || frame_count != header.frame_count) {
+    throw std::runtime_error("Error: Movie is corrupted.");
+  }
+
+  std::unique_ptr<Movie> movie(movie_create(MOVIE_PLAYING));
+  movie->rom_hash = header.rom_hash;
+  movie->start_state.assign(data + state_offset, data + state_offset + header.state_size);
+  movie->frame_keys.reserve(header.frame_count);
+  offset = runs_offset;
+  for (uint32_t i = 0; i < header.run_count; i++) {
+    uint16_t keys;
+    uint32_t length;
+    movie_get_run(data, size, offset, keys, length);
+    movie->frame_keys.insert(movie->frame_keys.end(), length, keys);
+  }
+  return movie.release();
+}
+
+void movie_save(Movie const& movie, std::string const& path) {
+  std::vector<uint8_t> data;
+  movie_serialize(movie, data);
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Error: Could not open file " + path);
+  }
+  file.write((char const*)data.data(), data.size());
+  file.close();
+}
+
+Movie* movie_load(std::string const& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Error: Could not open file " + path);
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  file.close();
+
+  return movie_deserialize(data.data(), data.size());
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "gba.h"
+
+static constexpr uint32_t MOVIE_VERSION = 1;
+
+enum MovieMode {
+  MOVIE_RECORDING,
+  MOVIE_PLAYING
+};
+
+// The keys held during every frame of a run, from a saved start state.
+// Keys only change as a frame starts, so playing the movie back from the start state repeats the run exactly.
+// Files are a header with the ROM hash, the compressed start state, and the keys as runs of identical frames.
+struct Movie {
+  MovieMode mode = MOVIE_RECORDING;
+  uint64_t rom_hash = 0;
+  std::vector<uint8_t> start_state;
+
+  // One mask per frame, pressed keys set as for gba_set_keys.
+  std::vector<uint16_t> frame_keys;
+
+  // Next frame to play back.
+  uint32_t frame = 0;
+};
+
+Movie* movie_create(MovieMode mode);
+void movie_destroy(Movie* movie);
+
+// Recording captures the current state as the start state and drops any frames recorded so far.
+// Playback checks the ROM matches the recorded one and restores the start state, or throws.
+void movie_start(Movie& movie, GBA& gba);
+
+// Call as every frame starts, with the keys held by the player. Returns the keys to use for the frame:
+// the recorded ones while playing, otherwise `keys`, which are appended to the movie when recording.
+uint16_t movie_frame_keys(Movie& movie, uint16_t keys);
+
+// Whether playback has gone through every recorded frame, input then passes through.
+bool movie_finished(Movie const& movie);
+
+uint64_t movie_hash_rom(RAM const& ram);
+
+void movie_serialize(Movie const& movie, std::vector<uint8_t>& out);
+
+// The movie is read for playback.
+Movie* movie_deserialize(uint8_t const* data, size_t size);
+
+void movie_save(Movie const& movie, std::string const& path);
+Movie* movie_load(std::string const& path);
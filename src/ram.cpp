@@ -1,8 +1,20 @@
 #include "ram.h"
 #include <fstream>
+#include <filesystem>
 #include <cstring>
+#include <atomic>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-void load_binary(std::string const& path, uint8_t* dest) {
+// Shared by every RAM instance, see RAM::save_memory_version.
+static std::atomic<uint64_t> ram_next_save_memory_version = 1;
+
+// Reads at most `dest_size` bytes of the file, returns the number of bytes read.
+size_t load_binary(std::string const& path, uint8_t* dest, size_t dest_size) {
   std::ifstream bin_in(path, std::ios::binary);
   if (!bin_in.is_open()) {
     throw std::runtime_error("Error: Could not open file " + path);
@@ -10,32 +22,128 @@ void load_binary(std::string const& path, uint8_t* dest) {
 
   // Read binary size.
   bin_in.seekg(0, std::ios::end);
-  size_t bin_size = bin_in.tellg();
+  size_t bin_size = std::min((size_t)bin_in.tellg(), dest_size);
 
-  // Copy binary data to memory.
-  uint8_t* bin_data = new uint8_t[bin_size];
+  // Read binary data straight into memory.
   bin_in.seekg(0, std::ios::beg);
-  bin_in.read((char*)bin_data, bin_size);
+  bin_in.read((char*)dest, bin_size);
+  return bin_size;
+}
+
+// Maps the file read-only, so all instances loading it share the same pages. Returns an empty pointer if it can't be mapped.
+std::shared_ptr<uint8_t[]> map_binary(std::string const& path, size_t max_size, size_t& size) {
+#ifdef _WIN32
+  return nullptr;
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Error: Could not open file " + path);
+  }
+
+  struct stat file_stat;
+  void* memory = MAP_FAILED;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    size = std::min((size_t)file_stat.st_size, max_size);
+    memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+
+  size_t mapped_size = size;
+  return std::shared_ptr<uint8_t[]>((uint8_t*)memory, [mapped_size](uint8_t* memory) {
+    munmap(memory, mapped_size);
+  });
+#endif
+}
+
+uint8_t* ram_allocate_shareable_memory() {
+#ifdef _WIN32
+  uint8_t* memory = new uint8_t[RAM_SHAREABLE_MEMORY_SIZE];
+  memset(memory, 0, RAM_SHAREABLE_MEMORY_SIZE);
+  return memory;
+#else
+  void* memory = mmap(nullptr, RAM_SHAREABLE_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error("Error: Could not allocate memory.");
+  }
+  return (uint8_t*)memory;
+#endif
+}
 
-  // Close binary file.
-  bin_in.close();
+#ifndef _WIN32
+// A file holding a copy of the block, or -1 if one can't be made.
+int ram_create_memory_file(uint8_t const* memory) {
+#ifdef __linux__
+  int fd = memfd_create("gba-memory", MFD_CLOEXEC);
+#else
+  // Unlinked straight away, the file lives on for as long as it is open or mapped.
+  static std::atomic<uint64_t> next_name = 0;
+  std::string name = "/gba-memory-" + std::to_string(getpid()) + "-" + std::to_string(next_name++);
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) {
+    shm_unlink(name.c_str());
+  }
+#endif
+  if (fd < 0) {
+    return -1;
+  }
 
-  // Copy binary data to memory.
-  memcpy(dest, bin_data, bin_size);
+  void* file_memory = MAP_FAILED;
+  if (ftruncate(fd, RAM_SHAREABLE_MEMORY_SIZE) == 0) {
+    file_memory = mmap(nullptr, RAM_SHAREABLE_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (file_memory == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  memcpy(file_memory, memory, RAM_SHAREABLE_MEMORY_SIZE);
+  munmap(file_memory, RAM_SHAREABLE_MEMORY_SIZE);
+  return fd;
+}
 
-  delete [] bin_data;
+// Replaces the block with a private mapping of the file, at the same address.
+bool ram_map_memory_file(RAM& ram, std::shared_ptr<int> const& file) {
+  void* memory = mmap(ram.shareable_memory, RAM_SHAREABLE_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, *file, 0);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  ram.shareable_memory_file = file;
+  ram.shareable_memory_written = false;
+  return true;
+}
+#endif
+
+// Zeroes EWRAM, IWRAM and VRAM. Where memory can be mapped the block is replaced by fresh zero pages,
+// which cost nothing until written, and leaves the file it was mapped from.
+void ram_clear_shareable_memory(RAM& ram) {
+#ifndef _WIN32
+  void* memory = mmap(ram.shareable_memory, RAM_SHAREABLE_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  if (memory != MAP_FAILED) {
+    ram.shareable_memory_file = nullptr;
+    return;
+  }
+#endif
+  memset(ram.shareable_memory, 0, RAM_SHAREABLE_MEMORY_SIZE);
 }
 
 void ram_init(RAM& ram) {
   // Clear-on-write when writing to the interrupt request flags.
-  ram_register_write_hook(ram, REG_INTERRUPT_REQUEST_FLAGS, [](RAM& ram, uint32_t address, uint32_t value) {
+  ram_register_write_hook(ram, REG_INTERRUPT_REQUEST_FLAGS, [](RAM& ram, uint32_t address, uint32_t value, uint32_t) {
     *(uint32_t*)ram_resolve_address(ram, address) &= ~value;
   });
 
-  // Make sure the key status register is read-only.
-  ram_register_write_hook(ram, REG_KEY_STATUS, [](RAM&, uint32_t, uint32_t) {
-    // Do nothing.
-  });
+  // Make sure the key status register is read-only, word writes still reach KEYCNT.
+  for (uint32_t offset = 0; offset < 2; offset++) {
+    ram_register_write_hook(ram, REG_KEY_STATUS + offset, [](RAM& ram, uint32_t, uint32_t value, uint32_t size) {
+      if (size == 4) {
+        ram_write_half_word(ram, REG_KEY_INTERRUPT_CONTROL, (uint16_t)(value >> 16));
+      }
+    });
+  }
 
   // For EEPROM, if the user does a read from 0xd000000, return 0x1 to indicate that the write request is complete.
   // TODO: This needs to be more integrated with the EEPROM module.
@@ -46,16 +154,37 @@ void ram_init(RAM& ram) {
 
   // Initialize the EEPROM with all bits set to 1 (to match MGBA behavior).
   memset(ram.eeprom, 0xFF, 0x2000);
+  ram_mark_save_memory_written(ram);
+
+  // Nothing has consumed video memory yet, so treat all of it as modified.
+  ram_mark_all_video_memory_dirty(ram);
+  ram_mark_all_pages_dirty(ram);
+}
+
+void ram_free(RAM& ram) {
+  delete [] ram.system_rom;
+#ifdef _WIN32
+  delete [] ram.shareable_memory;
+#else
+  munmap(ram.shareable_memory, RAM_SHAREABLE_MEMORY_SIZE);
+#endif
+  ram.shareable_memory_file = nullptr;
+  delete [] ram.io_registers;
+  delete [] ram.palette_ram;
+  delete [] ram.object_attribute_memory;
+  delete [] ram.game_pak_sram;
+  delete [] ram.eeprom;
+  ram.game_pak_rom_storage = nullptr;
 }
 
 void ram_soft_reset(RAM& ram) {
   // TODO: Put the size of each memory region in a constant.
-  memset(ram.external_working_ram, 0, 0x40000);
-  memset(ram.internal_working_ram, 0, 0x8000);
+  ram_clear_shareable_memory(ram);
   memset(ram.io_registers, 0, 0x804);
   memset(ram.palette_ram, 0, 0x400);
-  memset(ram.video_ram, 0, 0x18000);
   memset(ram.object_attribute_memory, 0, 0x400);
+  ram_mark_all_video_memory_dirty(ram);
+  ram_mark_all_pages_dirty(ram);
 
   // TODO: Reset EEPROM memory here, but make it configurable so you can keep save data.
 
@@ -67,16 +196,82 @@ void ram_soft_reset(RAM& ram) {
   ram_write_byte_direct(ram, GAME_PAK_SRAM_START + 1, 0x13);
 }
 
+void ram_set_rom_storage(RAM& ram, std::shared_ptr<uint8_t[]> const& storage, uint32_t size) {
+  ram.game_pak_rom_storage = storage;
+  ram.game_pak_rom = storage.get();
+  ram.game_pak_rom_size = size;
+  ram.memory_map[GAME_PAK_ROM] = ram.game_pak_rom;
+}
+
+// ROM is read a word at a time, so a size that isn't a multiple of 4 is padded with zeros up to one.
+std::shared_ptr<uint8_t[]> ram_allocate_rom_storage(size_t size) {
+  return std::shared_ptr<uint8_t[]>(new uint8_t[(size + 3) & ~(size_t)3]());
+}
+
 void ram_load_rom(RAM& ram, std::string const& path) {
   if (ram.load_rom_into_bios) {
     ram_load_bios(ram, path);
     return;
   }
-  load_binary(path, ram.game_pak_rom);
+
+  size_t size = 0;
+  std::shared_ptr<uint8_t[]> storage = map_binary(path, 0x2000000, size);
+  if (storage != nullptr) {
+    ram_set_rom_storage(ram, storage, (uint32_t)size);
+    return;
+  }
+
+  // Files that can't be mapped are read into memory of their own.
+  std::error_code error;
+  size = std::min((size_t)std::filesystem::file_size(path, error), (size_t)0x2000000);
+  storage = ram_allocate_rom_storage(error ? 0 : size);
+  size = load_binary(path, storage.get(), error ? 0 : size);
+  ram_set_rom_storage(ram, storage, (uint32_t)size);
+}
+
+void ram_share_rom(RAM& ram, RAM const& source) {
+  ram_set_rom_storage(ram, source.game_pak_rom_storage, source.game_pak_rom_size);
+}
+
+void ram_share_memory(RAM& ram, RAM& source) {
+#ifndef _WIN32
+  if (source.shareable_memory_file == nullptr || source.shareable_memory_written) {
+    int fd = ram_create_memory_file(source.shareable_memory);
+    if (fd >= 0) {
+      std::shared_ptr<int> file(new int(fd), [](int* fd) {
+        close(*fd);
+        delete fd;
+      });
+      ram_map_memory_file(source, file);
+    }
+  }
+  if (source.shareable_memory_file != nullptr && !source.shareable_memory_written &&
+      ram_map_memory_file(ram, source.shareable_memory_file)) {
+    return;
+  }
+#endif
+  memcpy(ram.shareable_memory, source.shareable_memory, RAM_SHAREABLE_MEMORY_SIZE);
+  ram.shareable_memory_written = true;
 }
 
 void ram_load_bios(RAM& ram, std::string const& path) {
-  load_binary(path, ram.system_rom);
+  load_binary(path, ram.system_rom, 0x4000);
+}
+
+void ram_load_rom_from_memory(RAM& ram, uint8_t const* data, size_t size) {
+  if (ram.load_rom_into_bios) {
+    ram_load_bios_from_memory(ram, data, size);
+    return;
+  }
+
+  size = std::min(size, (size_t)0x2000000);
+  std::shared_ptr<uint8_t[]> storage = ram_allocate_rom_storage(size);
+  memcpy(storage.get(), data, size);
+  ram_set_rom_storage(ram, storage, (uint32_t)size);
+}
+
+void ram_load_bios_from_memory(RAM& ram, uint8_t const* data, size_t size) {
+  memcpy(ram.system_rom, data, std::min(size, (size_t)0x4000));
 }
 
 void ram_register_read_hook(RAM& ram, uint32_t address, std::function<uint32_t(RAM&, uint32_t)> const& hook) {
@@ -84,7 +279,22 @@ void ram_register_read_hook(RAM& ram, uint32_t address, std::function<uint32_t(R
   ram.memory_read_hook_addresses.push_back(address);
 }
 
-void ram_register_write_hook(RAM& ram, uint32_t address, std::function<void(RAM&, uint32_t, uint32_t)> const& hook) {
+void ram_register_write_hook(RAM& ram, uint32_t address, std::function<void(RAM&, uint32_t, uint32_t, uint32_t)> const& hook) {
   ram.memory_write_hooks[address] = hook;
   ram.memory_write_hook_addresses.push_back(address);
 }
+
+void ram_mark_all_video_memory_dirty(RAM& ram) {
+  memset(ram.vram_dirty_blocks, 0xFF, sizeof(ram.vram_dirty_blocks));
+  ram.palette_dirty_blocks = 0xFFFFFFFF;
+  ram.oam_dirty_blocks = 0xFFFFFFFF;
+}
+
+void ram_mark_all_pages_dirty(RAM& ram) {
+  memset(ram.dirty_pages, 0xFF, sizeof(ram.dirty_pages));
+  ram.shareable_memory_written = true;
+}
+
+void ram_mark_save_memory_written(RAM& ram) {
+  ram.save_memory_version = ram_next_save_memory_version.fetch_add(1, std::memory_order_relaxed);
+}
@@ -9,12 +9,51 @@
 #include <vector>
 #include <algorithm>
 #include <functional>
+#include <memory>
+#include <cstring>
 #include <unordered_map>
 #include "memory_map.h"
 
 #define MEMORY_MASK 0x0F000000
 #define MEMORY_NOT_MASK 0x00FFFFFF
 
+static constexpr uint32_t VRAM_SIZE = 0x18000;
+static constexpr uint32_t PALETTE_RAM_SIZE = 0x400;
+static constexpr uint32_t OAM_SIZE = 0x400;
+
+// VRAM writes are tracked in 32 byte blocks (the size of a 4bpp tile), so caches of decoded
+// VRAM data only need to invalidate the blocks that actually changed.
+static constexpr uint32_t VRAM_DIRTY_BLOCK_SHIFT = 5;
+static constexpr uint32_t VRAM_DIRTY_BLOCK_SIZE = 1 << VRAM_DIRTY_BLOCK_SHIFT;
+static constexpr uint32_t VRAM_DIRTY_BLOCK_COUNT = VRAM_SIZE >> VRAM_DIRTY_BLOCK_SHIFT;
+static constexpr uint32_t VRAM_DIRTY_BITMAP_WORDS = VRAM_DIRTY_BLOCK_COUNT / 64;
+
+// Palette RAM and OAM use the same block size, 32 blocks each.
+static_assert((PALETTE_RAM_SIZE >> VRAM_DIRTY_BLOCK_SHIFT) == 32 && (OAM_SIZE >> VRAM_DIRTY_BLOCK_SHIFT) == 32);
+
+static constexpr uint32_t EWRAM_SIZE = 0x40000;
+static constexpr uint32_t IWRAM_SIZE = 0x8000;
+
+// Writable memory is also tracked in 1kb pages, numbered across the regions in the order below.
+// Used by snapshots that only store the pages written since a base snapshot.
+static constexpr uint32_t RAM_PAGE_SHIFT = 10;
+static constexpr uint32_t RAM_PAGE_SIZE = 1 << RAM_PAGE_SHIFT;
+static constexpr uint32_t RAM_PAGE_EWRAM = 0;
+static constexpr uint32_t RAM_PAGE_IWRAM = RAM_PAGE_EWRAM + (EWRAM_SIZE >> RAM_PAGE_SHIFT);
+static constexpr uint32_t RAM_PAGE_PALETTE = RAM_PAGE_IWRAM + (IWRAM_SIZE >> RAM_PAGE_SHIFT);
+static constexpr uint32_t RAM_PAGE_VRAM = RAM_PAGE_PALETTE + (PALETTE_RAM_SIZE >> RAM_PAGE_SHIFT);
+static constexpr uint32_t RAM_PAGE_OAM = RAM_PAGE_VRAM + (VRAM_SIZE >> RAM_PAGE_SHIFT);
+static constexpr uint32_t RAM_PAGE_COUNT = RAM_PAGE_OAM + (OAM_SIZE >> RAM_PAGE_SHIFT);
+static constexpr uint32_t RAM_DIRTY_PAGE_WORDS = (RAM_PAGE_COUNT + 63) / 64;
+
+// EWRAM, IWRAM and VRAM are one block of memory, in that order, which forks share copy-on-write (see ram_share_memory).
+static constexpr uint32_t RAM_SHAREABLE_MEMORY_SIZE = EWRAM_SIZE + IWRAM_SIZE + VRAM_SIZE;
+
+// Zeroed, page aligned memory for the block.
+uint8_t* ram_allocate_shareable_memory();
+
+struct GBA;
+
 enum MemoryLocation {
   BIOS,
   WORKING_RAM_ON_BOARD,
@@ -31,13 +70,23 @@ struct RAM {
   // 0x00000000 - 0x00003FFF
   uint8_t* system_rom = new uint8_t[0x4000];
 
+  // EWRAM, IWRAM and VRAM, see RAM_SHAREABLE_MEMORY_SIZE.
+  uint8_t* shareable_memory = ram_allocate_shareable_memory();
+
+  // The file the block is a private mapping of since the instance was forked or forked from, shared with the forks.
+  // Stays null where memory can't be mapped, forks then copy the block.
+  std::shared_ptr<int> shareable_memory_file;
+
+  // Set by every write to the block, which may then differ from the file.
+  bool shareable_memory_written = true;
+
   // EWRAM - External Working RAM (256kb) - Mirrored
   // 0x02000000 - 0x0203FFFF
-  uint8_t* external_working_ram = new uint8_t[0x40000];
+  uint8_t* external_working_ram = shareable_memory;
 
   // IWRAM - Internal Working RAM (32kb) - Mirrored
   // 0x03000000 - 0x03007FFF
-  uint8_t* internal_working_ram = new uint8_t[0x8000];
+  uint8_t* internal_working_ram = shareable_memory + EWRAM_SIZE;
 
   // I/O Registers
   // 0x04000000 - 0x040003FE (but seems to be used beyond 0x04000400)
@@ -49,7 +98,15 @@ struct RAM {
 
   // VRAM - Video RAM (96kb) - TODO: Mirror depending on mode
   // 0x06000000 - 0x06017FFF
-  uint8_t* video_ram = new uint8_t[0x18000];
+  uint8_t* video_ram = shareable_memory + EWRAM_SIZE + IWRAM_SIZE;
+
+  // One bit per VRAM block, set on every write to VRAM (CPU and DMA).
+  // Cleared by the consumer of the bitmap (the GPU tile cache, or the render pipeline).
+  uint64_t vram_dirty_blocks[VRAM_DIRTY_BITMAP_WORDS];
+
+  // Same for palette RAM and OAM, only consumed by the render pipeline.
+  uint32_t palette_dirty_blocks = 0;
+  uint32_t oam_dirty_blocks = 0;
 
   // OAM - Object Attribute Memory (1kb) - Mirror
   // 0x07000000 - 0x070003FF
@@ -57,7 +114,21 @@ struct RAM {
 
   // Game Pak ROM/FlashROM (max 32MB) - Mirrored (0x08000000, 0x0A000000, 0x0C000000)
   // 0x08000000 - 0x09FFFFFF
-  uint8_t* game_pak_rom = new uint8_t[0x2000000];
+  // Loaded ROMs are mapped read-only from the file, so every instance of a ROM shares the same memory,
+  // and forked instances share the mapping itself. Writes to the ROM are dropped, as on hardware.
+  // Reads past the end of the ROM are open bus.
+  std::shared_ptr<uint8_t[]> game_pak_rom_storage;
+  uint8_t* game_pak_rom = nullptr;
+  uint32_t game_pak_rom_size = 0;
+
+  // Value of the last open bus read, read back through ram_resolve_address.
+  uint8_t game_pak_open_bus[8];
+
+  // Where the CPU prefetches its next opcode from (PC + 8 in ARM state, PC + 4 in THUMB state), kept up to date
+  // by the CPU on every fetch. Unmapped memory reads back the opcode found there.
+  uint32_t prefetch_address = 0;
+  bool prefetch_thumb = false;
+  uint8_t cpu_open_bus[8];
 
   // Game Pak SRAM (max 128kb with two 64kb banks)
   // 0x0E000000 - 0x0E00FFFF
@@ -67,9 +138,20 @@ struct RAM {
   // 0x0D000000 - 0x0D001FFF
   uint8_t* eeprom = new uint8_t[0x2000];
 
+  // One bit per page written since the snapshot `dirty_pages_base` (0 when not relative to any snapshot).
+  uint64_t dirty_pages[RAM_DIRTY_PAGE_WORDS];
+  uint64_t dirty_pages_base = 0;
+
+  // Replaced on every write to SRAM or EEPROM. Versions are unique across all RAM instances,
+  // so two equal versions always mean equal save memory and copies of it can be skipped.
+  uint64_t save_memory_version = 0;
+
+  // The instance this RAM belongs to. Hooks hold no pointers of their own, they reach the other subsystems through it.
+  GBA* gba = nullptr;
+
   std::vector<uint32_t> memory_write_hook_addresses;
   std::vector<uint32_t> memory_read_hook_addresses;
-  std::unordered_map<uint32_t, std::function<void(RAM&, uint32_t, uint32_t)>> memory_write_hooks;
+  std::unordered_map<uint32_t, std::function<void(RAM&, uint32_t, uint32_t, uint32_t)>> memory_write_hooks;
   std::unordered_map<uint32_t, std::function<uint32_t(RAM&, uint32_t)>> memory_read_hooks;
 
   // NOTE: Order is important here, as it is used to resolve memory locations.
@@ -99,11 +181,72 @@ struct RAM {
 };
 
 void ram_init(RAM& ram);
+
+// Free the memory regions, the RAM can't be used afterwards.
+void ram_free(RAM& ram);
 void ram_soft_reset(RAM& ram);
 void ram_load_rom(RAM& ram, std::string const& path);
 void ram_load_bios(RAM& ram, std::string const& path);
+
+// Copies of images already in memory, the caller's buffer can be freed straight after.
+void ram_load_rom_from_memory(RAM& ram, uint8_t const* data, size_t size);
+void ram_load_bios_from_memory(RAM& ram, uint8_t const* data, size_t size);
 void ram_register_read_hook(RAM& ram, uint32_t address, std::function<uint32_t(RAM&, uint32_t)> const& hook);
-void ram_register_write_hook(RAM& ram, uint32_t address, std::function<void(RAM&, uint32_t, uint32_t)> const& hook);
+// Write hooks get the address, the value and the size of the access in bytes, and do the store themselves.
+void ram_register_write_hook(RAM& ram, uint32_t address, std::function<void(RAM&, uint32_t, uint32_t, uint32_t)> const& hook);
+void ram_mark_all_video_memory_dirty(RAM& ram);
+void ram_mark_save_memory_written(RAM& ram);
+
+// Every page counts as written, for code that replaces memory without going through the write functions.
+void ram_mark_all_pages_dirty(RAM& ram);
+
+// Reads past the end of the Game Pak ROM return the low 16 bits of the halfword address.
+inline uint8_t* ram_resolve_open_bus(RAM& ram, uint32_t address) {
+  uint32_t aligned = address & ~3u;
+  for (uint32_t i = 0; i < 4; i++) {
+    uint16_t value = (uint16_t)((aligned + i * 2) >> 1);
+    memcpy(&ram.game_pak_open_bus[i * 2], &value, sizeof(value));
+  }
+  return &ram.game_pak_open_bus[address & 3];
+}
+
+inline uint8_t* ram_resolve_address(RAM& ram, uint32_t address);
+
+// Unmapped memory between the BIOS and EWRAM reads back the last prefetched opcode,
+// a THUMB opcode appearing in both halves of the word.
+inline uint8_t* ram_resolve_cpu_open_bus(RAM& ram, uint32_t address) {
+  uint32_t value = 0;
+  uint32_t prefetch_region = ram.prefetch_address >> 24;
+  if (prefetch_region > 1 || ram.prefetch_address < 0x4000) {
+    if (ram.prefetch_thumb) {
+      uint16_t opcode;
+      memcpy(&opcode, ram_resolve_address(ram, ram.prefetch_address & ~1u), sizeof(opcode));
+      value = opcode | (uint32_t)opcode << 16;
+    } else {
+      memcpy(&value, ram_resolve_address(ram, ram.prefetch_address & ~3u), sizeof(value));
+    }
+  }
+  memcpy(&ram.cpu_open_bus[0], &value, sizeof(value));
+  memcpy(&ram.cpu_open_bus[4], &value, sizeof(value));
+  return &ram.cpu_open_bus[address & 3];
+}
+
+// Use the ROM of `source` without copying it.
+void ram_share_rom(RAM& ram, RAM const& source);
+
+// Make EWRAM, IWRAM and VRAM a copy of those of `source` without copying them: both privately map a file holding
+// the memory of `source`, and the kernel copies a page the first time either of them writes it.
+// The file is made on the first fork and reused by later ones until `source` writes the block again.
+// Where memory can't be mapped the block is copied instead.
+void ram_share_memory(RAM& ram, RAM& source);
+
+inline uint8_t* ram_page_memory(RAM& ram, uint32_t page) {
+  if (page < RAM_PAGE_IWRAM) return ram.external_working_ram + ((page - RAM_PAGE_EWRAM) << RAM_PAGE_SHIFT);
+  if (page < RAM_PAGE_PALETTE) return ram.internal_working_ram + ((page - RAM_PAGE_IWRAM) << RAM_PAGE_SHIFT);
+  if (page < RAM_PAGE_VRAM) return ram.palette_ram;
+  if (page < RAM_PAGE_OAM) return ram.video_ram + ((page - RAM_PAGE_VRAM) << RAM_PAGE_SHIFT);
+  return ram.object_attribute_memory;
+}
 
 // swaps a 16-bit value
 static inline uint16_t swap16(uint16_t v)
@@ -166,6 +309,53 @@ inline bool ram_address_has_write_hook(RAM& ram, uint32_t address) {
   return std::find(ram.memory_write_hook_addresses.begin(), ram.memory_write_hook_addresses.end(), address) != ram.memory_write_hook_addresses.end();
 }
 
+inline void ram_mark_page_dirty(RAM& ram, uint32_t page) {
+  ram.dirty_pages[page >> 6] |= 1ULL << (page & 63);
+}
+
+inline void ram_track_write(RAM& ram, uint32_t address) {
+  uint32_t offset = address & MEMORY_NOT_MASK;
+  uint32_t block = offset >> VRAM_DIRTY_BLOCK_SHIFT;
+  switch (address & MEMORY_MASK) {
+    case WORKING_RAM_ON_BOARD_START:
+      ram_mark_page_dirty(ram, RAM_PAGE_EWRAM + ((offset & (EWRAM_SIZE - 1)) >> RAM_PAGE_SHIFT));
+      ram.shareable_memory_written = true;
+      break;
+    case WORKING_RAM_ON_CHIP_START:
+      ram_mark_page_dirty(ram, RAM_PAGE_IWRAM + ((offset & (IWRAM_SIZE - 1)) >> RAM_PAGE_SHIFT));
+      ram.shareable_memory_written = true;
+      break;
+    case PALETTE_RAM_START:
+      // Palette RAM is mirrored every 1kb.
+      ram.palette_dirty_blocks |= 1U << (block & 31);
+      ram_mark_page_dirty(ram, RAM_PAGE_PALETTE);
+      break;
+    case VRAM_START:
+      if (block < VRAM_DIRTY_BLOCK_COUNT) {
+        ram.vram_dirty_blocks[block >> 6] |= 1ULL << (block & 63);
+        ram_mark_page_dirty(ram, RAM_PAGE_VRAM + (offset >> RAM_PAGE_SHIFT));
+        ram.shareable_memory_written = true;
+      }
+      break;
+    case OAM_START:
+      if (block < 32) {
+        ram.oam_dirty_blocks |= 1U << block;
+        ram_mark_page_dirty(ram, RAM_PAGE_OAM);
+      }
+      break;
+    case GAME_PAK_SRAM_START:
+      ram_mark_save_memory_written(ram);
+      break;
+  }
+}
+
+// The Game Pak ROM and its wait state mirrors (0x08000000 - 0x0DFFFFFF).
+// Stores there are dropped, including the GPIO port of RTC carts at 0x080000C4 - 0x080000C9, which isn't emulated.
+inline bool ram_address_is_game_pak_rom(uint32_t address) {
+  uint32_t region = address >> 24;
+  return region >= (GAME_PAK_ROM_START >> 24) && region < (GAME_PAK_SRAM_START >> 24);
+}
+
 inline uint8_t* ram_resolve_address(RAM& ram, uint32_t address) {
   uint32_t memory_loc = address & MEMORY_MASK;
   uint32_t offset = address & MEMORY_NOT_MASK;
@@ -179,7 +369,10 @@ inline uint8_t* ram_resolve_address(RAM& ram, uint32_t address) {
   // This is a temporary fix, we need to find a better way to handle ROM reads by the loaded program.
   uint32_t region = memory_loc >> 24;
 
-  if (region <= 7) {
+  if (region <= 1 && address >= 0x4000) {
+    // Past the BIOS, nothing is mapped until EWRAM.
+    return ram_resolve_cpu_open_bus(ram, address);
+  } else if (region <= 7) {
     if (region > 0) region--;
     memory = ram.memory_map[region];
     mirror_interval = ram.mirror_intervals[region];
@@ -191,17 +384,12 @@ inline uint8_t* ram_resolve_address(RAM& ram, uint32_t address) {
     memory_loc == GAME_PAK_ROM_WS2_START ||
     memory_loc == GAME_PAK_ROM_WS2_START + 0x1000000
   ) {
-    memory = ram.game_pak_rom;
-    mirror_interval = 0x2000000;
-  } 
-  else if (
-    memory_loc == GAME_PAK_ROM_START + 0x1000000 ||
-    memory_loc == GAME_PAK_ROM_WS1_START + 0x1000000 ||
-    memory_loc == GAME_PAK_ROM_WS2_START + 0x1000000
-  ) {
-    memory = ram.game_pak_rom;
-    mirror_interval = 0x2000000;
-    offset += 0x1000000;
+    // Each wait state region covers the full 32MB of the ROM.
+    offset = address & 0x1FFFFFF;
+    if (offset >= ram.game_pak_rom_size) {
+      return ram_resolve_open_bus(ram, address);
+    }
+    return &ram.game_pak_rom[offset];
   } else if (memory_loc == GAME_PAK_SRAM_START) {
     memory = ram.game_pak_sram;
   } else {
@@ -291,9 +479,11 @@ inline void ram_write_byte(RAM& ram, uint32_t address, uint8_t value) {
     return;
   }
   if (ram_address_has_write_hook(ram, address)) {
-    ram.memory_write_hooks[address](ram, address, (uint32_t)value);
+    ram.memory_write_hooks[address](ram, address, (uint32_t)value, 1);
     return;
   }
+  if (ram_address_is_game_pak_rom(address)) return;
+  ram_track_write(ram, address);
   *ram_resolve_address(ram, address) = value;
 }
 
@@ -303,6 +493,8 @@ inline void ram_write_byte_direct(RAM& ram, uint32_t address, uint8_t value) {
     // std::cout << "Warning: Attempted to write to read-only memory, skipped write op" << std::endl;
     return;
   }
+  if (ram_address_is_game_pak_rom(address)) return;
+  ram_track_write(ram, address);
   *ram_resolve_address(ram, address) = value;
 }
 
@@ -312,9 +504,11 @@ inline void ram_write_half_word(RAM& ram, uint32_t address, uint16_t value) {
     return;
   }
   if (ram_address_has_write_hook(ram, address)) {
-    ram.memory_write_hooks[address](ram, address, (uint32_t)value);
+    ram.memory_write_hooks[address](ram, address, (uint32_t)value, 2);
     return;
   }
+  if (ram_address_is_game_pak_rom(address)) return;
+  ram_track_write(ram, address);
   *(uint16_t*)ram_resolve_address(ram, address) = value;
 }
 
@@ -324,6 +518,8 @@ inline void ram_write_half_word_direct(RAM& ram, uint32_t address, uint32_t valu
     // std::cout << "Warning: Attempted to write to read-only memory, skipped write op" << std::endl;
     return;
   }
+  if (ram_address_is_game_pak_rom(address)) return;
+  ram_track_write(ram, address);
   *(uint16_t*)ram_resolve_address(ram, address) = value;
 }
 
@@ -333,9 +529,11 @@ inline void ram_write_word(RAM& ram, uint32_t address, uint32_t value) {
     return;
   }
   if (ram_address_has_write_hook(ram, address)) {
-    ram.memory_write_hooks[address](ram, address, value);
+    ram.memory_write_hooks[address](ram, address, value, 4);
     return;
   }
+  if (ram_address_is_game_pak_rom(address)) return;
+  ram_track_write(ram, address);
   *(uint32_t*)ram_resolve_address(ram, address) = value;
 }
 
@@ -344,5 +542,16 @@ inline void ram_write_word_direct(RAM& ram, uint32_t address, uint32_t value) {
   if (ram.enable_rom_write_protection && address <= BIOS_END) {
     // std::cout << "Warning: Attempted to write to read-only memory, skipped write op" << std::endl;
   }
+  if (ram_address_is_game_pak_rom(address)) return;
+  ram_track_write(ram, address);
   *(uint32_t*)ram_resolve_address(ram, address) = value;
 }
+
+// Stores a hooked write with the size it was made with.
+inline void ram_write_direct(RAM& ram, uint32_t address, uint32_t value, uint32_t size) {
+  switch (size) {
+    case 1: ram_write_byte_direct(ram, address, (uint8_t)value); break;
+    case 2: ram_write_half_word_direct(ram, address, (uint16_t)value); break;
+    default: ram_write_word_direct(ram, address, value); break;
+  }
+}
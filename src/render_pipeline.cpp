@@ -0,0 +1,218 @@
+#include "render_pipeline.h"
+#include <cstring>
+
+inline void render_pipeline_push_delta(std::vector<RenderBlockDelta>& deltas, uint32_t address, uint8_t const* data) {
+  RenderBlockDelta& delta = deltas.emplace_back();
+  delta.address = address;
+  memcpy(delta.data, data, VRAM_DIRTY_BLOCK_SIZE);
+}
+
+inline void render_pipeline_collect_small_region(
+  std::vector<RenderBlockDelta>& deltas,
+  uint32_t& dirty_blocks,
+  uint32_t region_start,
+  uint8_t const* region
+) {
+  uint32_t dirty = dirty_blocks;
+  dirty_blocks = 0;
+  while (dirty) {
+    uint32_t block = __builtin_ctz(dirty);
+    uint32_t offset = block << VRAM_DIRTY_BLOCK_SHIFT;
+    render_pipeline_push_delta(deltas, region_start + offset, region + offset);
+    dirty &= dirty - 1;
+  }
+}
+
+inline void render_pipeline_collect_deltas(RAM& ram, std::vector<RenderBlockDelta>& deltas) {
+  render_pipeline_collect_small_region(deltas, ram.palette_dirty_blocks, PALETTE_RAM_START, ram.palette_ram);
+  render_pipeline_collect_small_region(deltas, ram.oam_dirty_blocks, OAM_START, ram.object_attribute_memory);
+
+  for (uint32_t word = 0; word < VRAM_DIRTY_BITMAP_WORDS; word++) {
+    uint64_t dirty = ram.vram_dirty_blocks[word];
+    if (dirty == 0) continue;
+    ram.vram_dirty_blocks[word] = 0;
+
+    while (dirty) {
+      uint32_t block = word * 64 + __builtin_ctzll(dirty);
+      uint32_t offset = block << VRAM_DIRTY_BLOCK_SHIFT;
+      render_pipeline_push_delta(deltas, VRAM_START + offset, ram.video_ram + offset);
+      dirty &= dirty - 1;
+    }
+  }
+}
+
+inline void render_pipeline_apply_delta(RenderShadowMemory& shadow, RenderBlockDelta const& delta) {
+  uint32_t offset = delta.address & MEMORY_NOT_MASK;
+  switch (delta.address & MEMORY_MASK) {
+    case PALETTE_RAM_START:
+      memcpy(shadow.palette_ram + offset, delta.data, VRAM_DIRTY_BLOCK_SIZE);
+      break;
+    case VRAM_START: {
+      memcpy(shadow.video_ram + offset, delta.data, VRAM_DIRTY_BLOCK_SIZE);
+      uint32_t block = offset >> VRAM_DIRTY_BLOCK_SHIFT;
+      shadow.vram_dirty_blocks[block >> 6] |= 1ULL << (block & 63);
+      break;
+    }
+    case OAM_START:
+      memcpy(shadow.object_attribute_memory + offset, delta.data, VRAM_DIRTY_BLOCK_SIZE);
+      break;
+  }
+}
+
+void render_pipeline_render_band(GPURenderPipeline& pipeline, RenderBand& band, RenderFrameJob const& job) {
+  RenderShadowMemory& shadow = *band.shadow;
+  GPU& render_gpu = *band.render_gpu;
+  GPUMemory memory = {
+    shadow.io_registers,
+    shadow.palette_ram,
+    shadow.video_ram,
+    shadow.object_attribute_memory,
+    shadow.vram_dirty_blocks
+  };
+
+  for (RenderLineRecord const& line : job.lines) {
+    // Deltas are replayed for every line, so the shadow copy ends the frame up to date.
+    for (uint32_t i = line.delta_begin; i < line.delta_end; i++) {
+      render_pipeline_apply_delta(shadow, job.deltas[i]);
+    }
+
+    if (line.scanline < band.first_line || line.scanline >= band.end_line) continue;
+
+    memcpy(shadow.io_registers, line.io_registers, GPU_IO_REGISTERS_SIZE);
+    for (int i = 0; i < 2; i++) {
+      render_gpu.affine_ref_x[i] = line.affine_ref_x[i];
+      render_gpu.affine_ref_y[i] = line.affine_ref_y[i];
+    }
+
+    gpu_render_scanline(memory, render_gpu, line.scanline);
+    gpu_write_frame_buffer_line(*pipeline.output_gpu, line.scanline, render_gpu.scanline_buffer);
+  }
+}
+
+void render_pipeline_worker(GPURenderPipeline* pipeline, RenderBand* band) {
+  uint64_t rendered_generation = 0;
+  while (true) {
+    RenderFrameJob* job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(pipeline->mutex);
+      pipeline->job_submitted.wait(lock, [pipeline, rendered_generation] {
+        return pipeline->job_generation != rendered_generation || pipeline->stop;
+      });
+
+      // Finish the last submitted frame before stopping.
+      if (pipeline->job_generation == rendered_generation) return;
+      rendered_generation = pipeline->job_generation;
+      job = pipeline->submitted;
+    }
+
+    render_pipeline_render_band(*pipeline, *band, *job);
+
+    bool job_done = false;
+    {
+      std::lock_guard<std::mutex> lock(pipeline->mutex);
+      job_done = --pipeline->bands_remaining == 0;
+      if (job_done) {
+        pipeline->submitted = nullptr;
+      }
+    }
+    if (job_done) {
+      pipeline->job_completed.notify_all();
+    }
+  }
+}
+
+GPURenderPipeline* render_pipeline_create(RAM& ram, GPU& gpu, uint32_t band_count) {
+  if (band_count == 0) band_count = 1;
+  if (band_count > FRAME_HEIGHT / 2) band_count = FRAME_HEIGHT / 2;
+
+  GPURenderPipeline* pipeline = new GPURenderPipeline();
+  pipeline->output_gpu = &gpu;
+
+  for (uint32_t i = 0; i < band_count; i++) {
+    RenderBand* band = new RenderBand();
+    // Bands start on even lines, so both lines of a pair are rendered in order by the same worker.
+    band->first_line = (i * FRAME_HEIGHT / band_count) & ~1;
+    band->end_line = ((i + 1) * FRAME_HEIGHT / band_count) & ~1;
+
+    // Start from a full copy, from here on only changed blocks are sent.
+    RenderShadowMemory& shadow = *band->shadow;
+    memcpy(shadow.io_registers, ram.io_registers, GPU_IO_REGISTERS_SIZE);
+    memcpy(shadow.palette_ram, ram.palette_ram, PALETTE_RAM_SIZE);
+    memcpy(shadow.video_ram, ram.video_ram, VRAM_SIZE);
+    memcpy(shadow.object_attribute_memory, ram.object_attribute_memory, OAM_SIZE);
+    memset(shadow.vram_dirty_blocks, 0xFF, sizeof(shadow.vram_dirty_blocks));
+
+    // Each band decodes tiles with its own cache when the GPU uses one.
+    if (gpu.tile_cache != nullptr) {
+      band->render_gpu->tile_cache = new TileCache();
+      tile_cache_invalidate_all(*band->render_gpu->tile_cache);
+    }
+
+    pipeline->bands.push_back(band);
+  }
+
+  memset(ram.vram_dirty_blocks, 0, sizeof(ram.vram_dirty_blocks));
+  ram.palette_dirty_blocks = 0;
+  ram.oam_dirty_blocks = 0;
+
+  for (RenderBand* band : pipeline->bands) {
+    band->worker = std::thread(render_pipeline_worker, pipeline, band);
+  }
+  return pipeline;
+}
+
+void render_pipeline_destroy(GPURenderPipeline* pipeline) {
+  {
+    std::lock_guard<std::mutex> lock(pipeline->mutex);
+    pipeline->stop = true;
+  }
+  pipeline->job_submitted.notify_all();
+
+  for (RenderBand* band : pipeline->bands) {
+    band->worker.join();
+    delete band->render_gpu->tile_cache;
+    delete band->render_gpu;
+    delete band->shadow;
+    delete band;
+  }
+  delete pipeline;
+}
+
+void render_pipeline_record_line(RAM& ram, GPU& gpu, GPURenderPipeline& pipeline, uint8_t scanline) {
+  RenderFrameJob& job = *pipeline.recording;
+
+  RenderLineRecord& line = job.lines.emplace_back();
+  line.scanline = scanline;
+  memcpy(line.io_registers, ram.io_registers, GPU_IO_REGISTERS_SIZE);
+  for (int i = 0; i < 2; i++) {
+    line.affine_ref_x[i] = gpu.affine_ref_x[i];
+    line.affine_ref_y[i] = gpu.affine_ref_y[i];
+  }
+
+  line.delta_begin = job.deltas.size();
+  render_pipeline_collect_deltas(ram, job.deltas);
+  line.delta_end = job.deltas.size();
+}
+
+void render_pipeline_submit_frame(GPURenderPipeline& pipeline) {
+  if (pipeline.recording->lines.empty()) return;
+
+  {
+    std::unique_lock<std::mutex> lock(pipeline.mutex);
+    pipeline.job_completed.wait(lock, [&pipeline] { return pipeline.submitted == nullptr; });
+    pipeline.submitted = pipeline.recording;
+    pipeline.recording = pipeline.recording == &pipeline.jobs[0] ? &pipeline.jobs[1] : &pipeline.jobs[0];
+    pipeline.bands_remaining = pipeline.bands.size();
+    pipeline.job_generation++;
+  }
+  pipeline.job_submitted.notify_all();
+
+  // The workers are done with this job, it can be reused for the next frame.
+  pipeline.recording->lines.clear();
+  pipeline.recording->deltas.clear();
+}
+
+void render_pipeline_wait_idle(GPURenderPipeline& pipeline) {
+  std::unique_lock<std::mutex> lock(pipeline.mutex);
+  pipeline.job_completed.wait(lock, [&pipeline] { return pipeline.submitted == nullptr; });
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "gpu.h"
+
+// A 32 byte block of palette RAM, VRAM or OAM that changed before a recorded scanline.
+struct RenderBlockDelta {
+  uint32_t address;
+  uint8_t data[VRAM_DIRTY_BLOCK_SIZE];
+};
+
+// Everything the renderer reads for one scanline, captured on the emulation thread.
+struct RenderLineRecord {
+  uint8_t scanline;
+  uint8_t io_registers[GPU_IO_REGISTERS_SIZE];
+  int32_t affine_ref_x[2];
+  int32_t affine_ref_y[2];
+
+  // Range of RenderFrameJob::deltas to apply before rendering this line.
+  uint32_t delta_begin;
+  uint32_t delta_end;
+};
+
+struct RenderFrameJob {
+  std::vector<RenderLineRecord> lines;
+  std::vector<RenderBlockDelta> deltas;
+};
+
+// Worker copy of the memory the renderer reads, kept current by replaying the deltas in order.
+struct RenderShadowMemory {
+  uint8_t io_registers[GPU_IO_REGISTERS_SIZE];
+  uint8_t palette_ram[PALETTE_RAM_SIZE];
+  uint8_t video_ram[VRAM_SIZE];
+  uint8_t object_attribute_memory[OAM_SIZE];
+
+  // Set when a delta lands in VRAM, consumed by the worker's tile cache.
+  uint64_t vram_dirty_blocks[VRAM_DIRTY_BITMAP_WORDS];
+};
+
+// One band of scanlines and the worker that renders it.
+// Every band replays all the deltas of a frame into its own shadow copy, but only rasterizes its own lines.
+// So the copying grows with the band count, each band copies 32 bytes per block written during the frame:
+// a frame rewriting a full mode 3 bitmap costs every band 75kb. Past the number of cores more bands only add copying.
+struct RenderBand {
+  std::thread worker;
+  uint8_t first_line = 0;
+  uint8_t end_line = 0;
+
+  // Only touched by the worker once it is running.
+  RenderShadowMemory* shadow = new RenderShadowMemory();
+  GPU* render_gpu = new GPU();
+};
+
+// Renders frame N on worker threads while the emulation thread runs frame N+1.
+// The emulation thread records every visible line into one job while the workers render the other.
+struct GPURenderPipeline {
+  std::mutex mutex;
+  std::condition_variable job_submitted;
+  std::condition_variable job_completed;
+  bool stop = false;
+
+  RenderFrameJob jobs[2];
+  RenderFrameJob* recording = &jobs[0];
+  RenderFrameJob* submitted = nullptr;
+
+  // Bumped for every submitted job, each band renders a generation once.
+  uint64_t job_generation = 0;
+  uint32_t bands_remaining = 0;
+
+  std::vector<RenderBand*> bands;
+
+  // Finished lines are written to the frame buffer of this GPU.
+  GPU* output_gpu = nullptr;
+};
+
+// Split the visible lines into `band_count` bands, each rendered by its own worker thread.
+GPURenderPipeline* render_pipeline_create(RAM& ram, GPU& gpu, uint32_t band_count);
+void render_pipeline_destroy(GPURenderPipeline* pipeline);
+
+// Snapshot the registers and collect the video memory written since the previous line.
+void render_pipeline_record_line(RAM& ram, GPU& gpu, GPURenderPipeline& pipeline, uint8_t scanline);
+
+// Hand the recorded lines to the workers. Blocks while they are still busy with the previous frame.
+void render_pipeline_submit_frame(GPURenderPipeline& pipeline);
+
+// Block until the workers have rendered everything submitted so far.
+void render_pipeline_wait_idle(GPURenderPipeline& pipeline);
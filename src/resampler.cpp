@@ -0,0 +1,133 @@
+#include "resampler.h"
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static constexpr double RESAMPLER_PI = 3.14159265358979323846;
+
+// Keep the pass band a little under Nyquist so the window has room to roll off.
+static constexpr double RESAMPLER_CUTOFF_SCALE = 0.95;
+
+inline double resampler_sinc(double x) {
+  if (x == 0.0) return 1.0;
+  return std::sin(RESAMPLER_PI * x) / (RESAMPLER_PI * x);
+}
+
+// Blackman window over [-1, 1].
+inline double resampler_window(double x) {
+  if (x <= -1.0 || x >= 1.0) return 0.0;
+  return 0.42 + 0.5 * std::cos(RESAMPLER_PI * x) + 0.08 * std::cos(2.0 * RESAMPLER_PI * x);
+}
+
+// Dot products of the same input window with two neighbouring filter phases.
+inline void resampler_dot(float const* samples, float const* taps_a, float const* taps_b, float& a, float& b) {
+#if defined(__SSE2__)
+  __m128 sum_a = _mm_setzero_ps();
+  __m128 sum_b = _mm_setzero_ps();
+  for (uint32_t i = 0; i < RESAMPLER_TAPS; i += 4) {
+    __m128 input = _mm_loadu_ps(samples + i);
+    sum_a = _mm_add_ps(sum_a, _mm_mul_ps(input, _mm_load_ps(taps_a + i)));
+    sum_b = _mm_add_ps(sum_b, _mm_mul_ps(input, _mm_load_ps(taps_b + i)));
+  }
+
+  // Add up the four lanes of both sums.
+  __m128 low = _mm_unpacklo_ps(sum_a, sum_b);
+  __m128 high = _mm_unpackhi_ps(sum_a, sum_b);
+  __m128 pairs = _mm_add_ps(low, high);
+  __m128 totals = _mm_add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+  a = _mm_cvtss_f32(totals);
+  b = _mm_cvtss_f32(_mm_shuffle_ps(totals, totals, 1));
+#else
+  a = 0.0f;
+  b = 0.0f;
+  for (uint32_t i = 0; i < RESAMPLER_TAPS; i++) {
+    a += samples[i] * taps_a[i];
+    b += samples[i] * taps_b[i];
+  }
+#endif
+}
+
+inline int16_t resampler_clamp_sample(float value) {
+  if (value >= 32767.0f) return INT16_MAX;
+  if (value <= -32768.0f) return INT16_MIN;
+  return (int16_t)std::lrint(value);
+}
+
+void resampler_build_filter(Resampler& resampler, uint32_t input_rate, uint32_t output_rate) {
+  // When downsampling the cutoff follows the output Nyquist frequency.
+  double cutoff = RESAMPLER_CUTOFF_SCALE * (output_rate < input_rate ? (double)output_rate / input_rate : 1.0);
+  constexpr double center = RESAMPLER_TAPS / 2 - 1;
+  constexpr double half_width = RESAMPLER_TAPS / 2;
+
+  for (uint32_t phase = 0; phase <= RESAMPLER_PHASES; phase++) {
+    double offset = (double)phase / RESAMPLER_PHASES;
+    double taps[RESAMPLER_TAPS];
+    double sum = 0.0;
+    for (uint32_t i = 0; i < RESAMPLER_TAPS; i++) {
+      double x = i - center - offset;
+      taps[i] = cutoff * resampler_sinc(cutoff * x) * resampler_window(x / half_width);
+      sum += taps[i];
+    }
+
+    // Normalize every phase to unity gain, so a constant input stays constant.
+    for (uint32_t i = 0; i < RESAMPLER_TAPS; i++) {
+      resampler.filter[phase][i] = (float)(taps[i] / sum);
+    }
+  }
+}
+
+void resampler_init(Resampler& resampler, uint32_t input_rate, uint32_t output_rate) {
+  // The filter only depends on the rates, and takes far longer to build than the rest.
+  if (resampler.input_rate != input_rate || resampler.output_rate != output_rate) {
+    resampler_build_filter(resampler, input_rate, output_rate);
+  }
+
+  resampler.input_rate = input_rate;
+  resampler.output_rate = output_rate;
+  resampler.step = (double)input_rate / output_rate * (1.0 + resampler.rate_adjust);
+  resampler.position = 0.0;
+
+  // Start with silence in the filter history, the output is delayed by half the filter length.
+  for (int channel = 0; channel < 2; channel++) {
+    resampler.input[channel].assign(RESAMPLER_TAPS / 2 - 1, 0.0f);
+  }
+}
+
+void resampler_set_rate_adjust(Resampler& resampler, double adjust) {
+  resampler.rate_adjust = adjust;
+  resampler.step = (double)resampler.input_rate / resampler.output_rate * (1.0 + adjust);
+}
+
+void resampler_process(Resampler& resampler, std::vector<int16_t>& out) {
+  size_t available = resampler.input[0].size();
+  float const* left = resampler.input[0].data();
+  float const* right = resampler.input[1].data();
+
+  while ((size_t)resampler.position + RESAMPLER_TAPS <= available) {
+    size_t index = (size_t)resampler.position;
+    double phase = (resampler.position - index) * RESAMPLER_PHASES;
+    uint32_t phase_index = (uint32_t)phase;
+    float blend = (float)(phase - phase_index);
+
+    float const* taps_a = resampler.filter[phase_index];
+    float const* taps_b = resampler.filter[phase_index + 1];
+
+    float a, b;
+    resampler_dot(left + index, taps_a, taps_b, a, b);
+    out.push_back(resampler_clamp_sample(a + (b - a) * blend));
+    resampler_dot(right + index, taps_a, taps_b, a, b);
+    out.push_back(resampler_clamp_sample(a + (b - a) * blend));
+
+    resampler.position += resampler.step;
+  }
+
+  // Drop the input that no future output can reach.
+  size_t consumed = (size_t)resampler.position;
+  if (consumed > available) consumed = available;
+  for (int channel = 0; channel < 2; channel++) {
+    resampler.input[channel].erase(resampler.input[channel].begin(), resampler.input[channel].begin() + consumed);
+  }
+  resampler.position -= consumed;
+}
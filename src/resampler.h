@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+static constexpr uint32_t RESAMPLER_TAPS = 32;
+static constexpr uint32_t RESAMPLER_PHASES = 128;
+
+// Band-limited stereo resampler using a windowed sinc filter.
+// The filter is stored for RESAMPLER_PHASES fractional offsets and interpolated between neighbouring phases.
+struct Resampler {
+  uint32_t input_rate = 0;
+  uint32_t output_rate = 0;
+
+  // Input samples consumed per output sample, and the position of the next output in `input`.
+  // `rate_adjust` nudges the step, so a consumer can correct for drift between the two clocks.
+  double step = 1.0;
+  double rate_adjust = 0.0;
+  double position = 0.0;
+
+  alignas(16) float filter[RESAMPLER_PHASES + 1][RESAMPLER_TAPS];
+
+  // Pending input per channel (left, right). The oldest RESAMPLER_TAPS samples are kept as filter history.
+  std::vector<float> input[2];
+};
+
+void resampler_init(Resampler& resampler, uint32_t input_rate, uint32_t output_rate);
+
+// Produce `adjust` (e.g. 0.001 for 0.1%) fewer output samples per input sample. The filter is left as is.
+void resampler_set_rate_adjust(Resampler& resampler, double adjust);
+
+inline void resampler_push(Resampler& resampler, float left, float right) {
+  resampler.input[0].push_back(left);
+  resampler.input[1].push_back(right);
+}
+
+// Filter everything that can be produced from the pushed input, appending interleaved stereo samples to `out`.
+void resampler_process(Resampler& resampler, std::vector<int16_t>& out);
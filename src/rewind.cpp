@@ -0,0 +1,93 @@
+#include "rewind.h"
+
+RewindBuffer* rewind_create(uint32_t keyframe_count, size_t delta_budget, uint32_t frame_interval, uint32_t keyframe_interval) {
+  if (keyframe_count < 2 || frame_interval == 0 || keyframe_interval == 0) {
+    throw std::runtime_error("Error: Rewind needs at least 2 keyframes and non zero intervals.");
+  }
+
+  auto rewind = new RewindBuffer();
+  rewind->keyframes = snapshot_arena_create(keyframe_count);
+  rewind->delta_budget = delta_budget;
+  rewind->frame_interval = frame_interval;
+  rewind->keyframe_interval = keyframe_interval;
+  return rewind;
+}
+
+void rewind_destroy(RewindBuffer* rewind) {
+  snapshot_arena_destroy(rewind->keyframes);
+  delete rewind;
+}
+
+void rewind_drop_oldest(RewindBuffer& rewind) {
+  rewind.delta_size -= rewind.entries.front().delta.data.capacity();
+  rewind.entries.pop_front();
+}
+
+void rewind_drop_newest(RewindBuffer& rewind) {
+  rewind.delta_size -= rewind.entries.back().delta.data.capacity();
+  rewind.entries.pop_back();
+}
+
+void rewind_record(RewindBuffer& rewind, GBA& gba) {
+  if (++rewind.frames_since_record < rewind.frame_interval) return;
+  rewind.frames_since_record = 0;
+
+  RewindEntry entry;
+  entry.cycle_count = gba.cpu.cycle_count;
+
+  bool take_keyframe = rewind.entries.empty() || rewind.entries.back().keyframe_distance + 1 >= rewind.keyframe_interval;
+  if (!take_keyframe) {
+    entry.keyframe = rewind.entries.back().keyframe;
+    entry.keyframe_distance = rewind.entries.back().keyframe_distance + 1;
+    take_keyframe = !snapshot_take_delta(*rewind.keyframes, entry.keyframe, gba, entry.delta);
+  }
+
+  if (take_keyframe) {
+    entry.keyframe = snapshot_take(*rewind.keyframes, gba);
+    entry.keyframe_distance = 0;
+    entry.delta.data.clear();
+
+    // The new keyframe took the slot of the oldest one, anything built on it is gone.
+    while (!rewind.entries.empty() && rewind.entries.front().keyframe + rewind.keyframes->slot_count <= entry.keyframe) {
+      rewind_drop_oldest(rewind);
+    }
+  } else {
+    entry.delta.data.shrink_to_fit();
+  }
+
+  rewind.delta_size += entry.delta.data.capacity();
+  rewind.entries.push_back(std::move(entry));
+
+  // Always keep the newest entry, so there is somewhere to step back to.
+  while (rewind.delta_size > rewind.delta_budget && rewind.entries.size() > 1) {
+    rewind_drop_oldest(rewind);
+  }
+}
+
+bool rewind_step_back(RewindBuffer& rewind, GBA& gba) {
+  if (rewind.entries.empty()) return false;
+
+  if (rewind.entries.back().cycle_count == gba.cpu.cycle_count) {
+    if (rewind.entries.size() < 2) return false;
+    rewind_drop_newest(rewind);
+  }
+
+  RewindEntry const& entry = rewind.entries.back();
+  bool restored = entry.keyframe_distance == 0 ?
+    snapshot_restore(*rewind.keyframes, entry.keyframe, gba) :
+    snapshot_restore_delta(*rewind.keyframes, entry.delta, gba);
+  if (!restored) return false;
+
+  rewind.frames_since_record = 0;
+  return true;
+}
+
+void rewind_clear(RewindBuffer& rewind) {
+  rewind.entries.clear();
+  rewind.delta_size = 0;
+  rewind.frames_since_record = 0;
+}
+
+size_t rewind_memory_usage(RewindBuffer const& rewind) {
+  return rewind.keyframes->slot_size * (rewind.keyframes->slot_count + 1) + rewind.delta_size;
+}
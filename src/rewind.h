@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include "snapshot.h"
+
+// One recorded frame: a keyframe in the arena, or a delta against one.
+struct RewindEntry {
+  snapshot_t keyframe = 0;
+  uint32_t keyframe_distance = 0;
+  uint64_t cycle_count = 0;
+  SnapshotDelta delta;
+};
+
+// A ring of recent states for stepping back through a run.
+// Every `keyframe_interval` entries a full snapshot is taken into the arena, the entries in between are deltas against it,
+// so stepping back any number of entries costs one copy of the keyframe plus one delta.
+// The oldest entries are dropped when the deltas go over the memory budget or their keyframe slot is reused.
+struct RewindBuffer {
+  SnapshotArena* keyframes = nullptr;
+  std::deque<RewindEntry> entries;
+
+  // Record a state every `frame_interval` frames.
+  uint32_t frame_interval = 1;
+  uint32_t keyframe_interval = 60;
+  uint32_t frames_since_record = 0;
+
+  // Bytes held by deltas, the keyframe arena is allocated up front.
+  size_t delta_budget = 0;
+  size_t delta_size = 0;
+};
+
+RewindBuffer* rewind_create(uint32_t keyframe_count, size_t delta_budget, uint32_t frame_interval = 1, uint32_t keyframe_interval = 60);
+void rewind_destroy(RewindBuffer* rewind);
+
+// Call once per frame, at the frame boundary.
+void rewind_record(RewindBuffer& rewind, GBA& gba);
+
+// Go back to the last recorded state, or the one before it if the emulator is still at the last one.
+// Returns false, leaving the emulator untouched, when there is nothing further back.
+bool rewind_step_back(RewindBuffer& rewind, GBA& gba);
+
+void rewind_clear(RewindBuffer& rewind);
+
+// Total bytes held, keyframes and deltas.
+size_t rewind_memory_usage(RewindBuffer const& rewind);
@@ -0,0 +1,424 @@
+#include "snapshot.h"
+#include "render_pipeline.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+static constexpr CPUOperatingMode SNAPSHOT_SCPSR_MODES[5] = {FIQ, IRQ, Supervisor, Abort, Undefined};
+
+// Everything except the memory regions, which follow the slot in the arena.
+struct SnapshotSlot {
+  snapshot_t snapshot = 0;
+
+  // CPU
+  uint64_t cycle_count;
+  uint32_t registers[16];
+  uint32_t cpsr;
+  uint32_t scpsr_registers[5];
+  uint32_t banked_registers[5][7];
+  bool halted;
+  Flash flash;
+  EEPROM eeprom;
+
+  // Version of the SRAM and EEPROM copies in this slot (0 when the slot holds none).
+  uint64_t save_memory_version = 0;
+
+  // Unique id of the memory in this slot, RAM::dirty_pages_base while the RAM tracks writes relative to it.
+  uint64_t page_base = 0;
+
+  Timer timer;
+
+  // GPU
+  int32_t affine_ref_x[2];
+  int32_t affine_ref_y[2];
+  uint8_t affine_ref_written;
+  uint32_t frame_skip_accumulator;
+  bool render_current_frame;
+  uint16_t frame_buffer[FRAME_BUFFER_SIZE];
+
+  // APU, the pending FIFO events are rendered before taking the snapshot.
+  APUSquareChannel square[2];
+  APUWaveChannel wave;
+  APUNoiseChannel noise;
+  APUFifo fifos[2];
+  uint32_t frame_sequencer_cycles;
+  uint8_t frame_sequencer_step;
+  uint64_t rendered_cycle;
+};
+
+// Regions start on cache line boundaries, relative to the slot.
+static constexpr size_t SNAPSHOT_EWRAM_OFFSET = (sizeof(SnapshotSlot) + 63) & ~(size_t)63;
+static constexpr size_t SNAPSHOT_IWRAM_OFFSET = SNAPSHOT_EWRAM_OFFSET + 0x40000;
+static constexpr size_t SNAPSHOT_IO_OFFSET = SNAPSHOT_IWRAM_OFFSET + 0x8000;
+static constexpr size_t SNAPSHOT_PALETTE_OFFSET = SNAPSHOT_IO_OFFSET + 0x804;
+static constexpr size_t SNAPSHOT_VRAM_OFFSET = SNAPSHOT_PALETTE_OFFSET + PALETTE_RAM_SIZE;
+static constexpr size_t SNAPSHOT_OAM_OFFSET = SNAPSHOT_VRAM_OFFSET + VRAM_SIZE;
+static constexpr size_t SNAPSHOT_SRAM_OFFSET = SNAPSHOT_OAM_OFFSET + OAM_SIZE;
+static constexpr size_t SNAPSHOT_EEPROM_OFFSET = SNAPSHOT_SRAM_OFFSET + 0x20000;
+static constexpr size_t SNAPSHOT_SLOT_SIZE = (SNAPSHOT_EEPROM_OFFSET + 0x2000 + 63) & ~(size_t)63;
+
+// Shared by every arena, so page bases are never mistaken for one another.
+static std::atomic<uint64_t> snapshot_next_page_base = 1;
+
+inline uint8_t* snapshot_slot_memory(SnapshotArena const& arena, snapshot_t snapshot) {
+  return arena.memory + (snapshot % arena.slot_count) * arena.slot_size;
+}
+
+// Pages are laid out in the slot in the same order as they are numbered, with the I/O registers between IWRAM and palette RAM.
+inline size_t snapshot_page_offset(uint32_t page) {
+  if (page < RAM_PAGE_PALETTE) return SNAPSHOT_EWRAM_OFFSET + ((size_t)page << RAM_PAGE_SHIFT);
+  return SNAPSHOT_PALETTE_OFFSET + ((size_t)(page - RAM_PAGE_PALETTE) << RAM_PAGE_SHIFT);
+}
+
+// Copies video memory a dirty block at a time, and only marks the blocks that differ.
+// Restoring a nearby snapshot then leaves most of the tile cache and the render pipeline copies valid.
+template <typename Bitmap>
+inline void snapshot_restore_video_blocks(uint8_t* dest, uint8_t const* src, uint32_t size, Bitmap* dirty_blocks) {
+  constexpr uint32_t bits = sizeof(Bitmap) * 8;
+  for (uint32_t block = 0; block < size / VRAM_DIRTY_BLOCK_SIZE; block++) {
+    uint32_t offset = block * VRAM_DIRTY_BLOCK_SIZE;
+    if (memcmp(dest + offset, src + offset, VRAM_DIRTY_BLOCK_SIZE) == 0) continue;
+    memcpy(dest + offset, src + offset, VRAM_DIRTY_BLOCK_SIZE);
+    dirty_blocks[block / bits] |= (Bitmap)1 << (block % bits);
+  }
+}
+
+SnapshotArena* snapshot_arena_create(uint32_t slot_count) {
+  SnapshotArena* arena = new SnapshotArena();
+  arena->slot_count = slot_count > 0 ? slot_count : 1;
+  arena->slot_size = SNAPSHOT_SLOT_SIZE;
+
+  // One more slot than asked for, used to rebuild states from deltas.
+  arena->memory = new uint8_t[arena->slot_size * (arena->slot_count + 1)];
+  arena->scratch = arena->memory + arena->slot_size * arena->slot_count;
+
+  for (uint32_t i = 0; i <= arena->slot_count; i++) {
+    new (arena->memory + i * arena->slot_size) SnapshotSlot();
+  }
+  return arena;
+}
+
+void snapshot_arena_destroy(SnapshotArena* arena) {
+  delete [] arena->memory;
+  delete arena;
+}
+
+void snapshot_capture_slot(SnapshotSlot& slot, GBA& gba) {
+  CPU& cpu = gba.cpu;
+  GPU& gpu = gba.gpu;
+  Timer& timer = gba.timer;
+  APU& apu = gba.apu;
+
+  slot.cycle_count = cpu.cycle_count;
+  memcpy(slot.registers, cpu.registers, sizeof(slot.registers));
+  slot.cpsr = cpu.cpsr;
+  for (int i = 0; i < 5; i++) {
+    slot.scpsr_registers[i] = cpu.mode_to_scpsr[SNAPSHOT_SCPSR_MODES[i]];
+  }
+  memcpy(slot.banked_registers, cpu.banked_registers, sizeof(slot.banked_registers));
+  slot.halted = cpu.halted;
+  slot.flash = cpu.flash;
+  slot.eeprom = cpu.eeprom;
+  slot.save_memory_version = cpu.ram.save_memory_version;
+
+  slot.timer = timer;
+
+  memcpy(slot.affine_ref_x, gpu.affine_ref_x, sizeof(slot.affine_ref_x));
+  memcpy(slot.affine_ref_y, gpu.affine_ref_y, sizeof(slot.affine_ref_y));
+  slot.affine_ref_written = gpu.affine_ref_written;
+  slot.frame_skip_accumulator = gpu.frame_skip_accumulator;
+  slot.render_current_frame = gpu.render_current_frame;
+  memcpy(slot.frame_buffer, gpu.frame_buffer, sizeof(slot.frame_buffer));
+
+  memcpy(slot.square, apu.square, sizeof(slot.square));
+  slot.wave = apu.wave;
+  slot.noise = apu.noise;
+  memcpy(slot.fifos, apu.fifos, sizeof(slot.fifos));
+  slot.frame_sequencer_cycles = apu.frame_sequencer_cycles;
+  slot.frame_sequencer_step = apu.frame_sequencer_step;
+  slot.rendered_cycle = apu.rendered_cycle;
+}
+
+snapshot_t snapshot_take(SnapshotArena& arena, GBA& gba) {
+  CPU& cpu = gba.cpu;
+  gba_settle(gba);
+
+  snapshot_t snapshot = arena.next_snapshot++;
+  uint8_t* memory = snapshot_slot_memory(arena, snapshot);
+  SnapshotSlot& slot = *(SnapshotSlot*)memory;
+  slot.snapshot = snapshot;
+
+  // Save memory rarely changes, the copy left in the slot by an earlier snapshot is often still current.
+  if (slot.save_memory_version != cpu.ram.save_memory_version) {
+    memcpy(memory + SNAPSHOT_SRAM_OFFSET, cpu.ram.game_pak_sram, 0x20000);
+    memcpy(memory + SNAPSHOT_EEPROM_OFFSET, cpu.ram.eeprom, 0x2000);
+  }
+  snapshot_capture_slot(slot, gba);
+
+  memcpy(memory + SNAPSHOT_EWRAM_OFFSET, cpu.ram.external_working_ram, 0x40000);
+  memcpy(memory + SNAPSHOT_IWRAM_OFFSET, cpu.ram.internal_working_ram, 0x8000);
+  memcpy(memory + SNAPSHOT_IO_OFFSET, cpu.ram.io_registers, 0x804);
+  memcpy(memory + SNAPSHOT_PALETTE_OFFSET, cpu.ram.palette_ram, PALETTE_RAM_SIZE);
+  memcpy(memory + SNAPSHOT_VRAM_OFFSET, cpu.ram.video_ram, VRAM_SIZE);
+  memcpy(memory + SNAPSHOT_OAM_OFFSET, cpu.ram.object_attribute_memory, OAM_SIZE);
+
+  // From here on the RAM tracks its writes relative to this snapshot.
+  slot.page_base = snapshot_next_page_base.fetch_add(1, std::memory_order_relaxed);
+  cpu.ram.dirty_pages_base = slot.page_base;
+  memset(cpu.ram.dirty_pages, 0, sizeof(cpu.ram.dirty_pages));
+
+  return snapshot;
+}
+
+SnapshotSlot const* snapshot_find_slot(SnapshotArena const& arena, snapshot_t snapshot) {
+  if (snapshot == 0) return nullptr;
+  SnapshotSlot const* slot = (SnapshotSlot const*)snapshot_slot_memory(arena, snapshot);
+  return slot->snapshot == snapshot ? slot : nullptr;
+}
+
+// Everything but the memory regions.
+void snapshot_apply_slot(SnapshotSlot const& slot, GBA& gba) {
+  CPU& cpu = gba.cpu;
+  GPU& gpu = gba.gpu;
+  Timer& timer = gba.timer;
+  APU& apu = gba.apu;
+
+  if (gpu.render_pipeline != nullptr) {
+    render_pipeline_wait_idle(*gpu.render_pipeline);
+  }
+
+  cpu.cycle_count = slot.cycle_count;
+  memcpy(cpu.registers, slot.registers, sizeof(slot.registers));
+  cpu.cpsr = slot.cpsr;
+  for (int i = 0; i < 5; i++) {
+    cpu.mode_to_scpsr[SNAPSHOT_SCPSR_MODES[i]] = slot.scpsr_registers[i];
+  }
+  memcpy(cpu.banked_registers, slot.banked_registers, sizeof(slot.banked_registers));
+  cpu.halted = slot.halted;
+  cpu.flash = slot.flash;
+  cpu.eeprom = slot.eeprom;
+
+  timer = slot.timer;
+
+  memcpy(gpu.affine_ref_x, slot.affine_ref_x, sizeof(slot.affine_ref_x));
+  memcpy(gpu.affine_ref_y, slot.affine_ref_y, sizeof(slot.affine_ref_y));
+  gpu.affine_ref_written = slot.affine_ref_written;
+  gpu.frame_skip_accumulator = slot.frame_skip_accumulator;
+  gpu.render_current_frame = slot.render_current_frame;
+  for (uint32_t y = 0; y < FRAME_HEIGHT; y++) {
+    gpu_write_frame_buffer_line(gpu, y, slot.frame_buffer + y * FRAME_WIDTH);
+  }
+
+  // The audio already produced stays queued, the APU continues from the restored point.
+  memcpy(apu.square, slot.square, sizeof(slot.square));
+  apu.wave = slot.wave;
+  apu.noise = slot.noise;
+  memcpy(apu.fifos, slot.fifos, sizeof(slot.fifos));
+  apu.frame_sequencer_cycles = slot.frame_sequencer_cycles;
+  apu.frame_sequencer_step = slot.frame_sequencer_step;
+  apu.rendered_cycle = slot.rendered_cycle;
+  apu.fifo_events.clear();
+}
+
+void snapshot_restore_slot(uint8_t const* memory, GBA& gba) {
+  CPU& cpu = gba.cpu;
+  SnapshotSlot const& slot = *(SnapshotSlot const*)memory;
+  snapshot_apply_slot(slot, gba);
+
+  memcpy(cpu.ram.external_working_ram, memory + SNAPSHOT_EWRAM_OFFSET, 0x40000);
+  memcpy(cpu.ram.internal_working_ram, memory + SNAPSHOT_IWRAM_OFFSET, 0x8000);
+  memcpy(cpu.ram.io_registers, memory + SNAPSHOT_IO_OFFSET, 0x804);
+  snapshot_restore_video_blocks(cpu.ram.palette_ram, memory + SNAPSHOT_PALETTE_OFFSET, PALETTE_RAM_SIZE, &cpu.ram.palette_dirty_blocks);
+  snapshot_restore_video_blocks(cpu.ram.video_ram, memory + SNAPSHOT_VRAM_OFFSET, VRAM_SIZE, cpu.ram.vram_dirty_blocks);
+  snapshot_restore_video_blocks(cpu.ram.object_attribute_memory, memory + SNAPSHOT_OAM_OFFSET, OAM_SIZE, &cpu.ram.oam_dirty_blocks);
+
+  if (cpu.ram.save_memory_version != slot.save_memory_version) {
+    memcpy(cpu.ram.game_pak_sram, memory + SNAPSHOT_SRAM_OFFSET, 0x20000);
+    memcpy(cpu.ram.eeprom, memory + SNAPSHOT_EEPROM_OFFSET, 0x2000);
+    cpu.ram.save_memory_version = slot.save_memory_version;
+  }
+
+  // The RAM now holds exactly the memory of the slot.
+  cpu.ram.dirty_pages_base = slot.page_base;
+  memset(cpu.ram.dirty_pages, slot.page_base != 0 ? 0 : 0xFF, sizeof(cpu.ram.dirty_pages));
+  cpu.ram.shareable_memory_written = true;
+}
+
+void snapshot_copy_state(GBA& gba, GBA& copy) {
+  CPU& cpu = gba.cpu;
+  RAM& ram = copy.cpu.ram;
+  gba_settle(gba);
+
+  std::unique_ptr<SnapshotSlot> slot = std::make_unique<SnapshotSlot>();
+  snapshot_capture_slot(*slot, gba);
+  snapshot_apply_slot(*slot, copy);
+
+  memcpy(ram.io_registers, cpu.ram.io_registers, 0x804);
+  memcpy(ram.palette_ram, cpu.ram.palette_ram, PALETTE_RAM_SIZE);
+  memcpy(ram.object_attribute_memory, cpu.ram.object_attribute_memory, OAM_SIZE);
+  memcpy(ram.game_pak_sram, cpu.ram.game_pak_sram, 0x20000);
+  memcpy(ram.eeprom, cpu.ram.eeprom, 0x2000);
+  ram.save_memory_version = cpu.ram.save_memory_version;
+  ram_mark_all_video_memory_dirty(ram);
+
+  // Not relative to any snapshot.
+  ram.dirty_pages_base = 0;
+  memset(ram.dirty_pages, 0xFF, sizeof(ram.dirty_pages));
+}
+
+bool snapshot_restore(SnapshotArena const& arena, snapshot_t snapshot, GBA& gba) {
+  SnapshotSlot const* slot = snapshot_find_slot(arena, snapshot);
+  if (slot == nullptr) return false;
+
+  snapshot_restore_slot((uint8_t const*)slot, gba);
+  return true;
+}
+
+inline void snapshot_put_varint(std::vector<uint8_t>& out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+inline bool snapshot_get_varint(uint8_t const* data, size_t size, size_t& offset, uint32_t& value) {
+  value = 0;
+  for (uint32_t shift = 0; shift < 32; shift += 7) {
+    if (offset >= size) return false;
+    uint8_t byte = data[offset++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+inline bool snapshot_equal_u64(uint8_t const* a, uint8_t const* b) {
+  uint64_t x, y;
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  return x == y;
+}
+
+// Appends `current` XOR `base` as runs: the number of equal bytes, the number of differing bytes, then the XOR of those.
+// Short equal stretches inside a differing run are kept in it, a new run costs more than a few zero bytes.
+void snapshot_put_xor_runs(std::vector<uint8_t>& out, uint8_t const* current, uint8_t const* base, uint32_t size) {
+  uint32_t position = 0;
+  while (position < size) {
+    uint32_t equal_start = position;
+    while (position + 8 <= size && snapshot_equal_u64(current + position, base + position)) position += 8;
+    while (position < size && current[position] == base[position]) position++;
+
+    uint32_t differ_start = position;
+    while (position < size) {
+      uint32_t equal = 0;
+      while (equal < 4 && position + equal < size && current[position + equal] == base[position + equal]) equal++;
+      if (equal == 4 || position + equal == size) break;
+      position += equal + 1;
+    }
+
+    snapshot_put_varint(out, differ_start - equal_start);
+    snapshot_put_varint(out, position - differ_start);
+    for (uint32_t i = differ_start; i < position; i++) {
+      out.push_back(current[i] ^ base[i]);
+    }
+  }
+}
+
+bool snapshot_apply_xor_runs(uint8_t const* data, size_t size, size_t& offset, uint8_t* dest, uint32_t dest_size) {
+  uint32_t position = 0;
+  while (position < dest_size) {
+    uint32_t equal, differ;
+    if (!snapshot_get_varint(data, size, offset, equal) || !snapshot_get_varint(data, size, offset, differ)) return false;
+    if (equal + differ == 0 || equal > dest_size - position || differ > dest_size - position - equal) return false;
+    if (differ > size - offset) return false;
+
+    position += equal;
+    for (uint32_t i = 0; i < differ; i++) {
+      dest[position + i] ^= data[offset + i];
+    }
+    position += differ;
+    offset += differ;
+  }
+  return true;
+}
+
+bool snapshot_take_delta(SnapshotArena& arena, snapshot_t base, GBA& gba, SnapshotDelta& delta) {
+  CPU& cpu = gba.cpu;
+  SnapshotSlot const* base_slot = snapshot_find_slot(arena, base);
+  if (base_slot == nullptr) return false;
+  uint8_t const* base_memory = (uint8_t const*)base_slot;
+
+  gba_settle(gba);
+
+  // The pages written since the base, when the RAM is tracking relative to it. Otherwise compare every page.
+  uint64_t pages[RAM_DIRTY_PAGE_WORDS] = {};
+  if (cpu.ram.dirty_pages_base == base_slot->page_base) {
+    memcpy(pages, cpu.ram.dirty_pages, sizeof(pages));
+  } else {
+    for (uint32_t page = 0; page < RAM_PAGE_COUNT; page++) {
+      if (memcmp(ram_page_memory(cpu.ram, page), base_memory + snapshot_page_offset(page), RAM_PAGE_SIZE) != 0) {
+        pages[page >> 6] |= 1ULL << (page & 63);
+      }
+    }
+  }
+  bool has_save_memory = cpu.ram.save_memory_version != base_slot->save_memory_version;
+
+  delta.base = base;
+  delta.data.assign((uint8_t const*)pages, (uint8_t const*)pages + sizeof(pages));
+  delta.data.push_back(has_save_memory);
+
+  // The slot fields are gathered in the scratch slot first, then everything is diffed against the base.
+  SnapshotSlot& current = *(SnapshotSlot*)arena.scratch;
+  snapshot_capture_slot(current, gba);
+  current.snapshot = base_slot->snapshot;
+  current.page_base = base_slot->page_base;
+  snapshot_put_xor_runs(delta.data, (uint8_t const*)&current, base_memory, sizeof(SnapshotSlot));
+  snapshot_put_xor_runs(delta.data, cpu.ram.io_registers, base_memory + SNAPSHOT_IO_OFFSET, 0x804);
+  for (uint32_t page = 0; page < RAM_PAGE_COUNT; page++) {
+    if ((pages[page >> 6] & (1ULL << (page & 63))) == 0) continue;
+    snapshot_put_xor_runs(delta.data, ram_page_memory(cpu.ram, page), base_memory + snapshot_page_offset(page), RAM_PAGE_SIZE);
+  }
+  if (has_save_memory) {
+    snapshot_put_xor_runs(delta.data, cpu.ram.game_pak_sram, base_memory + SNAPSHOT_SRAM_OFFSET, 0x20000);
+    snapshot_put_xor_runs(delta.data, cpu.ram.eeprom, base_memory + SNAPSHOT_EEPROM_OFFSET, 0x2000);
+  }
+  return true;
+}
+
+bool snapshot_restore_delta(SnapshotArena& arena, SnapshotDelta const& delta, GBA& gba) {
+  SnapshotSlot const* base_slot = snapshot_find_slot(arena, delta.base);
+  if (base_slot == nullptr) return false;
+
+  uint8_t const* data = delta.data.data();
+  size_t size = delta.data.size();
+  uint64_t pages[RAM_DIRTY_PAGE_WORDS];
+  if (size < sizeof(pages) + 1) return false;
+  memcpy(pages, data, sizeof(pages));
+  bool has_save_memory = data[sizeof(pages)] != 0;
+  size_t offset = sizeof(pages) + 1;
+
+  // Rebuild the full state in the scratch slot, the emulator is only touched once the delta applied cleanly.
+  uint8_t* scratch = arena.scratch;
+  memcpy(scratch, base_slot, arena.slot_size);
+  bool valid = snapshot_apply_xor_runs(data, size, offset, scratch, sizeof(SnapshotSlot));
+  valid = valid && snapshot_apply_xor_runs(data, size, offset, scratch + SNAPSHOT_IO_OFFSET, 0x804);
+  for (uint32_t page = 0; valid && page < RAM_PAGE_COUNT; page++) {
+    if ((pages[page >> 6] & (1ULL << (page & 63))) == 0) continue;
+    valid = snapshot_apply_xor_runs(data, size, offset, scratch + snapshot_page_offset(page), RAM_PAGE_SIZE);
+  }
+  if (valid && has_save_memory) {
+    valid = snapshot_apply_xor_runs(data, size, offset, scratch + SNAPSHOT_SRAM_OFFSET, 0x20000) &&
+      snapshot_apply_xor_runs(data, size, offset, scratch + SNAPSHOT_EEPROM_OFFSET, 0x2000);
+  }
+  if (!valid) return false;
+
+  // The rebuilt memory is the base plus the pages of the delta, keep tracking relative to the base.
+  SnapshotSlot& slot = *(SnapshotSlot*)scratch;
+  slot.page_base = base_slot->page_base;
+  snapshot_restore_slot(scratch, gba);
+  for (uint32_t i = 0; i < RAM_DIRTY_PAGE_WORDS; i++) {
+    gba.cpu.ram.dirty_pages[i] |= pages[i];
+  }
+  return true;
+}
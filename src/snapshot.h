@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "gba.h"
+
+// Handle of a snapshot in an arena, 0 is never a valid handle.
+typedef uint64_t snapshot_t;
+
+// In-memory snapshots for rewind and search, taken and restored with plain copies.
+// The arena is a single allocation of fixed size slots, reused round robin, so taking a snapshot never allocates.
+// A handle stays valid until its slot is taken by a newer snapshot.
+struct SnapshotArena {
+  uint8_t* memory = nullptr;
+  size_t slot_size = 0;
+  uint32_t slot_count = 0;
+  snapshot_t next_snapshot = 1;
+
+  // Working slot for building and applying deltas.
+  uint8_t* scratch = nullptr;
+};
+
+// The state relative to a base snapshot: only the RAM pages written since the base are stored,
+// and everything is stored as its XOR with the base, run length encoded, so unchanged bytes cost next to nothing.
+// A delta can be restored for as long as its base is still in the arena.
+struct SnapshotDelta {
+  snapshot_t base = 0;
+  std::vector<uint8_t> data;
+};
+
+SnapshotArena* snapshot_arena_create(uint32_t slot_count);
+void snapshot_arena_destroy(SnapshotArena* arena);
+
+// Copy the emulator state into the next slot of the arena.
+snapshot_t snapshot_take(SnapshotArena& arena, GBA& gba);
+
+// Returns false, leaving the emulator untouched, if the snapshot was overwritten by newer ones.
+bool snapshot_restore(SnapshotArena const& arena, snapshot_t snapshot, GBA& gba);
+
+// Copy the state of `gba` into `copy` directly, without an arena, except for EWRAM, IWRAM and VRAM,
+// which the caller copies or shares. The copy's writes aren't tracked relative to any snapshot.
+void snapshot_copy_state(GBA& gba, GBA& copy);
+
+// Pages are found with the RAM dirty page bitmap, which follows the last snapshot taken or restored.
+// Against an older base every page is compared instead, the delta is the same but slower to build.
+bool snapshot_take_delta(SnapshotArena& arena, snapshot_t base, GBA& gba, SnapshotDelta& delta);
+bool snapshot_restore_delta(SnapshotArena& arena, SnapshotDelta const& delta, GBA& gba);
@@ -1,10 +1,69 @@
 #include "state_io.h"
 #include "ram.h"
+#include "lz.h"
 
 #include <cstring>
 #include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 
-struct SaveState {
+static constexpr char STATE_MAGIC[8] = {'G', 'B', 'A', 'S', 'T', 'A', 'T', 'E'};
+
+static constexpr uint32_t STATE_SECTION_COMPRESSED = 1 << 0;
+
+// Sections smaller than this are stored as is.
+static constexpr uint32_t STATE_COMPRESSION_MIN_SIZE = 64;
+
+// No section is larger than external working RAM, a bigger size comes from a damaged file and is not allocated.
+static constexpr uint32_t STATE_MAX_SECTION_SIZE = 0x40000;
+
+static constexpr uint32_t state_tag(char const (&name)[5]) {
+  return (uint32_t)name[0] | (uint32_t)name[1] << 8 | (uint32_t)name[2] << 16 | (uint32_t)name[3] << 24;
+}
+
+static constexpr uint32_t STATE_TAG_CPU = state_tag("CPU ");
+static constexpr uint32_t STATE_TAG_FLASH = state_tag("FLSH");
+static constexpr uint32_t STATE_TAG_EEPROM = state_tag("EEPR");
+static constexpr uint32_t STATE_TAG_GPU = state_tag("GPU ");
+static constexpr uint32_t STATE_TAG_TIMER = state_tag("TIMR");
+static constexpr uint32_t STATE_TAG_APU = state_tag("APU ");
+
+struct StateHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+};
+
+struct StateSectionHeader {
+  uint32_t tag;
+  uint32_t flags;
+  // Size of the section data, and of what is stored in the file (smaller when compressed).
+  uint32_t size;
+  uint32_t stored_size;
+};
+
+// Memory regions are stored verbatim, one section each.
+// DMA has no state outside of its I/O registers, so it is covered by the I/O section.
+struct StateRegion {
+  uint32_t tag;
+  uint8_t* RAM::* memory;
+  uint32_t size;
+};
+
+static StateRegion const STATE_REGIONS[] = {
+  {state_tag("EWRM"), &RAM::external_working_ram, 0x40000},
+  {state_tag("IWRM"), &RAM::internal_working_ram, 0x8000},
+  {state_tag("IO  "), &RAM::io_registers, 0x804},
+  {state_tag("PAL "), &RAM::palette_ram, 0x400},
+  {state_tag("VRAM"), &RAM::video_ram, VRAM_SIZE},
+  {state_tag("OAM "), &RAM::object_attribute_memory, 0x400},
+  {state_tag("SRAM"), &RAM::game_pak_sram, 0x20000},
+};
+
+// The unversioned format: a raw dump of this struct, with the first 64kb of SRAM only.
+struct LegacySaveState {
   // CPU
   uint64_t cycle_count = 0;
   uint32_t registers[16];
@@ -28,49 +87,350 @@ struct SaveState {
   uint8_t game_pak_sram[0x10000];
 };
 
-void save_state(CPU& cpu, std::string const& state_file_path) {
-  SaveState state;
-  state.cycle_count = cpu.cycle_count;
-  state.cpsr = cpu.cpsr;
-  memcpy(state.registers, cpu.registers, sizeof(state.registers));
-  memcpy(state.banked_registers, cpu.banked_registers, sizeof(state.banked_registers));
-
-  state.scpsr_registers[0] = cpu.mode_to_scpsr[FIQ];
-  state.scpsr_registers[1] = cpu.mode_to_scpsr[IRQ];
-  state.scpsr_registers[2] = cpu.mode_to_scpsr[Supervisor];
-  state.scpsr_registers[3] = cpu.mode_to_scpsr[Abort];
-  state.scpsr_registers[4] = cpu.mode_to_scpsr[Undefined];
-
-  memcpy(state.external_working_ram, cpu.ram.external_working_ram, sizeof(state.external_working_ram));
-  memcpy(state.internal_working_ram, cpu.ram.internal_working_ram, sizeof(state.internal_working_ram));
-  memcpy(state.io_registers, cpu.ram.io_registers, sizeof(state.io_registers));
-  memcpy(state.palette_ram, cpu.ram.palette_ram, sizeof(state.palette_ram));
-  memcpy(state.vram, cpu.ram.video_ram, sizeof(state.vram));
-  memcpy(state.oam, cpu.ram.object_attribute_memory, sizeof(state.oam));
-  memcpy(state.game_pak_sram, cpu.ram.game_pak_sram, sizeof(state.game_pak_sram));
+static constexpr CPUOperatingMode STATE_SCPSR_MODES[5] = {FIQ, IRQ, Supervisor, Abort, Undefined};
 
-  std::ofstream file(state_file_path, std::ios::binary);
-  file.write(reinterpret_cast<char*>(&state), sizeof(state));
-  file.close();
+// Sections are read into these first, so a damaged state is rejected before anything is applied.
+// Large blocks point into the decoded section instead of being copied.
+struct StateCPU {
+  uint64_t cycle_count;
+  uint32_t registers[16];
+  uint32_t cpsr;
+  uint32_t scpsr_registers[5];
+  uint32_t banked_registers[5][7];
+  bool halted;
+};
+
+struct StateEEPROM {
+  EEPROM eeprom;
+  uint8_t const* memory;
+};
+
+struct StateGPU {
+  int32_t affine_ref_x[2];
+  int32_t affine_ref_y[2];
+  uint8_t affine_ref_written;
+  uint32_t frame_skip_accumulator;
+  bool render_current_frame;
+  uint8_t const* frame_buffer;
+};
+
+struct StateAPU {
+  APUSquareChannel square[2];
+  APUWaveChannel wave;
+  APUNoiseChannel noise;
+  APUFifo fifos[2];
+  uint32_t frame_sequencer_cycles;
+  uint8_t frame_sequencer_step;
+  uint64_t rendered_cycle;
+  std::vector<APUFifoEvent> fifo_events;
+};
+
+// Sections missing from a state leave that part of the emulator as it was.
+struct StateContents {
+  uint8_t const* regions[std::size(STATE_REGIONS)] = {};
+  bool has_cpu = false;
+  bool has_flash = false;
+  bool has_eeprom = false;
+  bool has_gpu = false;
+  bool has_timer = false;
+  bool has_apu = false;
+  StateCPU cpu;
+  Flash flash;
+  StateEEPROM eeprom;
+  StateGPU gpu;
+  Timer timer;
+  StateAPU apu;
+};
+
+struct StateReader {
+  uint8_t const* data;
+  size_t size;
+  size_t offset = 0;
+};
+
+inline void state_put(std::vector<uint8_t>& section, void const* data, size_t size) {
+  uint8_t const* bytes = (uint8_t const*)data;
+  section.insert(section.end(), bytes, bytes + size);
 }
 
-void load_state(CPU& cpu, std::string const& state_file_path) {
-  SaveState state;
+template <typename T>
+inline void state_put_value(std::vector<uint8_t>& section, T const& value) {
+  static_assert(std::is_trivially_copyable<T>::value, "State values are copied as bytes.");
+  state_put(section, &value, sizeof(T));
+}
 
-  std::ifstream file(state_file_path, std::ios::binary);
-  file.read(reinterpret_cast<char*>(&state), sizeof(state));
-  file.close();
+inline uint8_t const* state_get_data(StateReader& reader, size_t size) {
+  if (size > reader.size - reader.offset) {
+    throw std::runtime_error("Error: Save state section is truncated.");
+  }
+  uint8_t const* data = reader.data + reader.offset;
+  reader.offset += size;
+  return data;
+}
+
+inline void state_get(StateReader& reader, void* data, size_t size) {
+  uint8_t const* source = state_get_data(reader, size);
+  // An empty vector has no data pointer to copy to.
+  if (size > 0) {
+    memcpy(data, source, size);
+  }
+}
+
+inline void state_check_read_all(StateReader const& reader) {
+  if (reader.offset != reader.size) {
+    throw std::runtime_error("Error: Save state section has the wrong size.");
+  }
+}
+
+template <typename T>
+inline void state_get_value(StateReader& reader, T& value) {
+  static_assert(std::is_trivially_copyable<T>::value, "State values are copied as bytes.");
+  state_get(reader, &value, sizeof(T));
+}
+
+void state_write_section(std::vector<uint8_t>& out, uint32_t tag, std::vector<uint8_t> const& section, bool compress) {
+  StateSectionHeader header = {tag, 0, (uint32_t)section.size(), (uint32_t)section.size()};
+
+  std::vector<uint8_t> compressed;
+  if (compress && section.size() >= STATE_COMPRESSION_MIN_SIZE) {
+    lz_compress(section.data(), section.size(), compressed);
+    if (compressed.size() < section.size()) {
+      header.flags |= STATE_SECTION_COMPRESSED;
+      header.stored_size = (uint32_t)compressed.size();
+    }
+  }
+
+  state_put_value(out, header);
+  if (header.flags & STATE_SECTION_COMPRESSED) {
+    state_put(out, compressed.data(), compressed.size());
+  } else {
+    state_put(out, section.data(), section.size());
+  }
+}
+
+void state_serialize_cpu(CPU& cpu, std::vector<uint8_t>& section) {
+  state_put_value(section, cpu.cycle_count);
+  state_put_value(section, cpu.registers);
+  state_put_value(section, cpu.cpsr);
+  for (CPUOperatingMode mode : STATE_SCPSR_MODES) {
+    state_put_value(section, cpu.mode_to_scpsr[mode]);
+  }
+  state_put_value(section, cpu.banked_registers);
+  state_put_value(section, cpu.halted);
+}
+
+void state_read_cpu(StateCPU& cpu, StateReader& reader) {
+  state_get_value(reader, cpu.cycle_count);
+  state_get_value(reader, cpu.registers);
+  state_get_value(reader, cpu.cpsr);
+  state_get_value(reader, cpu.scpsr_registers);
+  state_get_value(reader, cpu.banked_registers);
+
+  // Appended later, older states never halted.
+  cpu.halted = false;
+  if (reader.offset < reader.size) {
+    state_get_value(reader, cpu.halted);
+  }
+}
 
+void state_apply_cpu(CPU& cpu, StateCPU const& state) {
   cpu.cycle_count = state.cycle_count;
-  cpu.cpsr = state.cpsr;
   memcpy(cpu.registers, state.registers, sizeof(state.registers));
+  cpu.cpsr = state.cpsr;
+  for (int i = 0; i < 5; i++) {
+    cpu.mode_to_scpsr[STATE_SCPSR_MODES[i]] = state.scpsr_registers[i];
+  }
   memcpy(cpu.banked_registers, state.banked_registers, sizeof(state.banked_registers));
+  cpu.halted = state.halted;
+}
 
-  cpu.mode_to_scpsr[FIQ] = state.scpsr_registers[0];
-  cpu.mode_to_scpsr[IRQ] = state.scpsr_registers[1];
-  cpu.mode_to_scpsr[Supervisor] = state.scpsr_registers[2];
-  cpu.mode_to_scpsr[Abort] = state.scpsr_registers[3];
-  cpu.mode_to_scpsr[Undefined] = state.scpsr_registers[4];
+void state_serialize_flash(Flash const& flash, std::vector<uint8_t>& section) {
+  state_put_value(section, flash.command_buffer);
+  state_put_value(section, flash.command_buffer_index);
+  state_put_value(section, flash.bank);
+  state_put_value(section, (uint8_t)flash.mode);
+}
+
+void state_read_flash(Flash& flash, StateReader& reader) {
+  uint8_t mode;
+  state_get_value(reader, flash.command_buffer);
+  state_get_value(reader, flash.command_buffer_index);
+  state_get_value(reader, flash.bank);
+  state_get_value(reader, mode);
+  flash.mode = (FlashMode)mode;
+}
+
+void state_serialize_eeprom(CPU& cpu, std::vector<uint8_t>& section) {
+  state_put_value(section, cpu.eeprom.read_address);
+  state_put_value(section, cpu.eeprom.half_word_buffer);
+  state_put(section, cpu.ram.eeprom, 0x2000);
+}
+
+void state_read_eeprom(StateEEPROM& eeprom, StateReader& reader) {
+  state_get_value(reader, eeprom.eeprom.read_address);
+  state_get_value(reader, eeprom.eeprom.half_word_buffer);
+  eeprom.memory = state_get_data(reader, 0x2000);
+}
+
+void state_apply_eeprom(CPU& cpu, StateEEPROM const& eeprom) {
+  cpu.eeprom = eeprom.eeprom;
+  memcpy(cpu.ram.eeprom, eeprom.memory, 0x2000);
+}
+
+// The scanline buffers are rebuilt for every line, only state carried across lines is kept.
+void state_serialize_gpu(GPU const& gpu, std::vector<uint8_t>& section) {
+  state_put_value(section, gpu.affine_ref_x);
+  state_put_value(section, gpu.affine_ref_y);
+  state_put_value(section, gpu.affine_ref_written);
+  state_put_value(section, gpu.frame_skip_accumulator);
+  state_put_value(section, gpu.render_current_frame);
+  state_put_value(section, gpu.frame_buffer);
+}
+
+void state_read_gpu(StateGPU& gpu, StateReader& reader, uint32_t version) {
+  state_get_value(reader, gpu.affine_ref_x);
+  state_get_value(reader, gpu.affine_ref_y);
+  if (version < 2) {
+    // Version 1 kept the last BGxX/BGxY values seen rather than which registers were written.
+    state_get_data(reader, 4 * sizeof(uint32_t));
+    gpu.affine_ref_written = 0;
+  } else {
+    state_get_value(reader, gpu.affine_ref_written);
+  }
+  state_get_value(reader, gpu.frame_skip_accumulator);
+  state_get_value(reader, gpu.render_current_frame);
+  gpu.frame_buffer = state_get_data(reader, FRAME_BUFFER_SIZE_BYTES);
+}
+
+void state_apply_gpu(GPU& gpu, StateGPU const& state) {
+  memcpy(gpu.affine_ref_x, state.affine_ref_x, sizeof(state.affine_ref_x));
+  memcpy(gpu.affine_ref_y, state.affine_ref_y, sizeof(state.affine_ref_y));
+  gpu.affine_ref_written = state.affine_ref_written;
+  gpu.frame_skip_accumulator = state.frame_skip_accumulator;
+  gpu.render_current_frame = state.render_current_frame;
+
+  // Go through the frame buffer writer, so presenters pick up the lines that changed.
+  uint16_t line[FRAME_WIDTH];
+  for (uint32_t y = 0; y < FRAME_HEIGHT; y++) {
+    memcpy(line, state.frame_buffer + y * sizeof(line), sizeof(line));
+    gpu_write_frame_buffer_line(gpu, y, line);
+  }
+}
+
+void state_serialize_timer(Timer const& timer, std::vector<uint8_t>& section) {
+  state_put_value(section, timer.counters);
+  state_put_value(section, timer.overflow_flags);
+}
+
+void state_read_timer(Timer& timer, StateReader& reader) {
+  state_get_value(reader, timer.counters);
+  state_get_value(reader, timer.overflow_flags);
+}
+
+// The resampler and the rendered samples are output, not emulation state, and are not saved.
+void state_serialize_apu(APU const& apu, std::vector<uint8_t>& section) {
+  state_put_value(section, apu.square);
+  state_put_value(section, apu.wave);
+  state_put_value(section, apu.noise);
+  state_put_value(section, apu.fifos);
+  state_put_value(section, apu.frame_sequencer_cycles);
+  state_put_value(section, apu.frame_sequencer_step);
+  state_put_value(section, apu.rendered_cycle);
+
+  uint32_t event_count = (uint32_t)apu.fifo_events.size();
+  state_put_value(section, event_count);
+  state_put(section, apu.fifo_events.data(), event_count * sizeof(APUFifoEvent));
+}
+
+void state_read_apu(StateAPU& apu, StateReader& reader) {
+  state_get_value(reader, apu.square);
+  state_get_value(reader, apu.wave);
+  state_get_value(reader, apu.noise);
+  state_get_value(reader, apu.fifos);
+  state_get_value(reader, apu.frame_sequencer_cycles);
+  state_get_value(reader, apu.frame_sequencer_step);
+  state_get_value(reader, apu.rendered_cycle);
+
+  uint32_t event_count;
+  state_get_value(reader, event_count);
+  if (event_count > (reader.size - reader.offset) / sizeof(APUFifoEvent)) {
+    throw std::runtime_error("Error: Save state section is truncated.");
+  }
+  apu.fifo_events.resize(event_count);
+  state_get(reader, apu.fifo_events.data(), event_count * sizeof(APUFifoEvent));
+}
+
+void state_apply_apu(APU& apu, StateAPU const& state) {
+  memcpy(apu.square, state.square, sizeof(state.square));
+  apu.wave = state.wave;
+  apu.noise = state.noise;
+  memcpy(apu.fifos, state.fifos, sizeof(state.fifos));
+  apu.frame_sequencer_cycles = state.frame_sequencer_cycles;
+  apu.frame_sequencer_step = state.frame_sequencer_step;
+  apu.rendered_cycle = state.rendered_cycle;
+  apu.fifo_events = state.fifo_events;
+
+  // Restart the output from silence rather than from the audio of the previous state.
+  apu.samples.clear();
+  apu_set_sample_rate(apu, apu.sample_rate);
+}
+
+void state_serialize(GBA& gba, std::vector<uint8_t>& out, bool compress) {
+  CPU& cpu = gba.cpu;
+  GPU& gpu = gba.gpu;
+  Timer& timer = gba.timer;
+  APU& apu = gba.apu;
+
+  gba_settle(gba);
+
+  StateHeader header;
+  memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+  header.version = STATE_VERSION;
+  header.section_count = 0;
+
+  // The header is filled in once the sections are counted.
+  out.assign(sizeof(header), 0);
+
+  std::vector<uint8_t> section;
+  auto write_section = [&](uint32_t tag) {
+    state_write_section(out, tag, section, compress);
+    header.section_count++;
+    section.clear();
+  };
+
+  state_serialize_cpu(cpu, section);
+  write_section(STATE_TAG_CPU);
+
+  for (StateRegion const& region : STATE_REGIONS) {
+    state_put(section, cpu.ram.*region.memory, region.size);
+    write_section(region.tag);
+  }
+
+  state_serialize_flash(cpu.flash, section);
+  write_section(STATE_TAG_FLASH);
+  state_serialize_eeprom(cpu, section);
+  write_section(STATE_TAG_EEPROM);
+  state_serialize_gpu(gpu, section);
+  write_section(STATE_TAG_GPU);
+  state_serialize_timer(timer, section);
+  write_section(STATE_TAG_TIMER);
+  state_serialize_apu(apu, section);
+  write_section(STATE_TAG_APU);
+
+  memcpy(out.data(), &header, sizeof(header));
+}
+
+void state_deserialize_legacy(CPU& cpu, uint8_t const* data) {
+  LegacySaveState const& state = *(LegacySaveState const*)data;
+
+  cpu.cycle_count = state.cycle_count;
+  cpu.halted = false;
+  cpu.cpsr = state.cpsr;
+  memcpy(cpu.registers, state.registers, sizeof(state.registers));
+  memcpy(cpu.banked_registers, state.banked_registers, sizeof(state.banked_registers));
+  for (int i = 0; i < 5; i++) {
+    cpu.mode_to_scpsr[STATE_SCPSR_MODES[i]] = state.scpsr_registers[i];
+  }
 
   memcpy(cpu.ram.external_working_ram, state.external_working_ram, sizeof(state.external_working_ram));
   memcpy(cpu.ram.internal_working_ram, state.internal_working_ram, sizeof(state.internal_working_ram));
@@ -80,3 +440,128 @@ void load_state(CPU& cpu, std::string const& state_file_path) {
   memcpy(cpu.ram.object_attribute_memory, state.oam, sizeof(state.oam));
   memcpy(cpu.ram.game_pak_sram, state.game_pak_sram, sizeof(state.game_pak_sram));
 }
+
+void state_deserialize(GBA& gba, uint8_t const* data, size_t size) {
+  CPU& cpu = gba.cpu;
+  GPU& gpu = gba.gpu;
+  Timer& timer = gba.timer;
+  APU& apu = gba.apu;
+
+  StateHeader header;
+  if (size < sizeof(header) || memcmp(data, STATE_MAGIC, sizeof(STATE_MAGIC)) != 0) {
+    if (size != sizeof(LegacySaveState)) {
+      throw std::runtime_error("Error: Not a save state.");
+    }
+    state_deserialize_legacy(cpu, data);
+    ram_mark_all_video_memory_dirty(cpu.ram);
+    ram_mark_all_pages_dirty(cpu.ram);
+    ram_mark_save_memory_written(cpu.ram);
+    return;
+  }
+
+  memcpy(&header, data, sizeof(header));
+  if (header.version > STATE_VERSION) {
+    throw std::runtime_error("Error: Save state version " + std::to_string(header.version) + " is newer than this emulator.");
+  }
+
+  // Decode and read every section before touching the emulator, so a damaged file leaves it as it was.
+  std::vector<std::pair<uint32_t, std::vector<uint8_t>>> sections;
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.section_count; i++) {
+    StateSectionHeader section_header;
+    if (size - offset < sizeof(section_header)) {
+      throw std::runtime_error("Error: Save state is truncated.");
+    }
+    memcpy(&section_header, data + offset, sizeof(section_header));
+    offset += sizeof(section_header);
+    if (size - offset < section_header.stored_size) {
+      throw std::runtime_error("Error: Save state is truncated.");
+    }
+    if (section_header.size > STATE_MAX_SECTION_SIZE) {
+      throw std::runtime_error("Error: Save state section is corrupted.");
+    }
+
+    std::vector<uint8_t> section(section_header.size);
+    if (section_header.flags & STATE_SECTION_COMPRESSED) {
+      if (!lz_decompress(data + offset, section_header.stored_size, section.data(), section.size())) {
+        throw std::runtime_error("Error: Save state section is corrupted.");
+      }
+    } else if (section_header.stored_size == section_header.size) {
+      memcpy(section.data(), data + offset, section.size());
+    } else {
+      throw std::runtime_error("Error: Save state section is corrupted.");
+    }
+    offset += section_header.stored_size;
+
+    sections.emplace_back(section_header.tag, std::move(section));
+  }
+
+  StateContents contents;
+  for (auto const& [tag, section] : sections) {
+    StateReader reader = {section.data(), section.size()};
+
+    bool is_region = false;
+    for (size_t i = 0; i < std::size(STATE_REGIONS); i++) {
+      if (STATE_REGIONS[i].tag != tag) continue;
+      contents.regions[i] = state_get_data(reader, STATE_REGIONS[i].size);
+      is_region = true;
+    }
+    if (is_region) {
+      state_check_read_all(reader);
+      continue;
+    }
+
+    switch (tag) {
+      case STATE_TAG_CPU: state_read_cpu(contents.cpu, reader); contents.has_cpu = true; break;
+      case STATE_TAG_FLASH: state_read_flash(contents.flash, reader); contents.has_flash = true; break;
+      case STATE_TAG_EEPROM: state_read_eeprom(contents.eeprom, reader); contents.has_eeprom = true; break;
+      case STATE_TAG_GPU: state_read_gpu(contents.gpu, reader, header.version); contents.has_gpu = true; break;
+      case STATE_TAG_TIMER: state_read_timer(contents.timer, reader); contents.has_timer = true; break;
+      case STATE_TAG_APU: state_read_apu(contents.apu, reader); contents.has_apu = true; break;
+      // Sections from newer versions.
+      default: continue;
+    }
+    state_check_read_all(reader);
+  }
+
+  // Everything was read, nothing below can fail.
+  for (size_t i = 0; i < std::size(STATE_REGIONS); i++) {
+    if (contents.regions[i] != nullptr) {
+      memcpy(cpu.ram.*STATE_REGIONS[i].memory, contents.regions[i], STATE_REGIONS[i].size);
+    }
+  }
+  if (contents.has_cpu) state_apply_cpu(cpu, contents.cpu);
+  if (contents.has_flash) cpu.flash = contents.flash;
+  if (contents.has_eeprom) state_apply_eeprom(cpu, contents.eeprom);
+  if (contents.has_gpu) state_apply_gpu(gpu, contents.gpu);
+  if (contents.has_timer) timer = contents.timer;
+  if (contents.has_apu) state_apply_apu(apu, contents.apu);
+
+  // Video memory was replaced wholesale, so anything decoded or copied from it is stale.
+  ram_mark_all_video_memory_dirty(cpu.ram);
+  ram_mark_all_pages_dirty(cpu.ram);
+  ram_mark_save_memory_written(cpu.ram);
+}
+
+void save_state(GBA& gba, std::string const& state_file_path, bool compress) {
+  std::vector<uint8_t> data;
+  state_serialize(gba, data, compress);
+
+  std::ofstream file(state_file_path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Error: Could not open file " + state_file_path);
+  }
+  file.write((char const*)data.data(), data.size());
+  file.close();
+}
+
+void load_state(GBA& gba, std::string const& state_file_path) {
+  std::ifstream file(state_file_path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Error: Could not open file " + state_file_path);
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  file.close();
+
+  state_deserialize(gba, data.data(), data.size());
+}
@@ -1,6 +1,17 @@
 #pragma once
 
-#include "cpu.h"
+#include "gba.h"
 
-void save_state(CPU& cpu, std::string const& state_file_path);
-void load_state(CPU& cpu, std::string const& state_file_path);
+// Save states are a header followed by tagged sections, one per subsystem or memory region.
+// Sections with unknown tags are skipped on load, so newer versions can add state without breaking older files.
+static constexpr uint32_t STATE_VERSION = 2;
+
+// Sections are compressed individually, and only kept compressed when that makes them smaller.
+void save_state(GBA& gba, std::string const& state_file_path, bool compress = true);
+
+// Also reads the unversioned states written before the sectioned format, which only hold the CPU and memory.
+void load_state(GBA& gba, std::string const& state_file_path);
+
+// The same format in memory, `out` is replaced with the state.
+void state_serialize(GBA& gba, std::vector<uint8_t>& out, bool compress);
+void state_deserialize(GBA& gba, uint8_t const* data, size_t size);
@@ -0,0 +1,76 @@
+#include "tile_cache.h"
+#include <cstring>
+
+static constexpr uint8_t TRANSPARENT_TILE[TILE_CACHE_PIXELS_PER_TILE] = {};
+
+void tile_cache_invalidate_all(TileCache& cache) {
+  memset(cache.valid_4bpp, 0, sizeof(cache.valid_4bpp));
+  memset(cache.valid_8bpp, 0, sizeof(cache.valid_8bpp));
+}
+
+void tile_cache_sync(TileCache& cache, uint64_t* vram_dirty_blocks) {
+  for (uint32_t word = 0; word < VRAM_DIRTY_BITMAP_WORDS; word++) {
+    uint64_t dirty = vram_dirty_blocks[word];
+    if (dirty == 0) continue;
+    vram_dirty_blocks[word] = 0;
+
+    // Dirty blocks map 1:1 to 4bpp tiles.
+    cache.valid_4bpp[word] &= ~dirty;
+
+    // Each 8bpp tile covers two blocks, so fold pairs of bits together.
+    uint64_t dirty_pairs = (dirty | (dirty >> 1)) & 0x5555555555555555ULL;
+    uint32_t first_8bpp_tile = word * 32;
+    while (dirty_pairs) {
+      uint32_t bit = __builtin_ctzll(dirty_pairs);
+      uint32_t tile = first_8bpp_tile + bit / 2;
+      cache.valid_8bpp[tile >> 6] &= ~(1ULL << (tile & 63));
+      dirty_pairs &= dirty_pairs - 1;
+    }
+  }
+}
+
+inline void tile_cache_expand_tile(uint8_t const* tile_data, bool is_256_color_mode, uint8_t (&out)[2][TILE_CACHE_PIXELS_PER_TILE]) {
+  uint8_t* normal = out[0];
+  uint8_t* flipped = out[1];
+
+  if (is_256_color_mode) {
+    memcpy(normal, tile_data, TILE_CACHE_PIXELS_PER_TILE);
+  } else {
+    // Two pixels per byte, low nibble first.
+    for (int i = 0; i < 32; i++) {
+      normal[i * 2] = tile_data[i] & 0xF;
+      normal[i * 2 + 1] = tile_data[i] >> 4;
+    }
+  }
+
+  for (int y = 0; y < 8; y++) {
+    for (int x = 0; x < 8; x++) {
+      flipped[y * 8 + x] = normal[y * 8 + 7 - x];
+    }
+  }
+}
+
+uint8_t const* tile_cache_get_tile(
+  TileCache& cache,
+  uint8_t const* vram,
+  uint32_t tile_address,
+  bool is_256_color_mode,
+  bool horizontal_flip
+) {
+  uint32_t tile_size_bytes = is_256_color_mode ? 64 : 32;
+  if (tile_address + tile_size_bytes > VRAM_SIZE) {
+    return TRANSPARENT_TILE;
+  }
+
+  uint32_t tile = tile_address / tile_size_bytes;
+  uint64_t* valid = is_256_color_mode ? cache.valid_8bpp : cache.valid_4bpp;
+  auto& entry = is_256_color_mode ? cache.tiles_8bpp[tile] : cache.tiles_4bpp[tile];
+
+  uint64_t mask = 1ULL << (tile & 63);
+  if ((valid[tile >> 6] & mask) == 0) {
+    tile_cache_expand_tile(vram + tile_address, is_256_color_mode, entry);
+    valid[tile >> 6] |= mask;
+  }
+
+  return entry[horizontal_flip ? 1 : 0];
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include "ram.h"
+
+static constexpr uint32_t TILE_CACHE_PIXELS_PER_TILE = 64;
+static constexpr uint32_t TILE_CACHE_4BPP_TILES = VRAM_SIZE / 32;
+static constexpr uint32_t TILE_CACHE_8BPP_TILES = VRAM_SIZE / 64;
+
+// Cache of VRAM tiles expanded to one palette index per pixel (8x8 bytes).
+// Each tile is stored as-is and flipped horizontally, vertical flips only need to pick a different row.
+// Entries are keyed by the VRAM address of the tile and invalidated per tile using the RAM dirty bitmap.
+struct TileCache {
+  uint8_t tiles_4bpp[TILE_CACHE_4BPP_TILES][2][TILE_CACHE_PIXELS_PER_TILE];
+  uint8_t tiles_8bpp[TILE_CACHE_8BPP_TILES][2][TILE_CACHE_PIXELS_PER_TILE];
+
+  uint64_t valid_4bpp[TILE_CACHE_4BPP_TILES / 64];
+  uint64_t valid_8bpp[TILE_CACHE_8BPP_TILES / 64];
+};
+
+void tile_cache_invalidate_all(TileCache& cache);
+
+// Invalidate every tile touched by the blocks set in the dirty bitmap, then clear the bitmap.
+void tile_cache_sync(TileCache& cache, uint64_t* vram_dirty_blocks);
+
+// Returns the expanded 8x8 palette indices of the tile at the given VRAM offset.
+// Tiles that would read past the end of VRAM resolve to a fully transparent tile.
+uint8_t const* tile_cache_get_tile(
+  TileCache& cache,
+  uint8_t const* vram,
+  uint32_t tile_address,
+  bool is_256_color_mode,
+  bool horizontal_flip
+);
@@ -1,4 +1,5 @@
 #include "timer.h"
+#include "gba.h"
 
 #define TMXCNT_L(x) 0x4000100 + (x * 4)
 #define TMXCNT_H(x) 0x4000102 + (x * 4)
@@ -44,18 +45,19 @@ static constexpr std::array<uint32_t, 4> TM_PRESCALER_VALUES = {
 
 static constexpr uint16_t TM_CNT_H_ENABLE_FLAG = 1 << 7;
 
-void timer_init(CPU& cpu, Timer& timer) {
+void timer_init(GBA& gba) {
   for (int i = 0; i < 4; ++i) {
     // Initialize the counters.
-    timer.counters[i] = 0;
+    gba.timer.counters[i] = 0;
 
-    ram_register_read_hook(cpu.ram, TM_CNT_L[i], [i, &timer](RAM& ram, uint32_t address) {
+    ram_register_read_hook(gba.cpu.ram, TM_CNT_L[i], [i](RAM& ram, uint32_t address) {
       // RAM Read returns the counter value.
-      return timer.counters[i];
+      return ram.gba->timer.counters[i];
     });
 
     // Make sure the counter is reset with the <reload> value if the timer is enabled.
-    ram_register_write_hook(cpu.ram, TM_CNT_H[i], [i, &timer](RAM& ram, uint32_t address, uint32_t value) {
+    ram_register_write_hook(gba.cpu.ram, TM_CNT_H[i], [i](RAM& ram, uint32_t address, uint32_t value, uint32_t) {
+      Timer& timer = ram.gba->timer;
       uint16_t prev_value = ram_read_half_word_direct(ram, TM_CNT_H[i]);
       if (
         (prev_value & TM_CNT_H_ENABLE_FLAG) == 0 &&
@@ -7,5 +7,8 @@ struct Timer {
   bool overflow_flags[4] = {false, false, false, false};
 };
 
-void timer_init(CPU& cpu, Timer& timer);
+struct GBA;
+
+// Registers the timer register hooks on the instance's RAM.
+void timer_init(GBA& gba);
 void timer_tick(CPU& cpu, Timer& timer);
@@ -0,0 +1,63 @@
+#include "wav_sink.h"
+#include <cstring>
+#include <stdexcept>
+
+static constexpr uint32_t WAV_CHANNELS = 2;
+static constexpr uint32_t WAV_BYTES_PER_FRAME = WAV_CHANNELS * sizeof(int16_t);
+static constexpr uint32_t WAV_HEADER_SIZE = 44;
+
+inline void wav_put_u16(uint8_t* dest, uint16_t value) {
+  dest[0] = value & 0xFF;
+  dest[1] = value >> 8;
+}
+
+inline void wav_put_u32(uint8_t* dest, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    dest[i] = (value >> (i * 8)) & 0xFF;
+  }
+}
+
+void wav_write_header(WavSink& sink) {
+  uint32_t data_size = (uint32_t)(sink.frames_written * WAV_BYTES_PER_FRAME);
+
+  uint8_t header[WAV_HEADER_SIZE];
+  memcpy(header, "RIFF", 4);
+  wav_put_u32(header + 4, WAV_HEADER_SIZE - 8 + data_size);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  wav_put_u32(header + 16, 16);
+  wav_put_u16(header + 20, 1); // PCM
+  wav_put_u16(header + 22, WAV_CHANNELS);
+  wav_put_u32(header + 24, sink.sample_rate);
+  wav_put_u32(header + 28, sink.sample_rate * WAV_BYTES_PER_FRAME);
+  wav_put_u16(header + 32, WAV_BYTES_PER_FRAME);
+  wav_put_u16(header + 34, 16);
+  memcpy(header + 36, "data", 4);
+  wav_put_u32(header + 40, data_size);
+
+  sink.file.seekp(0);
+  sink.file.write((char const*)header, WAV_HEADER_SIZE);
+}
+
+void wav_sink_open(WavSink& sink, std::string const& path, uint32_t sample_rate) {
+  sink.file.open(path, std::ios::binary | std::ios::trunc);
+  if (!sink.file.is_open()) {
+    throw std::runtime_error("Error: Could not open file " + path);
+  }
+
+  sink.sample_rate = sample_rate;
+  sink.frames_written = 0;
+  wav_write_header(sink);
+}
+
+void wav_sink_write(WavSink& sink, int16_t const* samples, uint32_t frames) {
+  // WAV data is little endian, like every host this builds for.
+  sink.file.write((char const*)samples, frames * WAV_BYTES_PER_FRAME);
+  sink.frames_written += frames;
+}
+
+void wav_sink_close(WavSink& sink) {
+  if (!sink.file.is_open()) return;
+
+  wav_write_header(sink);
+  sink.file.close();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+
+// Writes 16 bit stereo PCM to a WAV file. The header sizes are filled in on close.
+struct WavSink {
+  std::ofstream file;
+  uint32_t sample_rate = 0;
+  uint64_t frames_written = 0;
+};
+
+void wav_sink_open(WavSink& sink, std::string const& path, uint32_t sample_rate);
+void wav_sink_write(WavSink& sink, int16_t const* samples, uint32_t frames);
+void wav_sink_close(WavSink& sink);
@@ -0,0 +1,105 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <gba.h>
+
+// b . - keeps the CPU busy without touching memory, the test does the writes a game would.
+static constexpr uint32_t LOOP_BIOS = 0xEAFFFFFE;
+
+static constexpr int32_t AFFINE_PB = 0x0100;
+static constexpr int32_t AFFINE_PD = -0x0080;
+
+static uint8_t affine_test_line(GBA& gba) {
+  return ram_read_byte(gba.cpu.ram, REG_VERTICAL_COUNT);
+}
+
+// Runs until VCOUNT moves on, the line it was on has then been drawn.
+static void affine_test_run_line(GBA& gba) {
+  uint8_t line = affine_test_line(gba);
+  while (affine_test_line(gba) == line) {
+    gba_cycle(gba);
+  }
+}
+
+static void affine_test_run_to_line(GBA& gba, uint8_t line) {
+  while (affine_test_line(gba) != line) {
+    affine_test_run_line(gba);
+  }
+}
+
+static GBA* affine_test_create() {
+  GBA* gba = gba_create();
+  gba_load_bios_from_memory(gba, &LOOP_BIOS, sizeof(LOOP_BIOS));
+  ram_write_half_word(gba->cpu.ram, REG_BG2_PARAM_B, (uint16_t)AFFINE_PB);
+  ram_write_half_word(gba->cpu.ram, REG_BG2_PARAM_D, (uint16_t)AFFINE_PD);
+  return gba;
+}
+
+TEST_CASE("Affine Reference Points", "[gpu]") {
+  GBA* gba = affine_test_create();
+  RAM& ram = gba->cpu.ram;
+  GPU& gpu = gba->gpu;
+
+  SECTION("VBlank Latch") {
+    affine_test_run_to_line(*gba, 10);
+    ram_write_word(ram, REG_BG2_X_REF, 0x00012300);
+    // 28 bit signed, this is -0x1000.
+    ram_write_word(ram, REG_BG2_Y_REF, 0x0FFFF000);
+
+    // Advanced by PB/PD after every visible line from the write on.
+    affine_test_run_to_line(*gba, 100);
+    REQUIRE(gpu.affine_ref_x[0] == 0x12300 + 90 * AFFINE_PB);
+    REQUIRE(gpu.affine_ref_y[0] == -0x1000 + 90 * AFFINE_PD);
+
+    // VBlank reloads the registers for the next frame, and the lines in it don't advance them.
+    affine_test_run_to_line(*gba, 200);
+    REQUIRE(gpu.affine_ref_x[0] == 0x12300);
+    REQUIRE(gpu.affine_ref_y[0] == -0x1000);
+
+    affine_test_run_to_line(*gba, 1);
+    REQUIRE(gpu.affine_ref_x[0] == 0x12300 + AFFINE_PB);
+    REQUIRE(gpu.affine_ref_y[0] == -0x1000 + AFFINE_PD);
+  }
+
+  SECTION("Mid-Frame Write") {
+    ram_write_word(ram, REG_BG2_X_REF, 0x4000);
+    ram_write_word(ram, REG_BG2_Y_REF, 0x8000);
+    affine_test_run_to_line(*gba, 50);
+    int32_t y_before = gpu.affine_ref_y[0];
+
+    // Only BG2X is written, it replaces the advanced point from the next line on. BG2Y keeps going.
+    ram_write_word(ram, REG_BG2_X_REF, 0x0200);
+    REQUIRE(gpu.affine_ref_x[0] == 0x4000 + 50 * AFFINE_PB);
+    affine_test_run_line(*gba);
+    REQUIRE(gpu.affine_ref_x[0] == 0x0200 + AFFINE_PB);
+    REQUIRE(gpu.affine_ref_y[0] == y_before + AFFINE_PD);
+
+    // A byte write reloads the whole register.
+    ram_write_byte(ram, REG_BG2_X_REF + 1, 0x03);
+    affine_test_run_line(*gba);
+    REQUIRE(gpu.affine_ref_x[0] == 0x0300 + AFFINE_PB);
+  }
+
+  SECTION("Skipped Frames") {
+    // One frame drawn in three, the reference points follow the same path as when every frame is drawn.
+    GBA* skipping = affine_test_create();
+    gpu_set_frame_skip(skipping->gpu, 1, 3);
+
+    uint32_t skipped_lines = 0;
+    for (uint32_t line = 0; line < 3 * 228; line++) {
+      if (line % 228 == 30) {
+        ram_write_word(ram, REG_BG2_X_REF, 0x1000 + line);
+        ram_write_word(skipping->cpu.ram, REG_BG2_X_REF, 0x1000 + line);
+      }
+      affine_test_run_line(*gba);
+      affine_test_run_line(*skipping);
+      skipped_lines += skipping->gpu.render_current_frame ? 0 : 1;
+
+      REQUIRE(skipping->gpu.affine_ref_x[0] == gpu.affine_ref_x[0]);
+      REQUIRE(skipping->gpu.affine_ref_y[0] == gpu.affine_ref_y[0]);
+    }
+    REQUIRE(skipped_lines >= 2 * 228 - 1);
+    gba_destroy(skipping);
+  }
+
+  gba_destroy(gba);
+}
@@ -0,0 +1,114 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <gba.h>
+
+// b . - keeps the CPU busy without touching memory, the test does the writes a game would.
+static constexpr uint32_t LOOP_BIOS = 0xEAFFFFFE;
+
+static constexpr uint16_t SOUND_MASTER_ENABLE = 1 << 7;
+static constexpr uint16_t SOUND_RESTART = 1 << 15;
+static constexpr uint16_t SOUND_LENGTH_ENABLE = 1 << 14;
+
+// Runs whole cycles and renders the audio up to where it stopped.
+static void apu_test_run(GBA& gba, uint32_t cycles) {
+  for (uint32_t i = 0; i < cycles; i++) {
+    gba_cycle(gba);
+  }
+  gba_settle(gba);
+}
+
+// The sample bytes the DMA source holds, all different over the range the test plays.
+static int8_t apu_test_sample(uint32_t index) {
+  return (int8_t)(index * 7 + 3);
+}
+
+TEST_CASE("APU", "[apu]") {
+  GBA* gba = gba_create();
+  RAM& ram = gba->cpu.ram;
+  APU& apu = gba->apu;
+  gba_load_bios_from_memory(gba, &LOOP_BIOS, sizeof(LOOP_BIOS));
+  ram_write_half_word(ram, REG_SOUND_CONTROL_X, SOUND_MASTER_ENABLE);
+
+  SECTION("FIFO Refilled By Sound DMA") {
+    for (uint32_t i = 0; i < 0x400; i++) {
+      ram_write_byte(ram, 0x2000000 + i, (uint8_t)apu_test_sample(i));
+    }
+
+    // FIFO A on both sides at full volume, played on timer 0 overflows every 256 cycles.
+    ram_write_half_word(ram, REG_SOUND_CONTROL_H, (1 << 2) | (1 << 8) | (1 << 9));
+    ram_write_word(ram, REG_DMA1_SOURCE_ADDRESS, 0x2000000);
+    ram_write_word(ram, REG_DMA1_DESTINATION_ADDRESS, REG_FIFO_A);
+    // Enabled, sound FIFO start, repeat, 32 bit units, fixed destination.
+    ram_write_half_word(ram, REG_DMA1_CONTROL, (1 << 15) | (3 << 12) | (1 << 10) | (1 << 9) | (2 << 5));
+    ram_write_half_word(ram, REG_TIMER0_COUNTER_RELOAD, 0xFF00);
+    ram_write_half_word(ram, REG_TIMER0_CONTROL, 1 << 7);
+
+    for (uint32_t block = 0; block < 8; block++) {
+      apu_test_run(*gba, 256 * 20 + 100);
+
+      // Every byte the DMA moved is either played or still waiting in the FIFO.
+      uint32_t transferred = ram_read_word(ram, REG_DMA1_SOURCE_ADDRESS) - 0x2000000;
+      uint32_t played = transferred - apu.fifos[0].count;
+      REQUIRE(transferred % 16 == 0);
+      REQUIRE(apu.fifos[0].count >= 16);
+      REQUIRE(played > 0);
+      REQUIRE(apu.fifos[0].sample == apu_test_sample(played - 1));
+      REQUIRE(apu.fifos[0].data[apu.fifos[0].read_index] == apu_test_sample(played));
+    }
+    // 8 blocks of 20 overflows went through the FIFO, several refills each.
+    REQUIRE(ram_read_word(ram, REG_DMA1_SOURCE_ADDRESS) - 0x2000000 >= 160);
+    // Repeating, so the DMA stays enabled.
+    REQUIRE(ram_read_half_word(ram, REG_DMA1_CONTROL) & (1 << 15));
+  }
+
+  SECTION("FIFO Reset") {
+    ram_write_word(ram, REG_FIFO_A, 0x04030201);
+    ram_write_word(ram, REG_FIFO_A, 0x08070605);
+    ram_write_word(ram, REG_FIFO_B, 0x0C0B0A09);
+    REQUIRE(apu.fifos[0].count == 8);
+    REQUIRE(apu.fifos[1].count == 4);
+
+    // The reset bits empty their FIFO and read back as zero.
+    ram_write_half_word(ram, REG_SOUND_CONTROL_H, (1 << 11) | (1 << 8));
+    REQUIRE(apu.fifos[0].count == 0);
+    REQUIRE(apu.fifos[1].count == 4);
+    REQUIRE(ram_read_half_word(ram, REG_SOUND_CONTROL_H) == (1 << 8));
+
+    ram_write_half_word(ram, REG_SOUND_CONTROL_H, 1 << 15);
+    REQUIRE(apu.fifos[1].count == 0);
+    REQUIRE(ram_read_half_word(ram, REG_SOUND_CONTROL_H) == 0);
+
+    // Refilling starts from the front again.
+    ram_write_word(ram, REG_FIFO_A, 0x44332211);
+    REQUIRE(apu.fifos[0].count == 4);
+    REQUIRE(apu.fifos[0].data[apu.fifos[0].read_index] == 0x11);
+  }
+
+  SECTION("Square Length And Envelope") {
+    // Length 4, volume 15 going down a step on every envelope clock.
+    ram_write_half_word(ram, REG_SOUND2_DUTY_LENGTH, (15 << 12) | (1 << 8) | 60);
+    ram_write_half_word(ram, REG_SOUND2_FREQUENCY, SOUND_RESTART | SOUND_LENGTH_ENABLE | 0x400);
+    REQUIRE(apu.square[1].enabled);
+    REQUIRE(apu.square[1].length == 4);
+    REQUIRE(apu.square[1].envelope.volume == 15);
+    REQUIRE((ram_read_half_word(ram, REG_SOUND_CONTROL_X) & 2) != 0);
+
+    // Each frame sequencer period is one step, lengths are clocked on every other step and envelopes on one in 8.
+    apu_test_run(*gba, 6 * APU_FRAME_SEQUENCER_PERIOD);
+    REQUIRE(apu.square[1].enabled);
+    REQUIRE(apu.square[1].length == 1);
+
+    apu_test_run(*gba, 2 * APU_FRAME_SEQUENCER_PERIOD);
+    REQUIRE_FALSE(apu.square[1].enabled);
+    REQUIRE(apu.square[1].envelope.volume == 14);
+    REQUIRE((ram_read_half_word(ram, REG_SOUND_CONTROL_X) & 2) == 0);
+
+    // Without the length enabled it plays on while the envelope fades.
+    ram_write_half_word(ram, REG_SOUND2_FREQUENCY, SOUND_RESTART | 0x400);
+    apu_test_run(*gba, 40 * APU_FRAME_SEQUENCER_PERIOD);
+    REQUIRE(apu.square[1].enabled);
+    REQUIRE(apu.square[1].envelope.volume == 10);
+  }
+
+  gba_destroy(gba);
+}
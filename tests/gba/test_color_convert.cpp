@@ -0,0 +1,71 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <gba.h>
+#include <color_convert.h>
+
+TEST_CASE("Color Conversion", "[color]") {
+  ColorFormat format = GENERATE(COLOR_FORMAT_RGBA8888, COLOR_FORMAT_BGRA8888, COLOR_FORMAT_RGB565);
+  uint32_t bytes_per_pixel = color_bytes_per_pixel(format);
+
+  // Without correction the table is filled one color at a time by the scalar conversion.
+  ColorTable* table = new ColorTable;
+  color_build_table(*table, format, false);
+
+  // Every color, once plain and once with ENABLE_PIXEL set, which is ignored.
+  std::vector<uint16_t> colors(2 * COLOR_TABLE_SIZE);
+  for (uint32_t i = 0; i < colors.size(); i++) {
+    colors[i] = (uint16_t)(i < COLOR_TABLE_SIZE ? i : (i - COLOR_TABLE_SIZE) | ENABLE_PIXEL);
+  }
+
+  SECTION("Every Color") {
+    std::vector<uint8_t> expected(colors.size() * bytes_per_pixel);
+    std::vector<uint8_t> converted(colors.size() * bytes_per_pixel);
+    color_convert_pixels(colors.data(), (uint32_t)colors.size(), format, expected.data(), table);
+    color_convert_pixels(colors.data(), (uint32_t)colors.size(), format, converted.data());
+    REQUIRE(memcmp(converted.data(), expected.data(), expected.size()) == 0);
+
+    // Starting off the vector alignment and ending in the middle of a vector, so the scalar tail runs too.
+    color_convert_pixels(colors.data() + 1, 29, format, converted.data());
+    REQUIRE(memcmp(converted.data(), expected.data() + bytes_per_pixel, 29 * bytes_per_pixel) == 0);
+  }
+
+  SECTION("Known Colors") {
+    uint16_t const known[3] = {0x7FFF, 0x001F, 0x7C00};
+    uint32_t converted[3] = {};
+    color_convert_pixels(known, 3, format, converted);
+    if (format == COLOR_FORMAT_RGB565) {
+      uint16_t const* pixels = (uint16_t const*)converted;
+      REQUIRE(pixels[0] == 0xFFFF);
+      REQUIRE(pixels[1] == 0xF800);
+      REQUIRE(pixels[2] == 0x001F);
+    } else {
+      bool rgba = format == COLOR_FORMAT_RGBA8888;
+      REQUIRE(converted[0] == 0xFFFFFFFF);
+      REQUIRE(converted[1] == (rgba ? 0xFF0000FF : 0xFFFF0000));
+      REQUIRE(converted[2] == (rgba ? 0xFFFF0000 : 0xFF0000FF));
+    }
+  }
+
+  SECTION("Frame Buffer") {
+    GBA* gba = gba_create();
+    for (uint32_t y = 0; y < FRAME_HEIGHT; y++) {
+      for (uint32_t x = 0; x < FRAME_WIDTH; x++) {
+        gba->gpu.frame_buffer[y * FRAME_BUFFER_PITCH + x] = colors[(y * FRAME_WIDTH + x) * 7 % colors.size()];
+      }
+    }
+
+    // Packed rows and rows with padding after them.
+    for (uint32_t padding : {0u, 12u}) {
+      uint32_t pitch = FRAME_WIDTH * bytes_per_pixel + padding;
+      std::vector<uint8_t> expected(FRAME_HEIGHT * pitch), converted(FRAME_HEIGHT * pitch);
+      color_convert_frame_buffer(gba->gpu, format, expected.data(), pitch, table);
+      color_convert_frame_buffer(gba->gpu, format, converted.data(), pitch);
+      REQUIRE(memcmp(converted.data(), expected.data(), expected.size()) == 0);
+    }
+    gba_destroy(gba);
+  }
+
+  delete table;
+}
@@ -0,0 +1,67 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <emulator_pool.h>
+#include <state_io.h>
+
+// Folds KEYINPUT into a running value forever, storing it to 0x2000000 and to the backdrop color,
+// so the state and the frame both depend on the keys held.
+//   mov r0, #0x4000000; mov r1, #0x2000000; mov r3, #0x5000000; mov r4, #0; add r5, r0, #0x130
+//   loop: ldrh r2, [r5]; add r4, r4, r2; add r4, r4, r4, lsl #1; str r4, [r1]; strh r4, [r3]; b loop
+static constexpr uint32_t KEY_MIXER_BIOS[] = {
+  0xE3A00301, 0xE3A01402, 0xE3A03405, 0xE3A04000, 0xE2805E13,
+  0xE1D520B0, 0xE0844002, 0xE0844084, 0xE5814000, 0xE1C340B0, 0xEAFFFFF9
+};
+
+static constexpr uint32_t POOL_INSTANCES = 6;
+static constexpr uint32_t POOL_RUNS = 3;
+static constexpr uint32_t POOL_FRAMES_PER_RUN = 2;
+
+static uint16_t pool_test_keys(uint32_t instance, uint32_t run) {
+  return (uint16_t)((instance * 0x45 + run * 0x13) & 0x3FF);
+}
+
+TEST_CASE("Emulator Pool", "[pool]") {
+  uint32_t thread_count = GENERATE(1u, 3u);
+  EmulatorPool* pool = emulator_pool_create(POOL_INSTANCES, thread_count);
+
+  // The same instances stepped one after another on this thread.
+  std::vector<GBA*> serial;
+  for (uint32_t i = 0; i < POOL_INSTANCES; i++) {
+    serial.push_back(gba_create());
+    apu_set_enabled(serial[i]->apu, false);
+    gba_load_bios_from_memory(serial[i], KEY_MIXER_BIOS, sizeof(KEY_MIXER_BIOS));
+    gba_load_bios_from_memory(pool->instances[i], KEY_MIXER_BIOS, sizeof(KEY_MIXER_BIOS));
+  }
+
+  for (uint32_t run = 0; run < POOL_RUNS; run++) {
+    for (uint32_t i = 0; i < POOL_INSTANCES; i++) {
+      emulator_pool_set_keys(*pool, i, pool_test_keys(i, run));
+      for (uint32_t frame = 0; frame < POOL_FRAMES_PER_RUN; frame++) {
+        gba_set_keys(*serial[i], pool_test_keys(i, run));
+        gba_run_frame(*serial[i]);
+      }
+    }
+    emulator_pool_run_frames(*pool, POOL_FRAMES_PER_RUN);
+  }
+
+  for (uint32_t i = 0; i < POOL_INSTANCES; i++) {
+    std::vector<uint8_t> expected, pooled;
+    state_serialize(*serial[i], expected, false);
+    state_serialize(*pool->instances[i], pooled, false);
+    REQUIRE(pooled.size() == expected.size());
+    REQUIRE(memcmp(pooled.data(), expected.data(), expected.size()) == 0);
+    REQUIRE(memcmp(pool->instances[i]->gpu.frame_buffer, serial[i]->gpu.frame_buffer, sizeof(serial[i]->gpu.frame_buffer)) == 0);
+  }
+
+  // The keys made a difference, each instance ran its own input.
+  for (uint32_t i = 1; i < POOL_INSTANCES; i++) {
+    REQUIRE(ram_read_word(pool->instances[i]->cpu.ram, 0x2000000) != ram_read_word(pool->instances[0]->cpu.ram, 0x2000000));
+  }
+
+  for (GBA* gba : serial) {
+    gba_destroy(gba);
+  }
+  emulator_pool_destroy(pool);
+}
@@ -0,0 +1,86 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fork.h>
+#include <state_io.h>
+
+TEST_CASE("Forks", "[fork]") {
+  GBA* gba = gba_create();
+  ram_write_word(gba->cpu.ram, 0x2000100, 0x11111111);
+  ram_write_word(gba->cpu.ram, 0x3000100, 0x22222222);
+  ram_write_word(gba->cpu.ram, 0x6000100, 0x33333333);
+  ram_write_half_word(gba->cpu.ram, 0x5000002, 0x7FFF);
+  gba->cpu.registers[0] = 0x12345678;
+  gba->cpu.cycle_count = 1000;
+
+  std::vector<uint8_t> state;
+  state_serialize(*gba, state, false);
+
+  GBA* fork = gba_clone(gba);
+
+  SECTION("Same State") {
+    std::vector<uint8_t> gba_state, fork_state;
+    state_serialize(*gba, gba_state, false);
+    state_serialize(*fork, fork_state, false);
+    REQUIRE(fork_state.size() == gba_state.size());
+    REQUIRE(memcmp(fork_state.data(), gba_state.data(), gba_state.size()) == 0);
+  }
+
+  SECTION("Writes Stay Apart") {
+    ram_write_word(fork->cpu.ram, 0x2000100, 0xAAAAAAAA);
+    ram_write_word(gba->cpu.ram, 0x3000100, 0xBBBBBBBB);
+    ram_write_byte(fork->cpu.ram, 0x6000101, 0xCC);
+    REQUIRE(ram_read_word(gba->cpu.ram, 0x2000100) == 0x11111111);
+    REQUIRE(ram_read_word(fork->cpu.ram, 0x2000100) == 0xAAAAAAAA);
+    REQUIRE(ram_read_word(gba->cpu.ram, 0x3000100) == 0xBBBBBBBB);
+    REQUIRE(ram_read_word(fork->cpu.ram, 0x3000100) == 0x22222222);
+    REQUIRE(ram_read_word(gba->cpu.ram, 0x6000100) == 0x33333333);
+    REQUIRE(ram_read_word(fork->cpu.ram, 0x6000100) == 0x3333CC33);
+
+    // Untouched pages read the same on both.
+    REQUIRE(ram_read_half_word(fork->cpu.ram, 0x5000002) == 0x7FFF);
+    REQUIRE(ram_read_word(fork->cpu.ram, 0x2030000) == ram_read_word(gba->cpu.ram, 0x2030000));
+  }
+
+  SECTION("Later Forks") {
+    // Nothing written in between, the second fork maps the same file.
+    GBA* second = gba_clone(gba);
+    REQUIRE(second->cpu.ram.shareable_memory_file == fork->cpu.ram.shareable_memory_file);
+
+    ram_write_word(gba->cpu.ram, 0x2000100, 0x44444444);
+    GBA* third = gba_clone(gba);
+    REQUIRE(ram_read_word(third->cpu.ram, 0x2000100) == 0x44444444);
+    REQUIRE(ram_read_word(second->cpu.ram, 0x2000100) == 0x11111111);
+    REQUIRE(ram_read_word(fork->cpu.ram, 0x2000100) == 0x11111111);
+
+    // A fork of a fork, outliving its source.
+    GBA* nested = gba_clone(fork);
+    gba_destroy(fork);
+    fork = gba_clone(nested);
+    REQUIRE(ram_read_word(nested->cpu.ram, 0x3000100) == 0x22222222);
+    REQUIRE(ram_read_word(fork->cpu.ram, 0x6000100) == 0x33333333);
+
+    gba_destroy(nested);
+    gba_destroy(third);
+    gba_destroy(second);
+  }
+
+  SECTION("Restored Source") {
+    // Memory replaced without the write functions is written as far as later forks are concerned.
+    GBA* other = gba_create();
+    state_deserialize(*gba, state.data(), state.size());
+    ram_write_word(other->cpu.ram, 0x2000100, 0x55555555);
+    std::vector<uint8_t> other_state;
+    state_serialize(*other, other_state, false);
+    state_deserialize(*gba, other_state.data(), other_state.size());
+
+    GBA* second = gba_clone(gba);
+    REQUIRE(ram_read_word(second->cpu.ram, 0x2000100) == 0x55555555);
+    gba_destroy(second);
+    gba_destroy(other);
+  }
+
+  gba_destroy(fork);
+  gba_destroy(gba);
+}
@@ -0,0 +1,58 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <gba.h>
+
+// b . - keeps the CPU busy without touching memory.
+static constexpr uint32_t LOOP_BIOS = 0xEAFFFFFE;
+
+static GBA* frame_skip_test_create() {
+  GBA* gba = gba_create();
+  gba_load_bios_from_memory(gba, &LOOP_BIOS, sizeof(LOOP_BIOS));
+  // VBlank, HBlank and VCount interrupts on, matching line 100. BG2 in mode 3, so drawn frames show VRAM.
+  ram_write_half_word(gba->cpu.ram, REG_LCD_STATUS, (100 << 8) | (1 << 5) | (1 << 4) | (1 << 3));
+  ram_write_half_word(gba->cpu.ram, REG_LCD_CONTROL, (1 << 10) | 3);
+  return gba;
+}
+
+TEST_CASE("Frame Skip", "[gpu]") {
+  GBA* every_frame = frame_skip_test_create();
+  GBA* skipping = frame_skip_test_create();
+  gba_set_frame_skip(skipping, 1, 4);
+
+  // Four frames, cycle by cycle. The display timing and interrupts don't depend on whether a frame is drawn.
+  uint32_t drawn_frames = 0;
+  for (uint32_t frame = 0; frame < 4; frame++) {
+    uint64_t frame_sequence = gba_get_frame_sequence(skipping);
+    ram_write_half_word(every_frame->cpu.ram, VRAM_START, (uint16_t)(frame + 1));
+    ram_write_half_word(skipping->cpu.ram, VRAM_START, (uint16_t)(frame + 1));
+
+    for (uint32_t cycle = 0; cycle < 228 * 1232; cycle++) {
+      gba_cycle(*every_frame);
+      gba_cycle(*skipping);
+
+      RAM& expected = every_frame->cpu.ram;
+      RAM& actual = skipping->cpu.ram;
+      if (ram_read_byte(actual, REG_VERTICAL_COUNT) != ram_read_byte(expected, REG_VERTICAL_COUNT) ||
+          ram_read_half_word(actual, REG_LCD_STATUS) != ram_read_half_word(expected, REG_LCD_STATUS) ||
+          ram_read_half_word(actual, REG_INTERRUPT_REQUEST_FLAGS) != ram_read_half_word(expected, REG_INTERRUPT_REQUEST_FLAGS)) {
+        FAIL("Timing differs at frame " << frame << ", cycle " << cycle);
+      }
+    }
+
+    // Both end frames at the same time, only one frame in four is drawn.
+    REQUIRE(gba_get_frame_sequence(skipping) == frame_sequence + 1);
+    REQUIRE(gba_get_frame_sequence(every_frame) == frame_sequence + 1);
+    REQUIRE((gba_get_framebuffer(every_frame)[0] & 0x7FFF) == frame + 1);
+    if ((gba_get_framebuffer(skipping)[0] & 0x7FFF) == frame + 1) {
+      drawn_frames++;
+    }
+  }
+  REQUIRE(drawn_frames == 1);
+
+  // The interrupts were raised, so the comparison above saw them.
+  uint16_t interrupts = ram_read_half_word(skipping->cpu.ram, REG_INTERRUPT_REQUEST_FLAGS);
+  REQUIRE((interrupts & 0x7) == 0x7);
+
+  gba_destroy(skipping);
+  gba_destroy(every_frame);
+}
@@ -0,0 +1,80 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <gba.h>
+
+static constexpr uint16_t KEY_A = 1 << 0;
+static constexpr uint16_t KEY_B = 1 << 1;
+static constexpr uint16_t KEY_START = 1 << 3;
+
+static bool keypad_interrupt_requested(GBA& gba) {
+  return (ram_read_half_word(gba.cpu.ram, REG_INTERRUPT_REQUEST_FLAGS) & INTERRUPT_KEYPAD) != 0;
+}
+
+TEST_CASE("Keypad Interrupt", "[gba]") {
+  GBA* gba = gba_create();
+  RAM& ram = gba->cpu.ram;
+
+  SECTION("Any Key") {
+    ram_write_half_word(ram, REG_KEY_INTERRUPT_CONTROL, REG_KEY_INTERRUPT_CONTROL_ENABLE | KEY_A | KEY_B);
+    gba_set_keys(*gba, KEY_START);
+    REQUIRE_FALSE(keypad_interrupt_requested(*gba));
+    gba_set_keys(*gba, KEY_B);
+    REQUIRE(keypad_interrupt_requested(*gba));
+  }
+
+  SECTION("All Keys") {
+    ram_write_half_word(ram, REG_KEY_INTERRUPT_CONTROL,
+                        REG_KEY_INTERRUPT_CONTROL_ENABLE | REG_KEY_INTERRUPT_CONTROL_ALL_KEYS | KEY_A | KEY_B);
+    gba_set_keys(*gba, KEY_A);
+    REQUIRE_FALSE(keypad_interrupt_requested(*gba));
+    gba_set_keys(*gba, KEY_A | KEY_B);
+    REQUIRE(keypad_interrupt_requested(*gba));
+  }
+
+  SECTION("Disabled") {
+    ram_write_half_word(ram, REG_KEY_INTERRUPT_CONTROL, KEY_A);
+    gba_set_keys(*gba, KEY_A);
+    REQUIRE_FALSE(keypad_interrupt_requested(*gba));
+  }
+
+  SECTION("Enabling With Keys Held") {
+    gba_set_keys(*gba, KEY_A);
+    ram_write_half_word(ram, REG_KEY_INTERRUPT_CONTROL, REG_KEY_INTERRUPT_CONTROL_ENABLE | KEY_A);
+    REQUIRE(keypad_interrupt_requested(*gba));
+  }
+
+  SECTION("Byte Writes") {
+    gba_set_keys(*gba, KEY_A);
+    ram_write_byte(ram, REG_KEY_INTERRUPT_CONTROL, KEY_A);
+    REQUIRE_FALSE(keypad_interrupt_requested(*gba));
+    ram_write_byte(ram, REG_KEY_INTERRUPT_CONTROL + 1, REG_KEY_INTERRUPT_CONTROL_ENABLE >> 8);
+    REQUIRE(ram_read_half_word(ram, REG_KEY_INTERRUPT_CONTROL) == (REG_KEY_INTERRUPT_CONTROL_ENABLE | KEY_A));
+    REQUIRE(keypad_interrupt_requested(*gba));
+    ram_write_byte(ram, REG_KEY_INTERRUPT_CONTROL, KEY_B);
+    REQUIRE(ram_read_half_word(ram, REG_KEY_INTERRUPT_CONTROL) == (REG_KEY_INTERRUPT_CONTROL_ENABLE | KEY_B));
+  }
+
+  SECTION("Word Write Through KEYINPUT") {
+    gba_set_keys(*gba, KEY_A);
+    ram_write_word(ram, REG_KEY_STATUS, KEY_B << 16);
+    REQUIRE(ram_read_half_word(ram, REG_KEY_INTERRUPT_CONTROL) == KEY_B);
+    REQUIRE(ram_read_half_word(ram, REG_KEY_STATUS) == (~KEY_A & 0x3FF));
+    ram_write_word(ram, REG_KEY_STATUS, 0);
+    REQUIRE(ram_read_half_word(ram, REG_KEY_INTERRUPT_CONTROL) == 0);
+    ram_write_byte(ram, REG_KEY_STATUS + 1, 0);
+    REQUIRE(ram_read_half_word(ram, REG_KEY_STATUS) == (~KEY_A & 0x3FF));
+  }
+
+  SECTION("Halt") {
+    ram_write_byte(ram, REG_POST_BOOT_FLAG, 1);
+    REQUIRE_FALSE(gba->cpu.halted);
+    ram_write_half_word(ram, REG_POST_BOOT_FLAG, 0x0001);
+    REQUIRE(gba->cpu.halted);
+    REQUIRE(ram_read_byte(ram, REG_POST_BOOT_FLAG) == 1);
+    gba->cpu.halted = false;
+    ram_write_byte(ram, REG_HALT_CONTROL, 0);
+    REQUIRE(gba->cpu.halted);
+  }
+
+  gba_destroy(gba);
+}
@@ -0,0 +1,55 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <vector>
+#include <lz.h>
+
+TEST_CASE("LZ compression", "[lz]") {
+  // Runs, repeats further back and noise, so both literals and matches are exercised.
+  std::vector<uint8_t> data(0x10000);
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < data.size(); i++) {
+    seed = seed * 1103515245 + 12345;
+    if (i < 0x1000) {
+      data[i] = 0;
+    } else if (i < 0x8000) {
+      data[i] = data[i - 0x1000] ^ (i % 97 == 0 ? 1 : 0);
+    } else {
+      data[i] = (uint8_t)(seed >> 16);
+    }
+  }
+
+  std::vector<uint8_t> compressed;
+  lz_compress(data.data(), data.size(), compressed);
+
+  SECTION("Round Trip") {
+    REQUIRE(compressed.size() < data.size());
+
+    std::vector<uint8_t> decompressed(data.size());
+    REQUIRE(lz_decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size()));
+    REQUIRE(decompressed == data);
+  }
+
+  SECTION("Empty Input") {
+    std::vector<uint8_t> empty;
+    lz_compress(nullptr, 0, empty);
+
+    uint8_t out = 0;
+    REQUIRE(lz_decompress(empty.data(), empty.size(), &out, 0));
+  }
+
+  SECTION("Malformed Input") {
+    std::vector<uint8_t> decompressed(data.size());
+
+    // Cut short.
+    REQUIRE_FALSE(lz_decompress(compressed.data(), compressed.size() / 2, decompressed.data(), decompressed.size()));
+
+    // Does not fill the output, or overflows it.
+    REQUIRE_FALSE(lz_decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size() + 1));
+    REQUIRE_FALSE(lz_decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size() - 1));
+
+    // A match reaching back before the start of the output.
+    uint8_t bad_offset[] = {0x14, 'a', 0xFF, 0x00};
+    uint8_t out[16];
+    REQUIRE_FALSE(lz_decompress(bad_offset, sizeof(bad_offset), out, sizeof(out)));
+  }
+}
@@ -0,0 +1,117 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <movie.h>
+
+// Offsets of the header fields the tests damage.
+static constexpr size_t MOVIE_HEADER_SIZE = 32;
+static constexpr size_t MOVIE_VERSION_OFFSET = 8;
+static constexpr size_t MOVIE_FRAME_COUNT_OFFSET = 12;
+static constexpr size_t MOVIE_STATE_SIZE_OFFSET = 24;
+static constexpr size_t MOVIE_RUN_COUNT_OFFSET = 28;
+
+static void patch_word(std::vector<uint8_t>& data, size_t offset, uint32_t value) {
+  memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+static uint32_t read_word(std::vector<uint8_t> const& data, size_t offset) {
+  uint32_t value;
+  memcpy(&value, data.data() + offset, sizeof(value));
+  return value;
+}
+
+TEST_CASE("Movie Serialization", "[movie]") {
+  Movie* movie = movie_create(MOVIE_RECORDING);
+  movie->rom_hash = 0x0123456789ABCDEF;
+  movie->start_state = {1, 2, 3, 4, 5, 6, 7};
+  // Three runs, the last long enough to need two varint bytes.
+  movie->frame_keys.insert(movie->frame_keys.end(), 5, 0x0001);
+  movie->frame_keys.insert(movie->frame_keys.end(), 1, 0x0302);
+  movie->frame_keys.insert(movie->frame_keys.end(), 200, 0x0000);
+
+  std::vector<uint8_t> data;
+  movie_serialize(*movie, data);
+
+  SECTION("Round Trip") {
+    REQUIRE(data.size() == MOVIE_HEADER_SIZE + 7 + 3 + 3 + 4);
+    REQUIRE(read_word(data, MOVIE_RUN_COUNT_OFFSET) == 3);
+
+    Movie* loaded = movie_deserialize(data.data(), data.size());
+    REQUIRE(loaded->mode == MOVIE_PLAYING);
+    REQUIRE(loaded->rom_hash == movie->rom_hash);
+    REQUIRE(loaded->start_state == movie->start_state);
+    REQUIRE(loaded->frame_keys == movie->frame_keys);
+
+    REQUIRE(movie_frame_keys(*loaded, 0x03FF) == 0x0001);
+    for (uint32_t frame = 1; frame < 206; frame++) {
+      movie_frame_keys(*loaded, 0);
+    }
+    REQUIRE(movie_finished(*loaded));
+    REQUIRE(movie_frame_keys(*loaded, 0x0004) == 0x0004);
+    movie_destroy(loaded);
+  }
+
+  SECTION("Empty Movie") {
+    movie->frame_keys.clear();
+    movie_serialize(*movie, data);
+    REQUIRE(data.size() == MOVIE_HEADER_SIZE + 7);
+
+    Movie* loaded = movie_deserialize(data.data(), data.size());
+    REQUIRE(loaded->frame_keys.empty());
+    REQUIRE(movie_finished(*loaded));
+    movie_destroy(loaded);
+  }
+
+  SECTION("Not A Movie") {
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), MOVIE_HEADER_SIZE - 1), "Error: Not a movie.");
+    data[0] ^= 0xFF;
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Not a movie.");
+  }
+
+  SECTION("Newer Version") {
+    patch_word(data, MOVIE_VERSION_OFFSET, MOVIE_VERSION + 1);
+    REQUIRE_THROWS(movie_deserialize(data.data(), data.size()));
+  }
+
+  SECTION("Truncated Start State") {
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), MOVIE_HEADER_SIZE + 6), "Error: Movie is truncated.");
+    patch_word(data, MOVIE_STATE_SIZE_OFFSET, 0xFFFFFFFF);
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Movie is truncated.");
+  }
+
+  SECTION("Truncated Runs") {
+    for (size_t size = MOVIE_HEADER_SIZE + 7; size < data.size(); size++) {
+      REQUIRE_THROWS_WITH(movie_deserialize(data.data(), size), "Error: Movie is corrupted.");
+    }
+  }
+
+  SECTION("Frame Count Mismatch") {
+    patch_word(data, MOVIE_FRAME_COUNT_OFFSET, 207);
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Movie is corrupted.");
+    patch_word(data, MOVIE_FRAME_COUNT_OFFSET, 205);
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Movie is corrupted.");
+  }
+
+  SECTION("Counts Larger Than The Data") {
+    // Turned down before the frames are allocated.
+    patch_word(data, MOVIE_FRAME_COUNT_OFFSET, 0xFFFFFFFF);
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Movie is corrupted.");
+    patch_word(data, MOVIE_FRAME_COUNT_OFFSET, 206);
+    patch_word(data, MOVIE_RUN_COUNT_OFFSET, 0xFFFFFFFF);
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Movie is corrupted.");
+  }
+
+  SECTION("Extra Run") {
+    patch_word(data, MOVIE_RUN_COUNT_OFFSET, 4);
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Movie is corrupted.");
+  }
+
+  SECTION("Unterminated Run Length") {
+    data.resize(data.size() - 2);
+    data.insert(data.end(), 5, 0xFF);
+    REQUIRE_THROWS_WITH(movie_deserialize(data.data(), data.size()), "Error: Movie is corrupted.");
+  }
+
+  movie_destroy(movie);
+}
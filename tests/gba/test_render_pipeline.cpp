@@ -0,0 +1,137 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <cstring>
+#include <gba.h>
+#include <render_pipeline.h>
+
+// b . - keeps the CPU busy without touching memory, the test does the writes a game would.
+static constexpr uint32_t LOOP_BIOS = 0xEAFFFFFE;
+
+struct SceneRandom {
+  uint32_t seed = 1;
+};
+
+static uint32_t scene_next(SceneRandom& random) {
+  random.seed = random.seed * 1664525 + 1013904223;
+  return random.seed;
+}
+
+static void scene_fill(GBA& gba, SceneRandom& random, uint32_t address, uint32_t size) {
+  for (uint32_t offset = 0; offset < size; offset += 4) {
+    ram_write_word(gba.cpu.ram, address + offset, scene_next(random));
+  }
+}
+
+// Random video memory with every layer, the sprites, both windows and blending turned on.
+static void scene_setup(GBA& gba, SceneRandom& random) {
+  RAM& ram = gba.cpu.ram;
+  gba_load_bios_from_memory(&gba, &LOOP_BIOS, sizeof(LOOP_BIOS));
+
+  scene_fill(gba, random, PALETTE_RAM_START, PALETTE_RAM_SIZE);
+  scene_fill(gba, random, VRAM_START, VRAM_SIZE);
+  scene_fill(gba, random, OAM_START, OAM_SIZE);
+  scene_fill(gba, random, 0x2000000, 0x8000);
+
+  for (uint32_t i = 0; i < 4; i++) {
+    ram_write_half_word(ram, REG_BG0_CONTROL + i * 2, (uint16_t)scene_next(random));
+  }
+  ram_write_half_word(ram, REG_BG2_PARAM_A, 0x0100);
+  ram_write_half_word(ram, REG_BG2_PARAM_B, 0x0020);
+  ram_write_half_word(ram, REG_BG2_PARAM_C, 0xFFE0);
+  ram_write_half_word(ram, REG_BG2_PARAM_D, 0x00F0);
+  ram_write_half_word(ram, REG_BG3_PARAM_A, 0x0080);
+  ram_write_half_word(ram, REG_BG3_PARAM_D, 0x0180);
+  ram_write_half_word(ram, REG_WINDOW0_HORIZONTAL, (20 << 8) | 200);
+  ram_write_half_word(ram, REG_WINDOW1_HORIZONTAL, (180 << 8) | 60);
+  ram_write_half_word(ram, REG_WINDOW0_VERTICAL, (10 << 8) | 150);
+  ram_write_half_word(ram, REG_WINDOW1_VERTICAL, (120 << 8) | 40);
+  ram_write_half_word(ram, REG_WINDOW_INSIDE, (uint16_t)scene_next(random));
+  ram_write_half_word(ram, REG_WINDOW_OUTSIDE, (uint16_t)scene_next(random));
+  ram_write_half_word(ram, REG_BLDCNT, (uint16_t)scene_next(random));
+  ram_write_half_word(ram, REG_BLDALPHA, 0x0808);
+  ram_write_half_word(ram, REG_BLDY, 0x0004);
+}
+
+static void scene_dma_to_vram(GBA& gba, uint32_t source, uint32_t destination, uint16_t words) {
+  ram_write_word(gba.cpu.ram, REG_DMA3_SOURCE_ADDRESS, source);
+  ram_write_word(gba.cpu.ram, REG_DMA3_DESTINATION_ADDRESS, destination);
+  ram_write_half_word(gba.cpu.ram, REG_DMA3_WORD_COUNT, words);
+  // Enabled, 32 bit units, started straight away.
+  ram_write_half_word(gba.cpu.ram, REG_DMA3_CONTROL, (1 << 15) | (1 << 10));
+}
+
+// The writes made while `line` is being drawn.
+static void scene_line(GBA& gba, SceneRandom& random, uint32_t line) {
+  RAM& ram = gba.cpu.ram;
+  static constexpr uint16_t ALL_LAYERS = 0x1F00 | (1 << 13) | (1 << 14) | (1 << 6);
+  switch (line) {
+    case 0: ram_write_half_word(ram, REG_LCD_CONTROL, ALL_LAYERS | 0); break;
+    case 20:
+      ram_write_half_word(ram, REG_BG0_X_OFFSET, (uint16_t)scene_next(random));
+      ram_write_half_word(ram, REG_BG1_Y_OFFSET, (uint16_t)scene_next(random));
+      break;
+    case 40: ram_write_half_word(ram, REG_LCD_CONTROL, ALL_LAYERS | 1); break;
+    case 50:
+      ram_write_word(ram, REG_BG2_X_REF, scene_next(random) & 0xFFFFF);
+      ram_write_half_word(ram, REG_BG2_Y_REF + 2, 0x0001);
+      break;
+    case 70: scene_dma_to_vram(gba, 0x2000000, VRAM_START, 0x800); break;
+    case 90:
+      ram_write_half_word(ram, REG_LCD_CONTROL, ALL_LAYERS | 2);
+      ram_write_word(ram, REG_BG3_X_REF, 0x2000);
+      ram_write_byte(ram, REG_BG2_PARAM_B, 0x40);
+      break;
+    case 110:
+      ram_write_half_word(ram, REG_LCD_CONTROL, ALL_LAYERS | 3);
+      scene_dma_to_vram(gba, 0x2002000, VRAM_START + 120 * FRAME_WIDTH * 2, 0x1000);
+      break;
+    case 130:
+      ram_write_half_word(ram, REG_LCD_CONTROL, ALL_LAYERS | (1 << 4) | 4);
+      ram_write_half_word(ram, PALETTE_RAM_START + 0x40, 0x7C1F);
+      break;
+    case 150: ram_write_half_word(ram, REG_LCD_CONTROL, ALL_LAYERS | 5); break;
+  }
+}
+
+// Runs from the start of VBlank to the start of the next one, making the scene's writes on the way.
+static void scene_run_frame(GBA& gba, SceneRandom& random) {
+  while (ram_read_byte(gba.cpu.ram, REG_VERTICAL_COUNT) != 0) {
+    gba_cycle(gba);
+  }
+  for (uint32_t line = 0; line < FRAME_HEIGHT; line++) {
+    scene_line(gba, random, line);
+    while (ram_read_byte(gba.cpu.ram, REG_VERTICAL_COUNT) == line) {
+      gba_cycle(gba);
+    }
+  }
+}
+
+TEST_CASE("Render Pipeline", "[gpu]") {
+  // One band, a few, and one per pair of lines.
+  uint32_t thread_count = GENERATE(1u, 4u, 80u);
+  GBA* reference = gba_create();
+  GBA* pipelined = gba_create();
+  REQUIRE(gba_set_render_threads(pipelined, thread_count) == 0);
+  REQUIRE(pipelined->gpu.render_pipeline->bands.size() == thread_count);
+
+  SceneRandom reference_random, pipelined_random;
+  scene_setup(*reference, reference_random);
+  scene_setup(*pipelined, pipelined_random);
+
+  for (uint32_t frame = 0; frame < 3; frame++) {
+    scene_run_frame(*reference, reference_random);
+    scene_run_frame(*pipelined, pipelined_random);
+    gba_wait_render(pipelined);
+    REQUIRE(memcmp(reference->gpu.frame_buffer, pipelined->gpu.frame_buffer, sizeof(reference->gpu.frame_buffer)) == 0);
+  }
+
+  // The frame was drawn, not left white.
+  uint32_t white = 0;
+  for (uint32_t i = 0; i < FRAME_BUFFER_SIZE; i++) {
+    white += reference->gpu.frame_buffer[i] == 0xFFFF;
+  }
+  REQUIRE(white < FRAME_BUFFER_SIZE / 2);
+
+  gba_destroy(pipelined);
+  gba_destroy(reference);
+}
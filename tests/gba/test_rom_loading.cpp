@@ -0,0 +1,25 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <string>
+#include <gba.h>
+
+TEST_CASE("ROM Loading", "[ram]") {
+  GBA* gba = gba_create();
+
+  SECTION("Size Not A Multiple Of 4") {
+    // The word holding the last byte is read from padding, which is zero.
+    uint8_t const rom[5] = {0x11, 0x22, 0x33, 0x44, 0x55};
+    REQUIRE(gba_load_rom_from_memory(gba, rom, sizeof(rom)) == 0);
+    REQUIRE(gba->cpu.ram.game_pak_rom_size == 5);
+    REQUIRE(ram_read_word(gba->cpu.ram, 0x8000000) == 0x44332211);
+    REQUIRE(ram_read_word(gba->cpu.ram, 0x8000004) == 0x00000055);
+    REQUIRE(ram_read_half_word(gba->cpu.ram, 0xA000004) == 0x0055);
+  }
+
+  SECTION("No Data") {
+    REQUIRE(gba_load_rom_from_memory(gba, nullptr, 4) == -1);
+    REQUIRE(std::string(gba_get_error()) == "Error: No ROM data.");
+  }
+
+  gba_destroy(gba);
+}
@@ -0,0 +1,70 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <vector>
+#include <gba.h>
+#include <snapshot.h>
+#include <state_io.h>
+
+// A frame's worth of writes to a few pages of work RAM, VRAM and OAM, plus some CPU and frame buffer changes.
+static void run_fake_frame(GBA& gba, uint32_t frame) {
+  for (uint32_t i = 0; i < 64; i++) {
+    ram_write_word(gba.cpu.ram, 0x3007E00 + (i * 4), frame * 1000 + i);
+    ram_write_half_word(gba.cpu.ram, 0x2001000 + (i * 2 + frame * 256) % 0x4000, (uint16_t)(frame + i));
+  }
+  ram_write_half_word(gba.cpu.ram, 0x6000000 + frame * 2, 0x7FFF);
+  ram_write_half_word(gba.cpu.ram, 0x7000000 + frame * 8, (uint16_t)frame);
+  gba.cpu.registers[frame % 13] = frame * 3;
+  gba.cpu.cycle_count += 280896;
+  gba.gpu.frame_buffer[frame * 100] = (uint16_t)frame;
+}
+
+TEST_CASE("Snapshot deltas", "[snapshot]") {
+  GBA* gba = gba_create();
+  for (uint32_t i = 0; i < 0x40000; i++) {
+    gba->cpu.ram.external_working_ram[i] = (uint8_t)(i % 5);
+  }
+
+  SnapshotArena* arena = snapshot_arena_create(2);
+  snapshot_t base = snapshot_take(*arena, *gba);
+
+  std::vector<SnapshotDelta> deltas(6);
+  std::vector<std::vector<uint8_t>> expected(6);
+  for (uint32_t frame = 0; frame < 6; frame++) {
+    run_fake_frame(*gba, frame);
+    REQUIRE(snapshot_take_delta(*arena, base, *gba, deltas[frame]));
+    state_serialize(*gba, expected[frame], false);
+  }
+
+  SECTION("Restore In Any Order") {
+    for (uint32_t frame : {3u, 5u, 0u, 4u, 1u}) {
+      REQUIRE(snapshot_restore_delta(*arena, deltas[frame], *gba));
+      std::vector<uint8_t> state;
+      state_serialize(*gba, state, false);
+      REQUIRE(state == expected[frame]);
+    }
+  }
+
+  SECTION("Deltas Only Hold What Changed") {
+    // Far smaller than a full slot, which holds all of the memory regions.
+    REQUIRE(deltas[5].data.size() < arena->slot_size / 20);
+  }
+
+  SECTION("Damaged Delta Is Rejected") {
+    SnapshotDelta damaged = deltas[2];
+    damaged.data.resize(damaged.data.size() / 2);
+    REQUIRE_FALSE(snapshot_restore_delta(*arena, damaged, *gba));
+
+    std::vector<uint8_t> state;
+    state_serialize(*gba, state, false);
+    REQUIRE(state == expected[5]);
+  }
+
+  SECTION("Delta Against An Overwritten Base") {
+    snapshot_take(*arena, *gba);
+    snapshot_take(*arena, *gba);
+    REQUIRE_FALSE(snapshot_restore_delta(*arena, deltas[0], *gba));
+  }
+
+  snapshot_arena_destroy(arena);
+  gba_destroy(gba);
+}
@@ -0,0 +1,114 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <gba.h>
+#include <render_pipeline.h>
+#include <state_io.h>
+
+// Sections are a 16 byte header (tag, flags, size, stored size) followed by the stored data.
+static constexpr size_t STATE_HEADER_SIZE = 16;
+static constexpr size_t STATE_SECTION_HEADER_SIZE = 16;
+
+// b . - keeps the CPU busy while frames are drawn.
+static constexpr uint32_t LOOP_BIOS = 0xEAFFFFFE;
+
+TEST_CASE("Save states", "[state]") {
+  GBA* gba = gba_create();
+  gba->cpu.registers[0] = 0x12345678;
+  gba->cpu.cycle_count = 1000;
+  gba->cpu.ram.external_working_ram[0x100] = 0xAB;
+  gba->cpu.ram.video_ram[0x200] = 0xCD;
+  gba->timer.counters[2] = 0x4321;
+  gba->gpu.affine_ref_x[1] = -256;
+
+  SECTION("Round Trip") {
+    for (bool compress : {false, true}) {
+      std::vector<uint8_t> state;
+      state_serialize(*gba, state, compress);
+
+      GBA* restored = gba_create();
+      REQUIRE_NOTHROW(state_deserialize(*restored, state.data(), state.size()));
+      REQUIRE(restored->cpu.registers[0] == 0x12345678);
+      REQUIRE(restored->cpu.cycle_count == 1000);
+      REQUIRE(restored->cpu.ram.external_working_ram[0x100] == 0xAB);
+      REQUIRE(restored->cpu.ram.video_ram[0x200] == 0xCD);
+      REQUIRE(restored->timer.counters[2] == 0x4321);
+      REQUIRE(restored->gpu.affine_ref_x[1] == -256);
+
+      // Saving the restored instance gives the same state back.
+      std::vector<uint8_t> again;
+      state_serialize(*restored, again, compress);
+      REQUIRE(again == state);
+      gba_destroy(restored);
+    }
+  }
+
+  SECTION("Damaged State Leaves The Instance Untouched") {
+    std::vector<uint8_t> state;
+    state_serialize(*gba, state, false);
+
+    GBA* target = gba_create();
+    target->cpu.registers[0] = 7;
+    target->cpu.ram.external_working_ram[0x100] = 0x11;
+
+    // Shorten the last section (APU) by a byte. It still decodes, but comes up short once it is read,
+    // after the CPU and memory sections in front of it.
+    std::vector<uint8_t> damaged = state;
+    size_t offset = STATE_HEADER_SIZE;
+    size_t last_section = 0;
+    while (offset < damaged.size()) {
+      uint32_t stored_size;
+      memcpy(&stored_size, damaged.data() + offset + 12, sizeof(stored_size));
+      last_section = offset;
+      offset += STATE_SECTION_HEADER_SIZE + stored_size;
+    }
+    for (size_t field = 8; field <= 12; field += 4) {
+      uint32_t section_size;
+      memcpy(&section_size, damaged.data() + last_section + field, sizeof(section_size));
+      section_size--;
+      memcpy(damaged.data() + last_section + field, &section_size, sizeof(section_size));
+    }
+    damaged.pop_back();
+
+    REQUIRE_THROWS(state_deserialize(*target, damaged.data(), damaged.size()));
+    REQUIRE(target->cpu.registers[0] == 7);
+    REQUIRE(target->cpu.ram.external_working_ram[0x100] == 0x11);
+
+    // Cut off in the middle of a section.
+    REQUIRE_THROWS(state_deserialize(*target, state.data(), state.size() / 2));
+    REQUIRE(target->cpu.registers[0] == 7);
+
+    REQUIRE_THROWS(state_deserialize(*target, state.data(), 4));
+    gba_destroy(target);
+  }
+
+  SECTION("Oversized Section") {
+    std::vector<uint8_t> state;
+    state_serialize(*gba, state, true);
+
+    // A section claiming 4 GB is turned down before anything is allocated for it.
+    uint32_t size = 0xFFFFFFFF;
+    memcpy(state.data() + STATE_HEADER_SIZE + 8, &size, sizeof(size));
+    REQUIRE_THROWS_WITH(state_deserialize(*gba, state.data(), state.size()), "Error: Save state section is corrupted.");
+  }
+
+  SECTION("Render Pipeline Settled") {
+    gba_load_bios_from_memory(gba, &LOOP_BIOS, sizeof(LOOP_BIOS));
+    REQUIRE(gba_set_render_threads(gba, 4) == 0);
+    gba_run_frame(*gba);
+    gba_run_frame(*gba);
+
+    // The bands of the last frame are finished before the frame buffer is saved.
+    std::vector<uint8_t> state;
+    state_serialize(*gba, state, false);
+    REQUIRE(gba->gpu.render_pipeline->bands_remaining == 0);
+
+    GBA* restored = gba_create();
+    state_deserialize(*restored, state.data(), state.size());
+    REQUIRE(memcmp(restored->gpu.frame_buffer, gba->gpu.frame_buffer, sizeof(gba->gpu.frame_buffer)) == 0);
+    gba_destroy(restored);
+  }
+
+  gba_destroy(gba);
+}
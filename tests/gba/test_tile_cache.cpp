@@ -0,0 +1,81 @@
+#include <catch_amalgamated.hpp>
+#include <cstdint>
+#include <cstring>
+#include <gba.h>
+#include <tile_cache.h>
+
+// b . - keeps the CPU busy while the DMA runs.
+static constexpr uint32_t LOOP_BIOS = 0xEAFFFFFE;
+
+// The palette indices a tile expands to, straight from VRAM.
+static void tile_test_expand(uint8_t const* vram, uint32_t address, bool is_256_color_mode, bool horizontal_flip, uint8_t (&out)[64]) {
+  for (uint32_t y = 0; y < 8; y++) {
+    for (uint32_t x = 0; x < 8; x++) {
+      uint32_t source_x = horizontal_flip ? 7 - x : x;
+      uint32_t pixel = y * 8 + source_x;
+      uint8_t index = is_256_color_mode ? vram[address + pixel] : vram[address + pixel / 2] >> (pixel % 2 * 4) & 0xF;
+      out[y * 8 + x] = index;
+    }
+  }
+}
+
+static bool tile_test_cached(TileCache const& cache, uint32_t address, bool is_256_color_mode) {
+  uint32_t tile = address / (is_256_color_mode ? 64 : 32);
+  uint64_t const* valid = is_256_color_mode ? cache.valid_8bpp : cache.valid_4bpp;
+  return (valid[tile >> 6] >> (tile & 63)) & 1;
+}
+
+// Syncs the cache with the VRAM writes as a frame would, then checks both copies of the tile against VRAM.
+static void tile_test_check(GBA& gba, uint32_t address, bool is_256_color_mode) {
+  TileCache& cache = *gba.gpu.tile_cache;
+  tile_cache_sync(cache, gba.cpu.ram.vram_dirty_blocks);
+  for (bool horizontal_flip : {false, true}) {
+    uint8_t expected[64];
+    tile_test_expand(gba.cpu.ram.video_ram, address, is_256_color_mode, horizontal_flip, expected);
+    uint8_t const* tile = tile_cache_get_tile(cache, gba.cpu.ram.video_ram, address, is_256_color_mode, horizontal_flip);
+    REQUIRE(memcmp(tile, expected, sizeof(expected)) == 0);
+  }
+  REQUIRE(tile_test_cached(cache, address, is_256_color_mode));
+}
+
+TEST_CASE("Tile Cache", "[gpu]") {
+  bool is_256_color_mode = GENERATE(false, true);
+  bool use_dma = GENERATE(false, true);
+
+  GBA* gba = gba_create();
+  RAM& ram = gba->cpu.ram;
+  gba_load_bios_from_memory(gba, &LOOP_BIOS, sizeof(LOOP_BIOS));
+
+  // Tile 5 of its size, filled with distinct indices, then cached.
+  uint32_t tile_size = is_256_color_mode ? 64 : 32;
+  uint32_t address = 5 * tile_size;
+  for (uint32_t offset = 0; offset < tile_size; offset += 4) {
+    ram_write_word(ram, VRAM_START + address + offset, 0x01234567 * (offset + 1));
+  }
+  tile_test_check(*gba, address, is_256_color_mode);
+
+  // Rewrite a word in the last row, the second 32 bytes of an 8bpp tile.
+  uint32_t changed = address + tile_size - 8;
+  uint32_t value = 0x76543210;
+  if (use_dma) {
+    ram_write_word(ram, 0x2000000, value);
+    ram_write_word(ram, REG_DMA3_SOURCE_ADDRESS, 0x2000000);
+    ram_write_word(ram, REG_DMA3_DESTINATION_ADDRESS, VRAM_START + changed);
+    ram_write_half_word(ram, REG_DMA3_WORD_COUNT, 1);
+    // Enabled, 32 bit units, started straight away.
+    ram_write_half_word(ram, REG_DMA3_CONTROL, (1 << 15) | (1 << 10));
+    while (ram_read_half_word(ram, REG_DMA3_CONTROL) & (1 << 15)) {
+      gba_cycle(*gba);
+    }
+  } else {
+    ram_write_word(ram, VRAM_START + changed, value);
+  }
+  REQUIRE(ram_read_word(ram, VRAM_START + changed) == value);
+
+  // The write dropped the cached tile, and both copies are rebuilt from the new data.
+  tile_cache_sync(*gba->gpu.tile_cache, ram.vram_dirty_blocks);
+  REQUIRE_FALSE(tile_test_cached(*gba->gpu.tile_cache, address, is_256_color_mode));
+  tile_test_check(*gba, address, is_256_color_mode);
+
+  gba_destroy(gba);
+}